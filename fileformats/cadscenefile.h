@@ -222,6 +222,14 @@ typedef struct _CSFLoaderConfig
   // therefore be mapped to a single CSF geometry.
   // default = 1
   int gltfFindUniqueGeometries;
+
+  // allocations of CSFileMemory are bump-allocated from per-thread
+  // chunks rather than individually malloc'ed, and all freed at
+  // once by CSFileMemory_delete. Makes loading and deleting files
+  // with many objects faster, at the cost of some unused memory
+  // at the end of the chunks.
+  // default = 0
+  int arenaAllocator;
 } CSFLoaderConfig;
 
 typedef uint64_t CSFoffset;
@@ -724,6 +732,12 @@ CSFAPI int CSFile_save(const CSFile* csf, const char* filename);
 
 // support for other extensions depends on
 // CSF_ZIP_SUPPORT, CSF_GLTF2_SUPPORT
+//
+// ".gz" files are saved as a sequence of independently compressed gzip members
+// (one per 4 MB block) with a block index in the first member's header.
+// Blocks are compressed and inflated in parallel, the latter directly into
+// the provided file memory. The result remains a valid gzip file, and plain
+// single-stream gzip files are still loaded as before.
 
 CSFAPI int CSFile_loadExt(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem);
 
@@ -833,6 +847,76 @@ CSFAPI void* CSFileHandle_loadElementsInto(CSFileHandlePTR        handle,
                                            CSFileMemoryPTR        mem,
                                            size_t                 pimarySize,
                                            void*                  primaryArray);
+
+//////////////////////////////////////////////////////////////////////////
+
+// The CSFResidency keeps materials and the node hierarchy of an uncompressed file
+// resident and streams geometry content in and out under a host memory budget.
+//
+// - CSFResidency_request queues geometries that are not resident. Their file ranges
+//   are sorted and coalesced into few larger reads, which are done asynchronously
+//   by the residency's own threads (each using its own file handle).
+// - CSFResidency_update publishes finished reads and, while over budget, evicts
+//   the reads whose geometries were least recently requested or accessed.
+//   Geometries touched since the previous update are never evicted.
+//   Geometries sharing a read are evicted together.
+// - Pointers returned by CSFResidency_getGeometry stay valid until the next update.
+// - The functions must be called from a single thread.
+
+typedef struct CSFResidency_s* CSFResidencyPTR;
+
+typedef struct _CSFResidencyConfig
+{
+  // host memory budget for resident geometry content in bytes,
+  // 0 means unlimited
+  // default = 0
+  size_t budget;
+
+  // coalesced reads do not grow beyond this size (single geometries can be bigger)
+  // default = 8 MB
+  size_t maxReadSize;
+
+  // geometries whose content is at most this many bytes apart
+  // within the file are fetched with the same read
+  // default = 64 KB
+  size_t maxReadGap;
+
+  // threads used for fetching
+  // default = 2
+  uint32_t numThreads;
+} CSFResidencyConfig;
+
+typedef struct _CSFResidencyStats
+{
+  size_t   residentBytes;
+  uint32_t residentGeometries;
+  uint32_t pendingGeometries;
+
+  // accumulated over lifetime
+  uint64_t numReads;
+  uint64_t readBytes;
+  uint64_t evictedGeometries;
+} CSFResidencyStats;
+
+// config can be nullptr for defaults.
+// The CSFile returned by CSFResidency_getFile is allocated within mem, which must outlive the residency.
+CSFAPI int  CSFResidency_open(CSFResidencyPTR* pResidency, const char* filename, const CSFResidencyConfig* config, CSFileMemoryPTR mem);
+CSFAPI void CSFResidency_close(CSFResidencyPTR residency);
+
+// materials and nodes come with their content, geometries only with their primary struct (pointers are null)
+// metas are not loaded
+CSFAPI const CSFile* CSFResidency_getFile(CSFResidencyPTR residency);
+
+// marks geometries as used and queues loading of those that are neither resident nor pending
+CSFAPI void CSFResidency_request(CSFResidencyPTR residency, uint32_t numGeometries, const int* geometryIDXs);
+// returns nullptr if not resident yet, otherwise marks geometry as used
+CSFAPI const CSFGeometry* CSFResidency_getGeometry(CSFResidencyPTR residency, int geometryIDX);
+// typically called once per frame
+CSFAPI void CSFResidency_update(CSFResidencyPTR residency);
+// blocks until all queued reads are done and publishes them, does not evict
+CSFAPI void CSFResidency_wait(CSFResidencyPTR residency);
+
+CSFAPI void CSFResidency_getStats(CSFResidencyPTR residency, CSFResidencyStats* stats);
 };
 
 #define CSF_logPrintf(outlog, ...)                                                                                     \
@@ -29,8 +29,13 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -702,12 +707,94 @@ struct CSFileMemory_s
 
   std::vector<csfutils::FileReadMapping> m_readMappings;
 
+  // arena mode: each thread bump-allocates from its own chunks
+  struct Arena
+  {
+    char*              current = nullptr;
+    size_t             used    = 0;
+    size_t             size    = 0;
+    std::vector<void*> chunks;
+  };
+  static const size_t ARENA_CHUNK_SIZE = 4 * 1024 * 1024;
+  static const size_t ARENA_ALIGNMENT  = 16;
+
+  // protected by m_mutex, only looked up when a thread first allocates
+  std::vector<std::pair<std::thread::id, std::unique_ptr<Arena>>> m_arenas;
+  // unique per memory object, so threads can cache their arena
+  uint64_t m_serial;
+
+  static uint64_t nextSerial()
+  {
+    static std::atomic<uint64_t> s_serial{0};
+    return ++s_serial;
+  }
+
+  Arena* getThreadArena()
+  {
+    struct ThreadCache
+    {
+      uint64_t serial = 0;
+      Arena*   arena  = nullptr;
+    };
+    static thread_local ThreadCache cache;
+    if(cache.serial == m_serial)
+    {
+      return cache.arena;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::thread::id             threadID = std::this_thread::get_id();
+    Arena*                      arena    = nullptr;
+    for(auto& it : m_arenas)
+    {
+      if(it.first == threadID)
+      {
+        arena = it.second.get();
+        break;
+      }
+    }
+    if(!arena)
+    {
+      m_arenas.emplace_back(threadID, std::make_unique<Arena>());
+      arena = m_arenas.back().second.get();
+    }
+    cache.serial = m_serial;
+    cache.arena  = arena;
+    return arena;
+  }
+
+  void* arenaAlloc(size_t size)
+  {
+    Arena* arena   = getThreadArena();
+    size_t aligned = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    if(arena->used + aligned > arena->size)
+    {
+      // large allocations get their own chunk, the current one stays in use
+      if(aligned > ARENA_CHUNK_SIZE / 4)
+      {
+        void* data = malloc(size);
+        arena->chunks.push_back(data);
+        return data;
+      }
+
+      arena->current = (char*)malloc(ARENA_CHUNK_SIZE);
+      arena->used    = 0;
+      arena->size    = ARENA_CHUNK_SIZE;
+      arena->chunks.push_back(arena->current);
+    }
+
+    void* data = arena->current + arena->used;
+    arena->used += aligned;
+    return data;
+  }
+
   void* alloc(size_t size, const void* indata = nullptr, size_t indataSize = 0)
   {
     if(size == 0)
       return nullptr;
 
-    void* data = malloc(size);
+    void* data = m_config.arenaAllocator ? arenaAlloc(size) : malloc(size);
     if(indata == CSF_MEMORY_ZEROED_FILL)
     {
       memset(data, 0, size);
@@ -718,6 +805,7 @@ struct CSFileMemory_s
       memcpy(data, indata, indataSize);
     }
 
+    if(!m_config.arenaAllocator)
     {
       std::lock_guard<std::mutex> lock(m_mutex);
       m_allocations.push_back(data);
@@ -736,10 +824,21 @@ struct CSFileMemory_s
     m_config.secondariesReadOnly      = 0;
     m_config.validate                 = 1;
     m_config.gltfFindUniqueGeometries = 1;
+    m_config.arenaAllocator           = 0;
+    m_serial                          = nextSerial();
   }
 
   ~CSFileMemory_s()
   {
+    for(auto& it : m_arenas)
+    {
+      for(void* chunk : it.second->chunks)
+      {
+        free(chunk);
+      }
+    }
+    m_arenas.clear();
+
     size_t numThreads = (std::thread::hardware_concurrency() + 1) / 2;
 
     if(m_allocations.size() > 2048)
@@ -1481,6 +1580,173 @@ CSFAPI int CSFile_load(CSFile** outcsf, const char* filename, CSFileMemoryPTR me
   }
 }
 
+#if CSF_SUPPORT_ZLIB
+// Block-compressed .gz container
+//
+// The file is a sequence of independent gzip members, one per block of
+// `blockSize` uncompressed bytes, so every gzip reader still sees the plain
+// csf byte stream. The first member's header carries an FEXTRA subfield 'C','S'
+// with the block index, which lets loaders inflate all blocks in parallel:
+//
+//   uint32_t version (1), uint32_t blockSize, uint64_t rawSize, uint32_t numBlocks,
+//   uint32_t memberSizes[numBlocks] (compressed size of each member including its header/trailer)
+//
+// Files lacking the subfield (e.g. written by gzip itself) use the streaming path.
+
+#define CSF_GZBLOCKS_VERSION 1
+#define CSF_GZBLOCKS_SIZE (4 * 1024 * 1024)
+#define CSF_GZBLOCKS_MAXBLOCKS ((0xFFFF - 4 - 20) / 4)
+
+static inline uint32_t CSFile_gzGet32(const uint8_t* ptr)
+{
+  return uint32_t(ptr[0]) | (uint32_t(ptr[1]) << 8) | (uint32_t(ptr[2]) << 16) | (uint32_t(ptr[3]) << 24);
+}
+
+static inline void CSFile_gzPut32(uint8_t* ptr, uint32_t value)
+{
+  ptr[0] = uint8_t(value);
+  ptr[1] = uint8_t(value >> 8);
+  ptr[2] = uint8_t(value >> 16);
+  ptr[3] = uint8_t(value >> 24);
+}
+
+struct CSFGZBlockIndex
+{
+  uint32_t       blockSize   = 0;
+  uint64_t       rawSize     = 0;
+  uint32_t       numBlocks   = 0;
+  const uint8_t* memberSizes = nullptr;
+  size_t         headerSize  = 0;  // size of the first member's header
+};
+
+// returns true if `data` starts with a gzip header holding our block index
+static bool CSFile_gzParseBlockIndex(const uint8_t* data, size_t dataSize, CSFGZBlockIndex& index)
+{
+  // ID1 ID2 CM FLG MTIME(4) XFL OS XLEN(2), we only write FEXTRA
+  if(dataSize < 12 || data[0] != 0x1f || data[1] != 0x8b || data[2] != 8 || data[3] != 4)
+  {
+    return false;
+  }
+
+  size_t extraSize = size_t(data[10]) | (size_t(data[11]) << 8);
+  if(12 + extraSize > dataSize)
+  {
+    return false;
+  }
+
+  const uint8_t* sub    = data + 12;
+  const uint8_t* subEnd = sub + extraSize;
+  while(sub + 4 <= subEnd)
+  {
+    size_t subSize = size_t(sub[2]) | (size_t(sub[3]) << 8);
+    if(sub + 4 + subSize > subEnd)
+    {
+      return false;
+    }
+    if(sub[0] == 'C' && sub[1] == 'S' && subSize >= 20 && CSFile_gzGet32(sub + 4) == CSF_GZBLOCKS_VERSION)
+    {
+      index.blockSize   = CSFile_gzGet32(sub + 8);
+      index.rawSize     = uint64_t(CSFile_gzGet32(sub + 12)) | (uint64_t(CSFile_gzGet32(sub + 16)) << 32);
+      index.numBlocks   = CSFile_gzGet32(sub + 20);
+      index.memberSizes = sub + 24;
+      index.headerSize  = 12 + extraSize;
+
+      return index.blockSize && subSize >= 20 + size_t(index.numBlocks) * 4
+             && index.numBlocks == (index.rawSize + index.blockSize - 1) / index.blockSize;
+    }
+    sub += 4 + subSize;
+  }
+
+  return false;
+}
+
+// inflates one gzip member holding raw deflate data into `dst`, checks crc and size
+static bool CSFile_gzInflateMember(const uint8_t* member, size_t memberSize, size_t headerSize, uint8_t* dst, size_t dstSize)
+{
+  if(memberSize < headerSize + 8)
+  {
+    return false;
+  }
+
+  z_stream stream = {};
+  if(inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+  {
+    return false;
+  }
+
+  stream.next_in   = (Bytef*)(member + headerSize);
+  stream.avail_in  = uInt(memberSize - headerSize - 8);
+  stream.next_out  = (Bytef*)dst;
+  stream.avail_out = uInt(dstSize);
+
+  int  result = inflate(&stream, Z_FINISH);
+  bool valid  = result == Z_STREAM_END && stream.total_out == dstSize;
+  inflateEnd(&stream);
+
+  const uint8_t* trailer = member + memberSize - 8;
+  return valid && CSFile_gzGet32(trailer) == uint32_t(crc32(crc32(0, nullptr, 0), dst, uInt(dstSize)))
+         && CSFile_gzGet32(trailer + 4) == uint32_t(dstSize);
+}
+
+// returns CADSCENEFILE_NOERROR and fills `outData` / `outSize` if the file uses the block container,
+// CADSCENEFILE_ERROR_OPERATION if it is a plain gzip stream that needs the fallback path
+static int CSFile_gzLoadBlocks(const char* filename, CSFileMemoryPTR mem, void** outData, size_t* outSize)
+{
+  csfutils::FileReadMapping file;
+  if(!file.open(filename))
+  {
+    return CADSCENEFILE_ERROR_NOFILE;
+  }
+
+  const uint8_t*  fileData = (const uint8_t*)file.data();
+  size_t          fileSize = file.size();
+  CSFGZBlockIndex index;
+  if(!CSFile_gzParseBlockIndex(fileData, fileSize, index))
+  {
+    return CADSCENEFILE_ERROR_OPERATION;
+  }
+
+  // member offsets from the index
+  std::vector<size_t> memberOffsets(index.numBlocks + 1);
+  memberOffsets[0] = 0;
+  for(uint32_t b = 0; b < index.numBlocks; b++)
+  {
+    memberOffsets[b + 1] = memberOffsets[b] + CSFile_gzGet32(index.memberSizes + b * 4);
+  }
+  if(memberOffsets[index.numBlocks] > fileSize || index.rawSize < sizeof(CSFile))
+  {
+    return CADSCENEFILE_ERROR_INVALID;
+  }
+
+  // inflate straight into the file memory (arena if enabled), blocks are independent
+  uint8_t*         data  = (uint8_t*)CSFileMemory_alloc(mem, size_t(index.rawSize), nullptr);
+  std::atomic_bool valid = true;
+
+  csfutils::parallel_items(
+      index.numBlocks,
+      [&](uint64_t b, uint32_t threadIdx, void* userData) {
+        size_t rawBegin = size_t(b) * index.blockSize;
+        size_t rawSize  = std::min(size_t(index.rawSize) - rawBegin, size_t(index.blockSize));
+        if(!CSFile_gzInflateMember(fileData + memberOffsets[b], memberOffsets[b + 1] - memberOffsets[b],
+                                   b == 0 ? index.headerSize : 10, data + rawBegin, rawSize))
+        {
+          valid = false;
+        }
+      },
+      nullptr, 1, std::min(CSF_DEFAULT_NUM_THREADS, index.numBlocks));
+
+  if(!valid || CSFile_getRawSize((const CSFile*)data) != index.rawSize)
+  {
+    return CADSCENEFILE_ERROR_INVALID;
+  }
+
+  *outData = data;
+  *outSize = size_t(index.rawSize);
+
+  return CADSCENEFILE_NOERROR;
+}
+#endif
+
 #if CSF_SUPPORT_GLTF2
 CSFAPI int CSFile_loadGTLF(CSFile** outcsf, const char* filename, CSFileMemoryPTR mem);
 #endif
@@ -1495,6 +1761,24 @@ CSFAPI int CSFile_loadExt(CSFile** outcsf, const char* filename, CSFileMemoryPTR
 #if CSF_SUPPORT_ZLIB
   if(len > 3 && strcmp(filename + len - 3, ".gz") == 0)
   {
+    void*  blockData = nullptr;
+    size_t blockSize = 0;
+    int    blockErr  = CSFile_gzLoadBlocks(filename, mem, &blockData, &blockSize);
+    if(blockErr != CADSCENEFILE_ERROR_OPERATION)
+    {
+      if(blockErr != CADSCENEFILE_NOERROR)
+      {
+        *outcsf = 0;
+        return blockErr;
+      }
+
+      CSFile* csf    = (CSFile*)CSFileMemory_alloc(mem, sizeof(CSFile), 0);
+      int     result = CSFile_loadRaw(csf, blockSize, blockData, mem->m_config.validate);
+      *outcsf        = result == CADSCENEFILE_NOERROR ? csf : 0;
+      return result;
+    }
+
+    // plain single-stream gzip
     gzFile filegz = gzopen(filename, "rb");
     if(!filegz)
     {
@@ -1610,21 +1894,97 @@ struct OutputBuf
 
 
 #if CSF_SUPPORT_ZLIB
+// writes the block container described at CSFile_gzLoadBlocks,
+// the blocks are deflated in parallel once the whole file was serialized
 struct OutputGZ
 {
-  gzFile    m_file;
+  FILE*     m_file;
   OutputBuf m_buf;
 
   int open(const char* filename, size_t filesize)
   {
     m_buf.open(filename, filesize);
-    m_file = gzopen(filename, "wb");
-    return m_file == 0;
+#ifdef WIN32
+    if(fopen_s(&m_file, filename, "wb"))
+    {
+      m_file = nullptr;
+    }
+#else
+    m_file = fopen(filename, "wb");
+#endif
+    return m_file == nullptr;
   }
   void close()
   {
-    gzwrite(m_file, m_buf.m_data, (z_off_t)m_buf.m_used);
-    gzclose(m_file);
+    size_t rawSize   = m_buf.m_allocated;
+    size_t blockSize = CSF_GZBLOCKS_SIZE;
+    if((rawSize + blockSize - 1) / blockSize > CSF_GZBLOCKS_MAXBLOCKS)
+    {
+      blockSize = (rawSize + CSF_GZBLOCKS_MAXBLOCKS - 1) / CSF_GZBLOCKS_MAXBLOCKS;
+      blockSize = (blockSize + 0xFFFF) & ~size_t(0xFFFF);
+    }
+    uint32_t numBlocks = uint32_t((rawSize + blockSize - 1) / blockSize);
+
+    // each block becomes a gzip member: header, raw deflate data, crc32 and size
+    std::vector<std::vector<uint8_t>> members(numBlocks);
+    csfutils::parallel_items(
+        numBlocks,
+        [&](uint64_t b, uint32_t threadIdx, void* userData) {
+          const uint8_t* raw     = (const uint8_t*)m_buf.m_data + size_t(b) * blockSize;
+          size_t         rawUsed = std::min(rawSize - size_t(b) * blockSize, blockSize);
+          size_t         header  = b == 0 ? 12 + 4 + 20 + size_t(numBlocks) * 4 : 10;
+
+          z_stream stream = {};
+          deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+
+          std::vector<uint8_t>& member = members[b];
+          member.resize(header + deflateBound(&stream, uLong(rawUsed)) + 8);
+
+          stream.next_in   = (Bytef*)raw;
+          stream.avail_in  = uInt(rawUsed);
+          stream.next_out  = member.data() + header;
+          stream.avail_out = uInt(member.size() - header - 8);
+          deflate(&stream, Z_FINISH);
+          member.resize(header + stream.total_out + 8);
+          deflateEnd(&stream);
+
+          memset(member.data(), 0, header);
+          member[0] = 0x1f;
+          member[1] = 0x8b;
+          member[2] = 8;
+          member[9] = 255;
+
+          uint8_t* trailer = member.data() + member.size() - 8;
+          CSFile_gzPut32(trailer, uint32_t(crc32(crc32(0, nullptr, 0), raw, uInt(rawUsed))));
+          CSFile_gzPut32(trailer + 4, uint32_t(rawUsed));
+        },
+        nullptr, 1, std::min(CSF_DEFAULT_NUM_THREADS, numBlocks));
+
+    // first member carries the block index
+    uint8_t* header    = members[0].data();
+    size_t   extraSize = 4 + 20 + size_t(numBlocks) * 4;
+    header[3]          = 4;  // FEXTRA
+    header[10]         = uint8_t(extraSize);
+    header[11]         = uint8_t(extraSize >> 8);
+    header[12]         = 'C';
+    header[13]         = 'S';
+    header[14]         = uint8_t(extraSize - 4);
+    header[15]         = uint8_t((extraSize - 4) >> 8);
+    CSFile_gzPut32(header + 16, CSF_GZBLOCKS_VERSION);
+    CSFile_gzPut32(header + 20, uint32_t(blockSize));
+    CSFile_gzPut32(header + 24, uint32_t(rawSize));
+    CSFile_gzPut32(header + 28, uint32_t(uint64_t(rawSize) >> 32));
+    CSFile_gzPut32(header + 32, numBlocks);
+    for(uint32_t b = 0; b < numBlocks; b++)
+    {
+      CSFile_gzPut32(header + 36 + b * 4, uint32_t(members[b].size()));
+    }
+
+    for(const std::vector<uint8_t>& member : members)
+    {
+      fwrite(member.data(), member.size(), 1, m_file);
+    }
+    fclose(m_file);
     m_buf.close();
   }
   void write(size_t offset, const void* data, size_t dataSize) { m_buf.write(offset, data, dataSize); }
@@ -2635,6 +2995,497 @@ CSFAPI void* CSFileHandle_loadElements(CSFileHandlePTR handle, CSFileHandleConte
 
 //////////////////////////////////////////////////////////////////////////
 
+struct CSFResidency_s
+{
+  enum GeometryState : uint8_t
+  {
+    GEOMETRY_EMPTY,
+    GEOMETRY_PENDING,
+    GEOMETRY_RESIDENT,
+  };
+
+  struct Geometry
+  {
+    // content range within file, begin == end if geometry has no content
+    CSFoffset    begin       = 0;
+    CSFoffset    end         = 0;
+    size_t       perpartSize = 0;
+    uint64_t     lastUsed    = 0;
+    CSFGeometry* resident    = nullptr;
+    uint32_t     chunkIdx    = ~0u;
+    uint8_t      state       = GEOMETRY_EMPTY;
+  };
+
+  // one coalesced read, geometries are loaded and evicted together
+  struct Chunk
+  {
+    uint32_t         index    = 0;
+    CSFoffset        begin    = 0;
+    CSFoffset        end      = 0;
+    uint8_t*         data     = nullptr;
+    size_t           size     = 0;
+    uint64_t         lastUsed = 0;
+    bool             valid    = false;
+    bool             resident = false;
+    std::vector<int> geometries;
+  };
+
+  CSFResidencyConfig       m_config;
+  std::string              m_filename;
+  CSFile*                  m_csf = nullptr;
+  std::vector<CSFGeometry> m_rawGeometries;  // primary structs with file offsets
+  std::vector<Geometry>    m_geometries;
+
+  // deque keeps chunks in place while workers access them
+  std::deque<Chunk>     m_chunks;
+  std::vector<uint32_t> m_freeChunks;
+  std::vector<int>      m_missing;
+
+  uint64_t m_frame              = 1;
+  size_t   m_residentBytes      = 0;
+  uint32_t m_residentGeometries = 0;
+  uint32_t m_pendingGeometries  = 0;
+  uint64_t m_numReads           = 0;
+  uint64_t m_readBytes          = 0;
+  uint64_t m_evictedGeometries  = 0;
+
+  // shared with workers, protected by m_mutex
+  std::mutex               m_mutex;
+  std::condition_variable  m_condQueue;
+  std::condition_variable  m_condDone;
+  std::deque<Chunk*>       m_queue;
+  std::vector<Chunk*>      m_finished;
+  uint32_t                 m_numInFlight = 0;
+  bool                     m_quit        = false;
+  std::vector<std::thread> m_threads;
+
+  int open(const char* filename, const CSFResidencyConfig& config, CSFileMemoryPTR mem)
+  {
+    m_config   = config;
+    m_filename = filename;
+
+    CSFileHandle_s handle;
+    int            result = handle.open(filename);
+    if(result != CADSCENEFILE_NOERROR)
+    {
+      return result;
+    }
+
+    m_csf = CSFileHandle_loadBasics(
+        &handle, CSFILEHANDLE_CONTENT_MATERIAL | CSFILEHANDLE_CONTENT_GEOMETRY | CSFILEHANDLE_CONTENT_NODE, mem);
+    if(m_csf->numMaterials)
+    {
+      CSFileHandle_loadElementsInto(&handle, CSFILEHANDLE_CONTENT_MATERIAL, 0, m_csf->numMaterials, mem,
+                                    sizeof(CSFMaterial) * m_csf->numMaterials, m_csf->materials);
+    }
+    if(m_csf->numNodes)
+    {
+      CSFileHandle_loadElementsInto(&handle, CSFILEHANDLE_CONTENT_NODE, 0, m_csf->numNodes, mem,
+                                    sizeof(CSFNode) * m_csf->numNodes, m_csf->nodes);
+    }
+    m_csf->geometryMetas = nullptr;
+    m_csf->nodeMetas     = nullptr;
+    m_csf->fileMeta      = nullptr;
+
+    // find content ranges of all geometries
+    m_rawGeometries.resize(m_csf->numGeometries);
+    m_geometries.resize(m_csf->numGeometries);
+    size_t rawSize = sizeof(CSFGeometry) * m_csf->numGeometries;
+    if(rawSize && handle.read(handle.m_header.geometriesOFFSET, m_rawGeometries.data(), rawSize) != rawSize)
+    {
+      return CADSCENEFILE_ERROR_INVALID;
+    }
+
+    CSFOffsetReader reader(&handle, mem);
+    for(int i = 0; i < m_csf->numGeometries; i++)
+    {
+      Geometry& geometry   = m_geometries[i];
+      geometry.perpartSize = reader.geometrySetup(&m_rawGeometries[i]);
+
+      reader.calculatePass();
+      CSFSerializer::processGeometry(reader, 0, i, &m_rawGeometries[i], 0, geometry.perpartSize);
+      if(reader.m_minOffset < reader.m_maxOffset)
+      {
+        if(reader.m_maxOffset > handle.m_fileSize)
+        {
+          return CADSCENEFILE_ERROR_INVALID;
+        }
+        geometry.begin = reader.m_minOffset;
+        geometry.end   = reader.m_maxOffset;
+      }
+    }
+
+    uint32_t numThreads = std::max(m_config.numThreads, 1u);
+    for(uint32_t t = 0; t < numThreads; t++)
+    {
+      m_threads.emplace_back([this]() { worker(); });
+    }
+
+    return CADSCENEFILE_NOERROR;
+  }
+
+  void worker()
+  {
+    CSFileHandle_s handle;
+    bool           opened = handle.open(m_filename.c_str()) == CADSCENEFILE_NOERROR;
+
+    while(true)
+    {
+      Chunk* chunk;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condQueue.wait(lock, [&]() { return m_quit || !m_queue.empty(); });
+        if(m_quit)
+        {
+          return;
+        }
+        chunk = m_queue.front();
+        m_queue.pop_front();
+      }
+
+      chunk->valid = opened && loadChunk(handle, *chunk);
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.push_back(chunk);
+        m_numInFlight--;
+      }
+      m_condDone.notify_all();
+    }
+  }
+
+  bool loadChunk(CSFileHandle_s& handle, Chunk& chunk)
+  {
+    // content first, placed to keep the file's alignment, followed by the primary structs
+    size_t readSize     = size_t(chunk.end - chunk.begin);
+    size_t contentShift = size_t(chunk.begin & 15);
+    size_t structOffset = (contentShift + readSize + 15) & ~size_t(15);
+
+    chunk.size = structOffset + sizeof(CSFGeometry) * chunk.geometries.size();
+    chunk.data = (uint8_t*)malloc(chunk.size);
+
+    uint8_t*     content    = chunk.data + contentShift;
+    CSFGeometry* geometries = (CSFGeometry*)(chunk.data + structOffset);
+    if(readSize && handle.read(chunk.begin, content, readSize) != readSize)
+    {
+      return false;
+    }
+
+    CSFOffsetReader reader(&handle, nullptr);
+    reader.m_calculate  = false;
+    reader.m_minOffset  = chunk.begin;
+    reader.m_allocation = content;
+
+    for(size_t i = 0; i < chunk.geometries.size(); i++)
+    {
+      int          geometryIdx = chunk.geometries[i];
+      CSFGeometry* geo         = geometries + i;
+      *geo                     = m_rawGeometries[geometryIdx];
+
+      CSFSerializer::processGeometry(reader, 0, geometryIdx, geo, 0, m_geometries[geometryIdx].perpartSize);
+      csfPostLoadGeometry(m_csf, geo);
+    }
+
+    return true;
+  }
+
+  void request(uint32_t numGeometries, const int* geometryIDXs)
+  {
+    m_missing.clear();
+    for(uint32_t i = 0; i < numGeometries; i++)
+    {
+      int idx = geometryIDXs[i];
+      if(idx < 0 || idx >= m_csf->numGeometries)
+      {
+        continue;
+      }
+
+      Geometry& geometry = m_geometries[idx];
+      if(geometry.state == GEOMETRY_EMPTY)
+      {
+        geometry.state = GEOMETRY_PENDING;
+        m_missing.push_back(idx);
+      }
+      touch(geometry);
+    }
+
+    if(m_missing.empty())
+    {
+      return;
+    }
+
+    // coalesce along the file
+    std::sort(m_missing.begin(), m_missing.end(),
+              [&](int a, int b) { return m_geometries[a].begin < m_geometries[b].begin; });
+
+    size_t              maxReadSize = m_config.maxReadSize ? m_config.maxReadSize : ~size_t(0);
+    std::vector<Chunk*> chunks;
+    Chunk*              chunk = nullptr;
+    for(int idx : m_missing)
+    {
+      const Geometry& geometry = m_geometries[idx];
+      bool            empty    = geometry.begin == geometry.end;
+
+      if(chunk && !empty && chunk->begin != chunk->end
+         && (geometry.begin > chunk->end + m_config.maxReadGap
+             || std::max(chunk->end, geometry.end) - chunk->begin > maxReadSize))
+      {
+        chunk = nullptr;
+      }
+      if(!chunk)
+      {
+        chunk = &allocChunk();
+        chunks.push_back(chunk);
+      }
+      if(!empty)
+      {
+        chunk->begin = chunk->begin == chunk->end ? geometry.begin : chunk->begin;
+        chunk->end   = std::max(chunk->end, geometry.end);
+      }
+      chunk->geometries.push_back(idx);
+    }
+
+    for(Chunk* it : chunks)
+    {
+      m_numReads++;
+      m_readBytes += it->end - it->begin;
+    }
+    m_pendingGeometries += uint32_t(m_missing.size());
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_queue.insert(m_queue.end(), chunks.begin(), chunks.end());
+      m_numInFlight += uint32_t(chunks.size());
+    }
+    m_condQueue.notify_all();
+  }
+
+  Chunk& allocChunk()
+  {
+    uint32_t chunkIdx;
+    if(m_freeChunks.empty())
+    {
+      chunkIdx = uint32_t(m_chunks.size());
+      m_chunks.emplace_back();
+      m_chunks.back().index = chunkIdx;
+    }
+    else
+    {
+      chunkIdx = m_freeChunks.back();
+      m_freeChunks.pop_back();
+    }
+
+    Chunk& chunk   = m_chunks[chunkIdx];
+    chunk.begin    = 0;
+    chunk.end      = 0;
+    chunk.lastUsed = m_frame;
+    return chunk;
+  }
+
+  void freeChunk(Chunk& chunk)
+  {
+    free(chunk.data);
+    chunk.data     = nullptr;
+    chunk.size     = 0;
+    chunk.valid    = false;
+    chunk.resident = false;
+    chunk.geometries.clear();
+    m_freeChunks.push_back(chunk.index);
+  }
+
+  void touch(Geometry& geometry)
+  {
+    geometry.lastUsed = m_frame;
+    if(geometry.state == GEOMETRY_RESIDENT)
+    {
+      m_chunks[geometry.chunkIdx].lastUsed = m_frame;
+    }
+  }
+
+  const CSFGeometry* getGeometry(int idx)
+  {
+    if(idx < 0 || idx >= m_csf->numGeometries || m_geometries[idx].state != GEOMETRY_RESIDENT)
+    {
+      return nullptr;
+    }
+
+    touch(m_geometries[idx]);
+    return m_geometries[idx].resident;
+  }
+
+  void publish()
+  {
+    std::vector<Chunk*> finished;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      finished.swap(m_finished);
+    }
+
+    for(Chunk* chunk : finished)
+    {
+      uint32_t numGeometries = uint32_t(chunk->geometries.size());
+      m_pendingGeometries -= numGeometries;
+
+      if(!chunk->valid)
+      {
+        // will be retried on next request
+        for(int idx : chunk->geometries)
+        {
+          m_geometries[idx].state = GEOMETRY_EMPTY;
+        }
+        freeChunk(*chunk);
+        continue;
+      }
+
+      CSFGeometry* geometries = (CSFGeometry*)(chunk->data + chunk->size - sizeof(CSFGeometry) * numGeometries);
+      for(uint32_t i = 0; i < numGeometries; i++)
+      {
+        Geometry& geometry = m_geometries[chunk->geometries[i]];
+        geometry.state     = GEOMETRY_RESIDENT;
+        geometry.resident  = geometries + i;
+        geometry.chunkIdx  = chunk->index;
+        chunk->lastUsed    = std::max(chunk->lastUsed, geometry.lastUsed);
+      }
+
+      chunk->resident = true;
+      m_residentBytes += chunk->size;
+      m_residentGeometries += numGeometries;
+    }
+  }
+
+  void evict()
+  {
+    if(!m_config.budget || m_residentBytes <= m_config.budget)
+    {
+      return;
+    }
+
+    std::vector<uint32_t> candidates;
+    for(size_t i = 0; i < m_chunks.size(); i++)
+    {
+      if(m_chunks[i].resident && m_chunks[i].lastUsed < m_frame)
+      {
+        candidates.push_back(uint32_t(i));
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [&](uint32_t a, uint32_t b) { return m_chunks[a].lastUsed < m_chunks[b].lastUsed; });
+
+    for(size_t i = 0; i < candidates.size() && m_residentBytes > m_config.budget; i++)
+    {
+      Chunk& chunk = m_chunks[candidates[i]];
+      for(int idx : chunk.geometries)
+      {
+        Geometry& geometry = m_geometries[idx];
+        geometry.state     = GEOMETRY_EMPTY;
+        geometry.resident  = nullptr;
+        geometry.chunkIdx  = ~0u;
+      }
+
+      m_residentBytes -= chunk.size;
+      m_residentGeometries -= uint32_t(chunk.geometries.size());
+      m_evictedGeometries += chunk.geometries.size();
+      freeChunk(chunk);
+    }
+  }
+
+  void update()
+  {
+    publish();
+    evict();
+    m_frame++;
+  }
+
+  void wait()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condDone.wait(lock, [&]() { return m_numInFlight == 0; });
+    }
+    publish();
+  }
+
+  ~CSFResidency_s()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_condQueue.notify_all();
+    for(std::thread& thread : m_threads)
+    {
+      thread.join();
+    }
+    for(Chunk& chunk : m_chunks)
+    {
+      free(chunk.data);
+    }
+  }
+};
+
+CSFAPI int CSFResidency_open(CSFResidencyPTR* pResidency, const char* filename, const CSFResidencyConfig* config, CSFileMemoryPTR mem)
+{
+  CSFResidencyConfig defaultConfig = {};
+  defaultConfig.maxReadSize        = 8 * 1024 * 1024;
+  defaultConfig.maxReadGap         = 64 * 1024;
+  defaultConfig.numThreads         = 2;
+
+  CSFResidencyPTR residency = new CSFResidency_s;
+  int             result    = residency->open(filename, config ? *config : defaultConfig, mem);
+  if(result != CADSCENEFILE_NOERROR)
+  {
+    delete residency;
+  }
+  else
+  {
+    *pResidency = residency;
+  }
+
+  return result;
+}
+
+CSFAPI void CSFResidency_close(CSFResidencyPTR residency)
+{
+  delete residency;
+}
+
+CSFAPI const CSFile* CSFResidency_getFile(CSFResidencyPTR residency)
+{
+  return residency->m_csf;
+}
+
+CSFAPI void CSFResidency_request(CSFResidencyPTR residency, uint32_t numGeometries, const int* geometryIDXs)
+{
+  residency->request(numGeometries, geometryIDXs);
+}
+
+CSFAPI const CSFGeometry* CSFResidency_getGeometry(CSFResidencyPTR residency, int geometryIDX)
+{
+  return residency->getGeometry(geometryIDX);
+}
+
+CSFAPI void CSFResidency_update(CSFResidencyPTR residency)
+{
+  residency->update();
+}
+
+CSFAPI void CSFResidency_wait(CSFResidencyPTR residency)
+{
+  residency->wait();
+}
+
+CSFAPI void CSFResidency_getStats(CSFResidencyPTR residency, CSFResidencyStats* stats)
+{
+  stats->residentBytes      = residency->m_residentBytes;
+  stats->residentGeometries = residency->m_residentGeometries;
+  stats->pendingGeometries  = residency->m_pendingGeometries;
+  stats->numReads           = residency->m_numReads;
+  stats->readBytes          = residency->m_readBytes;
+  stats->evictedGeometries  = residency->m_evictedGeometries;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
 #if !CSF_DISABLE_FILEMAPPING_SUPPORT
 
 #if defined(LINUX)
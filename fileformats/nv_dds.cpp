@@ -23,6 +23,10 @@
 #include "dxgiformat.h"  // Included in third_party's dxh subproject
 #include "texture_formats.h"
 
+#ifdef NV_DDS_USE_FILEMAPPING
+#include "nvh/filemapping.hpp"
+#endif
+
 #include <algorithm>
 #include <array>
 #include <cassert>
@@ -841,6 +845,8 @@ ErrorWithText Subresource::create(size_t imageSizeBytes, const void* pixels)
 
   try
   {
+    view          = nullptr;
+    viewSizeBytes = 0;
     if(pixels != nullptr)
     {
       const char* pixelsBytes = reinterpret_cast<const char*>(pixels);
@@ -858,6 +864,17 @@ ErrorWithText Subresource::create(size_t imageSizeBytes, const void* pixels)
   return {};
 }
 
+ErrorWithText Subresource::createView(size_t imageSizeBytes, const void* pixels)
+{
+  if(imageSizeBytes == 0)
+    return "imageSizeBytes must be nonzero.";
+
+  data          = std::vector<char>();
+  view          = reinterpret_cast<const char*>(pixels);
+  viewSizeBytes = imageSizeBytes;
+  return {};
+}
+
 void Subresource::clear()
 {
   *this = Subresource();
@@ -900,6 +917,7 @@ ErrorWithText Image::allocate(uint32_t _numMips, uint32_t _numLayers, uint32_t _
 void Image::clear()
 {
   m_data.clear();
+  m_viewSource.reset();
 }
 
 ResourceDimension Image::inferResourceDimension() const
@@ -1451,6 +1469,13 @@ ErrorWithText Image::readHeaderFromMemory(const char* buffer, size_t bufferSize,
 
 ErrorWithText Image::readFromStream(std::istream& input, const ReadSettings& readSettings)
 {
+  return readFromStreamInternal(input, readSettings, nullptr);
+}
+
+ErrorWithText Image::readFromStreamInternal(std::istream& input, const ReadSettings& readSettings, const char* viewBase)
+{
+  // Drops views of previously read data.
+  clear();
   UNWRAP_ERROR(readHeaderFromStream(input, readSettings));
 
   size_t validationInputSize = 0;
@@ -1716,6 +1741,16 @@ ErrorWithText Image::readFromStream(std::istream& input, const ReadSettings& rea
             }
           }
         }
+        else if(viewBase)
+        {
+          // Zero-copy path: reference the input's bytes.
+          const std::streampos pos = input.tellg();
+          if(pos == std::streampos(-1) || !input.seekg(static_cast<std::streamoff>(fileTexSize), std::ios::cur))
+          {
+            return "Referencing data for an image in a DDS input failed. Is the input truncated?";
+          }
+          UNWRAP_ERROR(resource.createView(fileTexSize, viewBase + static_cast<std::streamoff>(pos)));
+        }
         else
         {
           // Fast path: not bitmasked; read it directly from the input into
@@ -1736,6 +1771,27 @@ ErrorWithText Image::readFromFile(const char* filename, const ReadSettings& read
 {
   try
   {
+#ifdef NV_DDS_USE_FILEMAPPING
+    if(readSettings.zeroCopy)
+    {
+      std::shared_ptr<nvh::FileReadMapping> mapping = std::make_shared<nvh::FileReadMapping>();
+      // Empty files cannot be mapped; let the stream path report the error.
+      if(mapping->open(filename))
+      {
+        const char*   mappedData = reinterpret_cast<const char*>(mapping->data());
+        MemoryStream  stream(mappedData, static_cast<std::streamsize>(mapping->size()));
+        ErrorWithText result = readFromStreamInternal(stream, readSettings, mappedData);
+        if(result.has_value())
+        {
+          clear();
+          return result;
+        }
+        m_viewSource = std::move(mapping);
+        return {};
+      }
+    }
+#endif
+
     std::ifstream file(filename, std::ios::binary | std::ios::in);
     return readFromStream(file, readSettings);
   }
@@ -1752,7 +1808,7 @@ ErrorWithText Image::readFromMemory(const char* buffer, size_t bufferSize, const
     return "The `bufferSize` parameter was too large to be stored in an std::streamsize.";
   }
   MemoryStream stream(buffer, bufferSize);
-  return readFromStream(stream, readSettings);
+  return readFromStreamInternal(stream, readSettings, readSettings.zeroCopy ? buffer : nullptr);
 }
 
 ErrorWithText Image::writeToStream(std::ostream& output, const WriteSettings& writeSettings)
@@ -2003,8 +2059,8 @@ ErrorWithText Image::writeToStream(std::ostream& output, const WriteSettings& wr
     {
       for(uint32_t mip = 0; mip < m_numMips; mip++)
       {
-        const std::vector<char>& data = subresource(mip, layer, face).data;
-        if(!output.write(data.data(), static_cast<std::streamoff>(data.size())))
+        const Subresource& resource = subresource(mip, layer, face);
+        if(!output.write(resource.bytes(), static_cast<std::streamoff>(resource.size())))
         {
           return "Could not write data for mip " + std::to_string(mip) + ", face " + std::to_string(face) + ", layer "
                  + std::to_string(layer) + ".";
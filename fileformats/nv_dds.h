@@ -25,6 +25,8 @@
 
 Other than the C++ standard library, nv_dds only requires five files:
 dxgiformat.h, nv_dds.h, nv_dds.cpp, texture_formats.h, and texture_formats.cpp.
+Zero-copy file reads are opt-in: define NV_DDS_USE_FILEMAPPING when compiling
+nv_dds.cpp to memory-map files with nvh/filemapping.hpp (nvpro_core does).
 
 To load a DDS file, use `Image::readFromFile()`:
 
@@ -61,6 +63,21 @@ if(maybe_error.has_value())
 read and write functions supports various settings; see `ReadSettings`
 and `WriteSettings`.
 
+To avoid copying texel data, set `ReadSettings::zeroCopy`: `readFromFile()`
+then memory-maps the file (if built with NV_DDS_USE_FILEMAPPING), and
+subresources reference the mapped bytes. Use `Subresource::bytes()` and
+`Subresource::size()` to access data in either case:
+
+```cpp
+nv_dds::ReadSettings settings;
+settings.zeroCopy = true;
+if(!image.readFromFile("data/image.dds", settings).has_value())
+{
+  const nv_dds::Subresource& mip0 = image.subresource(0, 0, 0);
+  memcpy(stagingPtr, mip0.bytes(), mip0.size());
+}
+```
+
 Images can also be created from raw data:
 ```cpp
 nv_dds::Image image;
@@ -103,6 +120,7 @@ absolutely necessary, consider using a library such as NVTT.)
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -250,8 +268,21 @@ struct Subresource
   ErrorWithText create(size_t imageSizeBytes, const void* pixels);
   // Frees image data and resets the size.
   void clear();
+  // Makes this subresource reference `imageSizeBytes` bytes at `pixels`
+  // instead of owning a copy; `data` is freed. The bytes must outlive the
+  // subresource. Images read with ReadSettings::zeroCopy use this.
+  // Returns an error message if imageSizeBytes is 0.
+  ErrorWithText createView(size_t imageSizeBytes, const void* pixels);
+
+  // Returns the image's bytes, whether owned by `data` or referenced.
+  const char* bytes() const { return view ? view : data.data(); }
+  // Returns the length of bytes() in bytes.
+  size_t size() const { return view ? viewSizeBytes : data.size(); }
 
-  std::vector<char> data;  // The image's raw data.
+  std::vector<char> data;  // The image's raw data, empty if this is a view.
+  // If not nullptr, the subresource references these bytes instead of `data`.
+  const char* view          = nullptr;
+  size_t      viewSizeBytes = 0;
 };
 
 // Contains all the settings for reading DDS files.
@@ -277,6 +308,14 @@ struct ReadSettings
   // However, if you know you're always converting the output to RGBAF32, then
   // you can skip a conversion by setting this to true.
   bool bitmaskForceRgbaF32 = false;
+  // If true, subresources that need no decoding reference the input bytes
+  // instead of copying them; see Subresource::bytes().
+  // readFromFile() then memory-maps the file, and the Image keeps the mapping
+  // alive (also across copies of the Image) until it is cleared or destroyed.
+  // Without NV_DDS_USE_FILEMAPPING, readFromFile() reads and copies as usual.
+  // For readFromMemory(), the caller must keep the buffer alive.
+  // Has no effect on bitmasked files or readFromStream().
+  bool zeroCopy = false;
 };
 
 struct WriteSettings
@@ -428,7 +467,7 @@ public:
   inline size_t getSize() const
   {
     assert(!m_data.empty());
-    return m_data[0].data.size();
+    return m_data[0].size();
   }
 
   // Returns the number of mips (levels) in the image, including the base mip.
@@ -524,6 +563,13 @@ private:
   // A structure containing all the image's encoded data. We store this in a
   // buffer with an entry per subresource, and provide accessors to it.
   std::vector<Subresource> m_data;
+
+  // Owner of the bytes that subresource views reference, if any.
+  std::shared_ptr<const void> m_viewSource;
+
+  // readFromStream(); if `viewBase` is not nullptr, `input` reads from memory
+  // starting at `viewBase`, and subresources become views into it.
+  ErrorWithText readFromStreamInternal(std::istream& input, const ReadSettings& readSettings, const char* viewBase);
 };
 
 //-----------------------------------------------------------------------------
@@ -42,6 +42,9 @@
 #include "khr_df.h"
 #include "texture_formats.h"
 
+#include "nvh/filemapping.hpp"
+#include "nvh/parallel_work.hpp"
+
 namespace nv_ktx {
 
 // Some sources for this code:
@@ -983,8 +986,103 @@ struct ScopedZstdCContext
   }
   ZSTD_CCtx* pCtx = nullptr;
 };
+
+// A Zstandard-supercompressed mip whose inflation was deferred so that all
+// such mips can be inflated in parallel.
+struct ZstdMipJob
+{
+  uint32_t           mip      = 0;
+  size_t             faceSize = 0;        // Bytes written to each subresource
+  std::vector<char*> faces;               // Subresource storage, in layer-major order
+  const char*        src      = nullptr;  // Supercompressed data; points into the input when reading from memory
+  size_t             srcSize  = 0;
+  std::vector<char>  srcStorage;          // Owns the supercompressed data when reading from a stream
+  ErrorWithText      error;
+};
+
+// Streams the inflated data of a mip directly into its subresources, so that
+// no intermediate buffer for the whole level is needed.
+ErrorWithText InflateZstdMip(ZSTD_DCtx* pCtx, const ZstdMipJob& job)
+{
+  const size_t resetError = ZSTD_DCtx_reset(pCtx, ZSTD_reset_session_only);
+  if(ZSTD_isError(resetError))
+  {
+    return "Resetting the Zstandard context failed with the message '" + std::string(ZSTD_getErrorName(resetError))
+           + "'.";
+  }
+
+  ZSTD_inBuffer input{job.src, job.srcSize, 0};
+  for(char* face : job.faces)
+  {
+    ZSTD_outBuffer output{face, job.faceSize, 0};
+    while(output.pos < output.size)
+    {
+      const size_t lastInputPos  = input.pos;
+      const size_t lastOutputPos = output.pos;
+      const size_t zstdError     = ZSTD_decompressStream(pCtx, &output, &input);
+      if(ZSTD_isError(zstdError))
+      {
+        return "Mip " + std::to_string(job.mip) + " Zstandard inflation failed with the message '"
+               + std::string(ZSTD_getErrorName(zstdError)) + "' (code " + std::to_string(zstdError) + ").";
+      }
+      // The frame ended, or the decoder can't make progress because the input
+      // is exhausted: the level is shorter than its subresources.
+      if(output.pos < output.size && (zstdError == 0 || (input.pos == lastInputPos && output.pos == lastOutputPos)))
+      {
+        return "Expected " + std::to_string(job.faceSize * job.faces.size()) + " bytes in mip "
+               + std::to_string(job.mip) + ", but the inflated data was shorter than that.";
+      }
+    }
+  }
+  return {};
+}
 #endif
 
+// A read-only std::streambuf over a block of memory. readFromKTX2Stream
+// recognizes it, so that it can read supercompressed data in place instead of
+// copying it out of the stream first.
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+  MemoryStreamBuf(const char* data, size_t size)
+  {
+    // The get area is never written to.
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+  }
+  const char* begin() const { return eback(); }
+  size_t      size() const { return static_cast<size_t>(egptr() - eback()); }
+
+protected:
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+  {
+    if(!(which & std::ios_base::in))
+    {
+      return pos_type(off_type(-1));
+    }
+    off_type base = 0;
+    if(dir == std::ios_base::cur)
+    {
+      base = gptr() - eback();
+    }
+    else if(dir == std::ios_base::end)
+    {
+      base = egptr() - eback();
+    }
+    const off_type pos = base + off;
+    if(pos < 0 || pos > egptr() - eback())
+    {
+      return pos_type(off_type(-1));
+    }
+    setg(eback(), eback() + pos, egptr());
+    return pos_type(pos);
+  }
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+  {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+};
+
 #ifdef NVP_SUPPORTS_GZLIB
 // A Zlib inflation stream that is automatically deinitialized when it goes out of scope.
 struct ScopedZlibDStream
@@ -1728,6 +1826,16 @@ ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const ReadSettin
   // Temporary buffers used for supercompressed data.
   std::vector<char> supercompressedData;
   std::vector<char> inflatedData;
+#ifdef NVP_SUPPORTS_ZSTD
+  // Zstandard mips that don't need transcoding are inflated after this loop,
+  // in parallel and directly into the subresources. When reading from memory,
+  // their supercompressed data is used in place.
+  const MemoryStreamBuf* memoryBuf = dynamic_cast<const MemoryStreamBuf*>(input.rdbuf());
+  const bool deferZstdMips =
+      (header.supercompressionScheme == 2) && (input_supercompression == InputSupercompression::eNone);
+  std::vector<ZstdMipJob> zstdJobs;
+  zstdJobs.reserve(deferZstdMips ? num_mips : 0);
+#endif
   // Traverse mips in reverse order following the spec
   for(int mip = num_mips - 1; mip >= 0; mip--)
   {
@@ -1842,6 +1950,59 @@ ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const ReadSettin
       //                             |
       //                             in the ETC1S + UASTC case, we load file data into here directly
       //                             (it turns out ETC1S doesn't do anything per-level)
+#ifdef NVP_SUPPORTS_ZSTD
+      if(deferZstdMips)
+      {
+        const size_t expected_bytes_in_this_mip =
+            inflatedFaceSize * size_t(header.layerCount) * size_t(header.faceCount);
+        if(expected_bytes_in_this_mip > levelIndex.uncompressedByteLength)
+        {
+          return "Expected " + std::to_string(expected_bytes_in_this_mip) + " bytes in mip " + std::to_string(mip)
+                 + ", but the inflated data was only " + std::to_string(levelIndex.uncompressedByteLength)
+                 + " bytes long.";
+        }
+        if(inflatedFaceSize > finalFaceSize)
+        {
+          return "Failed to read KTX2 file: the size of the inflated data didn't match the expected size.";
+        }
+
+        ZstdMipJob& job = zstdJobs.emplace_back();
+        job.mip         = uint32_t(mip);
+        job.faceSize    = inflatedFaceSize;
+        if(memoryBuf != nullptr)
+        {
+          const uint64_t mipStart = uint64_t(std::streamoff(start_pos)) + levelIndex.byteOffset;
+          if(mipStart > memoryBuf->size() || levelIndex.byteLength > memoryBuf->size() - mipStart)
+          {
+            return "Reading mip " + std::to_string(mip) + "'s supercompressed data failed.";
+          }
+          job.src     = memoryBuf->begin() + mipStart;
+          job.srcSize = size_t(levelIndex.byteLength);
+        }
+        else
+        {
+          UNWRAP_ERROR(ResizeVectorOrError(job.srcStorage, levelIndex.byteLength));
+          if(!input.read(job.srcStorage.data(), levelIndex.byteLength))
+          {
+            return "Reading mip " + std::to_string(mip) + "'s supercompressed data failed.";
+          }
+          job.src     = job.srcStorage.data();
+          job.srcSize = job.srcStorage.size();
+        }
+
+        for(uint32_t layer = 0; layer < header.layerCount; layer++)
+        {
+          for(uint32_t face = 0; face < header.faceCount; face++)
+          {
+            std::vector<char>& subresource_data = subresource(mip, layer, face);
+            UNWRAP_ERROR(ResizeVectorOrError(subresource_data, finalFaceSize));
+            job.faces.push_back(subresource_data.data());
+          }
+        }
+        continue;
+      }
+#endif
+
       if(header.supercompressionScheme == 0)
       {
         // UASTC, ETC1S: Load file data into inflatedData directly
@@ -1877,8 +2038,8 @@ ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const ReadSettin
         {
           // Zstandard
 #ifdef NVP_SUPPORTS_ZSTD
-          size_t zstdError = ZSTD_decompress(inflatedData.data(), inflatedData.size(),  //
-                                             supercompressedData.data(), supercompressedData.size());
+          size_t zstdError = ZSTD_decompressDCtx(zstdDCtx.pCtx, inflatedData.data(), inflatedData.size(),  //
+                                                 supercompressedData.data(), supercompressedData.size());
           if(ZSTD_isError(zstdError))
           {
             const char* zstdErrorName = ZSTD_getErrorName(zstdError);
@@ -2014,6 +2175,38 @@ ErrorWithText KTXImage::readFromKTX2Stream(std::istream& input, const ReadSettin
     }
   }
 
+#ifdef NVP_SUPPORTS_ZSTD
+  if(!zstdJobs.empty())
+  {
+    // One decompression context per thread, created when first needed.
+    const size_t numContexts = (readSettings.num_threads == 1) ? 1 : nvh::get_thread_pool().get_thread_count();
+    std::vector<ScopedZstdDContext> contexts(std::max(size_t(1), numContexts));
+    nvh::parallel_batches_indexed<1>(
+        zstdJobs.size(),
+        [&](uint64_t jobIndex, uint32_t threadIndex) {
+          ZstdMipJob&         job     = zstdJobs[jobIndex];
+          ScopedZstdDContext& context = contexts[threadIndex];
+          if(context.pCtx == nullptr)
+          {
+            context.Init();
+            if(context.pCtx == nullptr)
+            {
+              job.error = "Initializing Zstandard context failed.";
+              return;
+            }
+          }
+          job.error = InflateZstdMip(context.pCtx, job);
+        },
+        readSettings.num_threads);
+
+    // Report errors in the order the serial path would have.
+    for(const ZstdMipJob& job : zstdJobs)
+    {
+      UNWRAP_ERROR(job.error);
+    }
+  }
+#endif
+
   return {};
 }
 
@@ -3187,8 +3380,27 @@ ErrorWithText KTXImage::readFromStream(std::istream& input, const ReadSettings&
   return "Not a KTX1 or KTX2 file (first 12 bytes weren't a valid identifier).";
 }
 
+ErrorWithText KTXImage::readFromMemory(const void* data, size_t size, const ReadSettings& readSettings)
+{
+  if(data == nullptr && size != 0)
+  {
+    return "readFromMemory was called with a null pointer and a nonzero size.";
+  }
+  MemoryStreamBuf memory_buf(reinterpret_cast<const char*>(data), size);
+  std::istream    input_stream(&memory_buf);
+  return readFromStream(input_stream, readSettings);
+}
+
 ErrorWithText KTXImage::readFromFile(const char* filename, const ReadSettings& readSettings)
 {
+  nvh::FileReadMapping mapping;
+  if(mapping.open(filename))
+  {
+    return readFromMemory(mapping.data(), mapping.size(), readSettings);
+  }
+
+  // Mapping can fail for e.g. empty files or special files; read those
+  // through a stream instead.
   std::ifstream input_stream(filename, std::ifstream::in | std::ifstream::binary);
   return readFromStream(input_stream, readSettings);
 }
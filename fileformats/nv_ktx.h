@@ -40,6 +40,12 @@ else
 }
 ```
 
+`readFromFile` memory-maps the file and reads it through `readFromMemory`,
+which avoids copying supercompressed data through an `std::istream`. The
+levels of Zstandard-supercompressed KTX2 files are inflated in parallel on
+the `nvh::parallel_work` thread pool, directly into the subresource storage;
+set `ReadSettings::num_threads` to 1 to read on the calling thread only.
+
 Define `NVP_SUPPORTS_ZSTD`, `NVP_SUPPORTS_GZLIB`, and `NVP_SUPPORTS_BASISU` to
 include the Zstd, Zlib, and Basis Universal headers respectively, and to
 enable reading these formats. This will also enable writing Zstd and
@@ -102,6 +108,10 @@ struct ReadSettings
   // By default, UASTC is transcoded to BC7 instead of ASTC. Setting this to
   // true will transcode UASTC to ASTC.
   bool device_supports_astc = false;
+  // Threading of the Zstandard inflation of supercompressed mips: 1 inflates
+  // on the calling thread, any other value uses all threads of the
+  // nvh::parallel_work thread pool (it is not a thread count).
+  uint32_t num_threads = 0;
 };
 
 enum class WriteSupercompressionType
@@ -221,7 +231,14 @@ public:
   ErrorWithText readFromStream(std::istream&       input,          // The input stream, at the start of the KTX data
                                const ReadSettings& readSettings);  // Settings for the reader
 
-  // Wrapper for readFromStream for a filename.
+  // Reads this structure from KTX data in memory, such as a mapped file. The
+  // data only needs to stay valid for the duration of the call.
+  ErrorWithText readFromMemory(const void*         data,           // The start of the KTX data
+                               size_t              size,           // The size of the KTX data in bytes
+                               const ReadSettings& readSettings);  // Settings for the reader
+
+  // Wrapper for readFromMemory for a filename; the file is memory-mapped,
+  // falling back to readFromStream if mapping fails.
   ErrorWithText readFromFile(const char*         filename,       // The .ktx or .ktx2 file to read from.
                              const ReadSettings& readSettings);  // Settings for the reader
 
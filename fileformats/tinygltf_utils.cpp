@@ -743,7 +743,7 @@ void tinygltf::utils::simpleCreateTangents(tinygltf::Model& model, tinygltf::Pri
 
 
   // Ortho-normalize each tangent and apply the handedness.
-  nvh::parallel_batches(numVertices, [&](uint64_t i) {
+  nvh::parallel_batches_adaptive("simpleCreateTangents", numVertices, [&](uint64_t i) {
     const uint32_t vertex = static_cast<uint32_t>(i);
     glm::vec4&     t0     = *tinygltf::utils::getAttributeData<glm::vec4>(model, primitive, vertex, tanAccessorIndex);
     glm::vec3      n0;
@@ -95,17 +95,6 @@ inline void bitTraverse(T bits, Visitor& visitor)
   }
 }
 
-template <typename Visitor>
-inline void bitTraverse(uint64_t bits, Visitor& visitor)
-{
-  unsigned long localIndex;
-  while(bits != 0)
-  {
-    visitor(localIndex);
-    bits ^= uint64_t(1) << localIndex;  // clear the current bit so that the next one is being found by the bitscan
-  }
-}
-
 /** >  Call visitor(index) for each bit set **/
 template <typename BitType, typename Visitor>
 inline void bitTraverse(BitType* elements, size_t numberOfElements, Visitor& visitor)
@@ -5,6 +5,7 @@
 #include <cassert>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <vector>
 
 /// @DOC_SKIP (keyword to exclude this file from automatic README.md generation)
@@ -79,6 +80,39 @@ std::size_t hashAligned32(const T& v)
 }
 
 
+// Hash of a memory block, consuming 8 bytes at a time. Unlike std::hash, the result is the same on
+// all platforms and compilers, so it can be used for file names and keys of data stored on disk.
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  const uint64_t prime = 0x9e3779b97f4a7c15ULL;
+  uint64_t       hash  = seed ^ (size * prime);
+
+  auto mix = [&](uint64_t word) {
+    word *= prime;
+    word ^= word >> 32;
+    hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+  };
+
+  size_t i = 0;
+  for(; i + 8 <= size; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    mix(word);
+  }
+  if(i < size)
+  {
+    uint64_t word = 0;
+    memcpy(&word, bytes + i, size - i);
+    mix(word);
+  }
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
 // Generic hash function to use when using a struct aligned to 32-bit as std::map-like container key
 // Important: this only works if the struct contains integral types, as it will not
 // do any pointer chasing
@@ -17,13 +17,20 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <atomic>
 #include <execution>
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#endif
 #include <filesystem>
 #include <glm/gtx/norm.hpp>
 #include <unordered_set>
 
+#include "container_utils.hpp"
+#include "filemapping.hpp"
 #include "gltfscene.hpp"
 #include "parallel_work.hpp"
+#include "task_graph.hpp"
 #include "timesampler.hpp"
 
 // List of supported extensions
@@ -136,11 +143,235 @@ bool nvh::gltf::Scene::load(const std::string& filename)
 
   m_currentScene   = m_model.defaultScene > -1 ? m_model.defaultScene : 0;
   m_currentVariant = 0;  // Default KHR_materials_variants
+
+  // Reuse the data derived by a previous load of the same content
+  std::string          cacheFile;
+  uint64_t             sourceHash = 0;
+  nvh::FileReadMapping cacheMapping;
+  if(!m_cacheDirectory.empty())
+  {
+    // Named after the path of the glTF, the content hash is checked by beginLoadCache
+    const std::string sourcePath = fs::absolute(fs::path(filename)).lexically_normal().string();
+    const uint64_t    pathHash   = nvh::hashBytes(sourcePath.data(), sourcePath.size());
+    const std::string name       = fmt::format("{}_{:016x}.nvgltfcache", fs::path(filename).stem().string(), pathHash);
+    sourceHash                   = computeSourceHash();
+    cacheFile                    = (fs::path(m_cacheDirectory) / name).string();
+    bool mapped = cacheMapping.open(cacheFile.c_str());
+    beginLoadCache(mapped ? cacheMapping.data() : nullptr, mapped ? cacheMapping.size() : 0, sourceHash);
+  }
+
   parseScene();
 
+  if(m_loadCache.active)
+  {
+    bool complete = m_loadCache.complete;
+    m_loadCache.cachedTangents.clear();
+    m_loadCache.cachedPrimitiveIDs = nullptr;
+    cacheMapping.close();  // Before replacing the file
+
+    if(complete)
+    {
+      LOGI("%sScene cache: %s\n", st.indent().c_str(), cacheFile.c_str());
+    }
+    else if(writeLoadCache(cacheFile, sourceHash))
+    {
+      LOGI("%sScene cache written: %s\n", st.indent().c_str(), cacheFile.c_str());
+    }
+    m_loadCache = {};
+  }
+
   return result;
 }
 
+//-------------------------------------------------------------------------------------------------
+// Processed-scene cache
+//
+// The cache file is a flat little-endian layout, mapped as-is on load:
+//   SceneCacheHeader
+//   int32_t             primitiveIDs[numPrimitives]  - renderPrimID of each mesh primitive, in mesh order
+//   SceneCacheTangents  tangents[numTangents]
+//   vec4 tangent data, 16 byte aligned, referenced by the offsets of `tangents`
+//
+// Any change to the parsing that affects this data must bump the version.
+
+static constexpr uint32_t SCENE_CACHE_MAGIC   = 0x4347564e;  // "NVGC"
+static constexpr uint32_t SCENE_CACHE_VERSION = 1;
+
+struct SceneCacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sourceHash;
+  uint32_t numPrimitives;
+  uint32_t numTangents;
+};
+
+struct SceneCacheTangents
+{
+  int32_t  renderPrimID;
+  uint32_t vertexCount;
+  uint64_t offset;  // From the start of the file
+};
+
+// Hash of large memory, blocks are hashed in parallel and their hashes combined
+static uint64_t hashBytesParallel(const uint8_t* data, size_t size, uint64_t seed)
+{
+  const size_t          blockSize = 4 << 20;
+  const size_t          numBlocks = (size + blockSize - 1) / blockSize;
+  std::vector<uint64_t> blockHashes(numBlocks);
+  nvh::parallel_batches<1>(numBlocks, [&](uint64_t b) {
+    size_t offset  = b * blockSize;
+    blockHashes[b] = nvh::hashBytes(data + offset, std::min(blockSize, size - offset), b);
+  });
+  return nvh::hashBytes(blockHashes.data(), numBlocks * sizeof(uint64_t), seed);
+}
+
+// Key of the cache: the glTF file (the JSON, or the whole .glb), the external buffers and the loader version
+uint64_t nvh::gltf::Scene::computeSourceHash() const
+{
+  uint64_t hash = SCENE_CACHE_VERSION;
+
+  nvh::FileReadMapping mapping;
+  if(mapping.open(m_filename.c_str()))
+  {
+    hash = hashBytesParallel(static_cast<const uint8_t*>(mapping.data()), mapping.size(), hash);
+  }
+  for(const tinygltf::Buffer& buffer : m_model.buffers)
+  {
+    if(!buffer.uri.empty())
+    {
+      hash = hashBytesParallel(buffer.data.data(), buffer.data.size(), hash);
+    }
+  }
+  return hash;
+}
+
+// Prepares m_loadCache for parseScene(), using the mapped cache file when it is valid
+void nvh::gltf::Scene::beginLoadCache(const void* data, size_t size, uint64_t sourceHash)
+{
+  m_loadCache        = {};
+  m_loadCache.active = true;
+
+  uint32_t numPrimitives = 0;
+  m_loadCache.meshPrimOffsets.resize(m_model.meshes.size());
+  for(size_t i = 0; i < m_model.meshes.size(); i++)
+  {
+    m_loadCache.meshPrimOffsets[i] = numPrimitives;
+    numPrimitives += static_cast<uint32_t>(m_model.meshes[i].primitives.size());
+  }
+  m_loadCache.primitiveIDs.resize(numPrimitives, -1);
+
+  if(!data || size < sizeof(SceneCacheHeader))
+    return;
+
+  const uint8_t*   bytes = static_cast<const uint8_t*>(data);
+  SceneCacheHeader header;
+  memcpy(&header, bytes, sizeof(header));
+  if(header.magic != SCENE_CACHE_MAGIC || header.version != SCENE_CACHE_VERSION || header.sourceHash != sourceHash)
+  {
+    LOGI("Scene cache is out of date, it will be rewritten\n");
+    return;
+  }
+  if(header.numPrimitives != numPrimitives)
+  {
+    LOGW("Scene cache does not match the glTF, ignored\n");
+    return;
+  }
+
+  size_t tablesEnd = sizeof(SceneCacheHeader) + sizeof(int32_t) * size_t(header.numPrimitives)
+                     + sizeof(SceneCacheTangents) * size_t(header.numTangents);
+  if(tablesEnd > size)
+  {
+    LOGW("Scene cache is truncated, ignored\n");
+    return;
+  }
+
+  const uint8_t* tangentTable = bytes + sizeof(SceneCacheHeader) + sizeof(int32_t) * size_t(header.numPrimitives);
+  for(uint32_t i = 0; i < header.numTangents; i++)
+  {
+    SceneCacheTangents entry;
+    memcpy(&entry, tangentTable + i * sizeof(SceneCacheTangents), sizeof(entry));
+    if(entry.offset > size || size_t(entry.vertexCount) * sizeof(glm::vec4) > size - entry.offset)
+    {
+      LOGW("Scene cache is truncated, ignored\n");
+      m_loadCache.cachedTangents.clear();
+      return;
+    }
+    m_loadCache.cachedTangents[entry.renderPrimID] = {bytes + entry.offset, entry.vertexCount};
+  }
+
+  m_loadCache.cachedPrimitiveIDs = reinterpret_cast<const int32_t*>(bytes + sizeof(SceneCacheHeader));
+  m_loadCache.complete           = true;
+}
+
+// Writes the recorded data, through a temporary file to never leave a partial cache behind
+bool nvh::gltf::Scene::writeLoadCache(const std::string& cacheFile, uint64_t sourceHash)
+{
+  namespace fs = std::filesystem;
+
+  SceneCacheHeader header{};
+  header.magic         = SCENE_CACHE_MAGIC;
+  header.version       = SCENE_CACHE_VERSION;
+  header.sourceHash    = sourceHash;
+  header.numPrimitives = static_cast<uint32_t>(m_loadCache.primitiveIDs.size());
+  header.numTangents   = static_cast<uint32_t>(m_loadCache.tangentPrimitives.size());
+
+  std::vector<SceneCacheTangents> tangents(header.numTangents);
+  size_t offset = sizeof(SceneCacheHeader) + sizeof(int32_t) * size_t(header.numPrimitives)
+                  + sizeof(SceneCacheTangents) * size_t(header.numTangents);
+  for(uint32_t i = 0; i < header.numTangents; i++)
+  {
+    int                       renderPrimID = m_loadCache.tangentPrimitives[i];
+    const tinygltf::Primitive& primitive   = *m_renderPrimitives[renderPrimID].pPrimitive;
+    offset                                 = (offset + 15) & ~size_t(15);
+    tangents[i].renderPrimID               = renderPrimID;
+    tangents[i].vertexCount = static_cast<uint32_t>(m_model.accessors[primitive.attributes.at("TANGENT")].count);
+    tangents[i].offset      = offset;
+    offset += tangents[i].vertexCount * sizeof(glm::vec4);
+  }
+
+  std::error_code ec;
+  fs::create_directories(fs::path(cacheFile).parent_path(), ec);
+
+  std::string tempFile = cacheFile + ".tmp";
+  {
+    nvh::FileReadOverWriteMapping mapping;
+    if(!mapping.open(tempFile.c_str(), offset))
+    {
+      LOGW("Could not write the scene cache: %s\n", tempFile.c_str());
+      return false;
+    }
+
+    uint8_t* bytes = static_cast<uint8_t*>(mapping.data());
+    memcpy(bytes, &header, sizeof(header));
+    memcpy(bytes + sizeof(header), m_loadCache.primitiveIDs.data(), sizeof(int32_t) * m_loadCache.primitiveIDs.size());
+    memcpy(bytes + sizeof(header) + sizeof(int32_t) * m_loadCache.primitiveIDs.size(), tangents.data(),
+           sizeof(SceneCacheTangents) * tangents.size());
+    for(const SceneCacheTangents& entry : tangents)
+    {
+      memcpy(bytes + entry.offset, getTangentData(entry.renderPrimID), entry.vertexCount * sizeof(glm::vec4));
+    }
+  }
+
+  fs::rename(tempFile, cacheFile, ec);
+  if(ec)
+  {
+    LOGW("Could not write the scene cache: %s\n", cacheFile.c_str());
+    fs::remove(tempFile, ec);
+    return false;
+  }
+  return true;
+}
+
+// Tangents generated by createMissingTangents() are tightly packed vec4
+uint8_t* nvh::gltf::Scene::getTangentData(int renderPrimID)
+{
+  const tinygltf::Primitive&  primitive = *m_renderPrimitives[renderPrimID].pPrimitive;
+  const tinygltf::Accessor&   accessor  = m_model.accessors[primitive.attributes.at("TANGENT")];
+  const tinygltf::BufferView& view      = m_model.bufferViews[accessor.bufferView];
+  return m_model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset;
+}
+
 bool nvh::gltf::Scene::save(const std::string& filename)
 {
   namespace fs = std::filesystem;
@@ -160,6 +391,9 @@ bool nvh::gltf::Scene::save(const std::string& filename)
 
   bool saveBinary = ext == ".glb" ? true : false;
 
+  // The animation only writes to the local transforms, bring the nodes up to date
+  syncAnimationToModel();
+
   // Copy the images to the destination folder
   if(!m_model.images.empty() && !saveBinary)
   {
@@ -262,51 +496,19 @@ void nvh::gltf::Scene::parseScene()
     createSceneCamera();
   }
 
+  // Flatten the final scene graph, used to update the transforms and visibility
+  buildFlatHierarchy();
+
   // Parse various scene components
   parseVariants();
   parseAnimations();
   createMissingTangents();
 
-  // Update the visibility of the render nodes
-  uint32_t renderNodeID = 0;
-  for(const int sceneNode : m_model.scenes[m_currentScene].nodes)
-  {
-    bool visible = tinygltf::utils::getNodeVisibility(m_model.nodes[sceneNode]).visible;
-    updateVisibility(sceneNode, visible, renderNodeID);
-  }
-
-  // We are updating the scene to the first state, animation, skinning, morph, ..
+  // We are updating the scene to the first state, animation, skinning, morph, visibility, ..
   updateRenderNodes();
 }
 
 
-// This function recursively updates the visibility of nodes in the scene graph.
-// If a node is marked as not visible, all its children will also be marked as not visible,
-// regardless of their individual visibility flags.
-void nvh::gltf::Scene::updateVisibility(int nodeID, bool visible, uint32_t& renderNodeID)
-{
-  tinygltf::Node& node = m_model.nodes[nodeID];
-
-  if(visible)
-  {
-    // Changing the visibility only if the parent was visible
-    visible = tinygltf::utils::getNodeVisibility(node).visible;
-  }
-
-  if(node.mesh >= 0)
-  {
-    // If the node has a mesh, update the visibility of all its primitives
-    const tinygltf::Mesh& mesh = m_model.meshes[node.mesh];
-    for(size_t j = 0; j < mesh.primitives.size(); j++)
-      m_renderNodes[renderNodeID++].visible = visible;
-  }
-
-  for(auto& child : node.children)
-  {
-    updateVisibility(child, visible, renderNodeID);
-  }
-}
-
 // Set the default names for the scene elements if they are empty
 void nvh::gltf::Scene::setSceneElementsDefaultNames()
 {
@@ -382,54 +584,314 @@ void nvh::gltf::Scene::createSceneCamera()
   tnode.rotation    = {q.x, q.y, q.z, q.w};
 }
 
-// This function will update the matrices and the materials of the render nodes
+// This function will update the matrices, visibility and materials of all the render nodes
 void nvh::gltf::Scene::updateRenderNodes()
 {
   const tinygltf::Scene& scene = m_model.scenes[m_currentScene];
   assert(scene.nodes.size() > 0 && "No nodes in the glTF file");
-  //assert(scene.nodes.size() == 1 && "Only one top node per scene is supported");
   assert(m_sceneRootNode > -1 && "No root node in the scene");
 
   m_nodesWorldMatrices.resize(m_model.nodes.size());
 
-  uint32_t renderNodeID = 0;  // Index of the render node
-  for(auto& sceneNode : scene.nodes)
+  // Level by level only pays off with several threads, on one thread the depth-first order is faster
+  if(m_parallelTransforms && nvh::get_thread_pool().get_thread_count() > 1)
   {
-    tinygltf::utils::traverseSceneGraph(
-        m_model, sceneNode, glm::mat4(1),  //
-        nullptr,                           // Camera fct
-        // Dealing with lights
-        [&](int nodeID, const glm::mat4& mat) {
-          tinygltf::Node& tnode             = m_model.nodes[nodeID];
-          m_lights[tnode.light].worldMatrix = mat;
-          return false;  // Continue traversal
-        },
-        // Dealing with Nodes and Variant Materials
-        [&](int nodeID, const glm::mat4& mat) {
-          tinygltf::Node&       tnode = m_model.nodes[nodeID];
-          const tinygltf::Mesh& mesh  = m_model.meshes[tnode.mesh];
-          for(size_t j = 0; j < mesh.primitives.size(); j++)
-          {
-            const tinygltf::Primitive& primitive  = mesh.primitives[j];
-            gltf::RenderNode&          renderNode = m_renderNodes[renderNodeID];
-            renderNode.worldMatrix                = mat;
-            renderNode.materialID                 = getMaterialVariantIndex(primitive, m_currentVariant);
-            renderNodeID++;
-          }
-          return false;  // Continue traversal
-        },
-        [&](int nodeID, const glm::mat4& mat) {
-          m_nodesWorldMatrices[nodeID] = mat;
-          return false;
-        });
+    updateFlatLevels();
   }
+  else
+  {
+    updateFlatRange(0, static_cast<uint32_t>(m_flatHierarchy.nodes.size()));
+  }
+  m_flatHierarchy.dirty.clear();
+
+  updateRenderNodesMaterials();
+}
+
+// Update the matrices and visibility of the dirty nodes and their children only.
+// Returns the render nodes that were changed, for a partial upload.
+const std::vector<uint32_t>& nvh::gltf::Scene::updateDirtyRenderNodes()
+{
+  FlatHierarchy& flat = m_flatHierarchy;
+
+  m_nodesWorldMatrices.resize(m_model.nodes.size());
+  m_dirtyRenderNodes.clear();
+
+  // Dirty positions are visited in depth-first order, a dirty node inside an updated subtree is skipped
+  uint32_t updatedEnd = 0;
+  flat.dirty.traverseBits([&](size_t position) {
+    if(position < updatedEnd)
+      return;
+    updatedEnd = static_cast<uint32_t>(position + flat.subtreeSizes[position]);
+    updateFlatRange(static_cast<uint32_t>(position), updatedEnd);
+    for(uint32_t renderNodeID = flat.renderNodeOffsets[position]; renderNodeID < flat.renderNodeOffsets[updatedEnd]; renderNodeID++)
+    {
+      m_dirtyRenderNodes.push_back(renderNodeID);
+    }
+  });
+  flat.dirty.clear();
 
-  // Update the visibility of the render nodes
-  renderNodeID = 0;
-  for(const int sceneNode : m_model.scenes[m_currentScene].nodes)
+  return m_dirtyRenderNodes;
+}
+
+void nvh::gltf::Scene::markNodeDirty(int nodeID)
+{
+  if(nodeID < 0 || nodeID >= static_cast<int>(m_flatHierarchy.positions.size()))
+    return;
+
+  const int position = m_flatHierarchy.positions[nodeID];
+  if(position >= 0)
   {
-    KHR_node_visibility nvisible = tinygltf::utils::getNodeVisibility(m_model.nodes[sceneNode]);
-    updateVisibility(sceneNode, nvisible.visible, renderNodeID);
+    m_flatHierarchy.dirty.enableBit(position);
+  }
+}
+
+// Flattens the scene graph of the current scene in depth-first order and finds the render nodes of each node.
+// The render nodes were created by a depth-first traversal as well, so each node owns a contiguous range of them.
+void nvh::gltf::Scene::buildFlatHierarchy()
+{
+  FlatHierarchy& flat = m_flatHierarchy;
+  flat                = {};
+  flat.positions.assign(m_model.nodes.size(), -1);
+
+  // Children are pushed in reverse to be visited in order
+  std::vector<std::pair<int, int>> stack;  // Node ID, parent position
+  const std::vector<int>&          sceneNodes = m_model.scenes[m_currentScene].nodes;
+  for(auto it = sceneNodes.rbegin(); it != sceneNodes.rend(); ++it)
+  {
+    stack.push_back({*it, -1});
+  }
+  while(!stack.empty())
+  {
+    auto [nodeID, parent] = stack.back();
+    stack.pop_back();
+
+    const int position = static_cast<int>(flat.nodes.size());
+    flat.nodes.push_back(nodeID);
+    flat.parents.push_back(parent);
+    flat.positions[nodeID] = position;
+
+    const std::vector<int>& children = m_model.nodes[nodeID].children;
+    for(auto it = children.rbegin(); it != children.rend(); ++it)
+    {
+      stack.push_back({*it, position});
+    }
+  }
+
+  // Children come after their parent, accumulating backward gives the subtree sizes
+  const uint32_t numPositions = static_cast<uint32_t>(flat.nodes.size());
+  flat.subtreeSizes.assign(numPositions, 1);
+  for(uint32_t position = numPositions; position-- > 0;)
+  {
+    if(flat.parents[position] >= 0)
+    {
+      flat.subtreeSizes[flat.parents[position]] += flat.subtreeSizes[position];
+    }
+  }
+
+  flat.renderNodeOffsets.resize(numPositions + 1);
+  uint32_t renderNodeID = 0;
+  for(uint32_t position = 0; position < numPositions; position++)
+  {
+    flat.renderNodeOffsets[position] = renderNodeID;
+    while(renderNodeID < m_renderNodes.size() && m_renderNodes[renderNodeID].refNodeID == flat.nodes[position])
+    {
+      renderNodeID++;
+    }
+  }
+  flat.renderNodeOffsets[numPositions] = renderNodeID;
+  assert(renderNodeID == m_renderNodes.size() && "Render nodes are not in depth-first order");
+
+  // Counting sort of the positions by depth, keeping the depth-first order within a level
+  std::vector<uint32_t> depths(numPositions, 0);
+  for(uint32_t position = 0; position < numPositions; position++)
+  {
+    const int parent = flat.parents[position];
+    depths[position] = parent < 0 ? 0 : depths[parent] + 1;
+    if(depths[position] + 2 > flat.levelOffsets.size())
+    {
+      flat.levelOffsets.resize(depths[position] + 2, 0);
+    }
+    flat.levelOffsets[depths[position] + 1]++;
+    if(m_model.nodes[flat.nodes[position]].light > -1)
+    {
+      flat.lightPositions.push_back(position);
+    }
+  }
+  for(size_t level = 1; level < flat.levelOffsets.size(); level++)
+  {
+    flat.levelOffsets[level] += flat.levelOffsets[level - 1];
+  }
+  flat.levelPositions.resize(numPositions);
+  std::vector<uint32_t> levelFill(flat.levelOffsets);
+  for(uint32_t position = 0; position < numPositions; position++)
+  {
+    flat.levelPositions[levelFill[depths[position]]++] = position;
+  }
+
+  flat.visible.assign(numPositions, 1);
+  flat.dirty.resize(numPositions);
+
+  if(!m_instanceMatrices.empty())
+  {
+    m_instanceMatrices.resize(m_renderNodes.size(), glm::mat4(1));
+  }
+}
+
+// Computes the world matrix and visibility of the flattened positions [begin, end) and updates their lights
+// and render nodes. The parent of `begin` must be up to date.
+void nvh::gltf::Scene::updateFlatRange(uint32_t begin, uint32_t end)
+{
+  for(uint32_t position = begin; position < end; position++)
+  {
+    updateFlatPosition(position);
+  }
+  updateFlatLights(begin, end);
+}
+
+// Same as updateFlatRange over all the positions, but going level by level: the nodes of a level only
+// depend on the previous one, so large levels are computed in parallel.
+void nvh::gltf::Scene::updateFlatLevels()
+{
+  const FlatHierarchy& flat = m_flatHierarchy;
+
+  for(size_t level = 0; level + 1 < flat.levelOffsets.size(); level++)
+  {
+    const uint32_t* positions    = flat.levelPositions.data() + flat.levelOffsets[level];
+    const uint64_t  numPositions = flat.levelOffsets[level + 1] - flat.levelOffsets[level];
+    nvh::parallel_ranges<2048>(numPositions, [&](uint64_t begin, uint64_t end, uint32_t /*threadIndex*/) {
+      for(uint64_t i = begin; i < end; i++)
+      {
+        updateFlatPosition(positions[i]);
+      }
+    });
+  }
+  updateFlatLights(0, static_cast<uint32_t>(flat.nodes.size()));
+}
+
+// World = parent * local, for affine matrices (last row is 0, 0, 0, 1) which is the case of all glTF nodes
+static inline glm::mat4 multiplyAffine(const glm::mat4& parent, const glm::mat4& local)
+{
+  glm::mat4 result;
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+  const __m128 p0 = _mm_loadu_ps(glm::value_ptr(parent[0]));
+  const __m128 p1 = _mm_loadu_ps(glm::value_ptr(parent[1]));
+  const __m128 p2 = _mm_loadu_ps(glm::value_ptr(parent[2]));
+  const __m128 p3 = _mm_loadu_ps(glm::value_ptr(parent[3]));
+  for(int c = 0; c < 4; c++)
+  {
+    __m128 column = _mm_mul_ps(p0, _mm_set1_ps(local[c][0]));
+    column        = _mm_add_ps(column, _mm_mul_ps(p1, _mm_set1_ps(local[c][1])));
+    column        = _mm_add_ps(column, _mm_mul_ps(p2, _mm_set1_ps(local[c][2])));
+    if(c == 3)
+    {
+      column = _mm_add_ps(column, p3);
+    }
+    _mm_storeu_ps(glm::value_ptr(result[c]), column);
+  }
+#else
+  for(int c = 0; c < 3; c++)
+  {
+    result[c] = parent[0] * local[c][0] + parent[1] * local[c][1] + parent[2] * local[c][2];
+  }
+  result[3] = parent[0] * local[3][0] + parent[1] * local[3][1] + parent[2] * local[3][2] + parent[3];
+#endif
+  return result;
+}
+
+// Computes the world matrix and visibility of one flattened position, and updates its render nodes.
+// Only writes data owned by the position, so positions of the same level can be updated concurrently.
+void nvh::gltf::Scene::updateFlatPosition(uint32_t position)
+{
+  FlatHierarchy& flat = m_flatHierarchy;
+
+  const int             nodeID = flat.nodes[position];
+  const int             parent = flat.parents[position];
+  const tinygltf::Node& tnode  = m_model.nodes[nodeID];
+
+  const glm::mat4 localMatrix = getNodeLocalMatrix(nodeID);
+  const glm::mat4 worldMatrix = parent < 0 ? localMatrix : multiplyAffine(m_nodesWorldMatrices[flat.nodes[parent]], localMatrix);
+  // If a node is not visible, all its children are not visible either
+  const bool visible = (parent < 0 || flat.visible[parent]) && tinygltf::utils::getNodeVisibility(tnode).visible;
+
+  m_nodesWorldMatrices[nodeID] = worldMatrix;
+  flat.visible[position]       = visible;
+
+  for(uint32_t renderNodeID = flat.renderNodeOffsets[position]; renderNodeID < flat.renderNodeOffsets[position + 1]; renderNodeID++)
+  {
+    gltf::RenderNode& renderNode = m_renderNodes[renderNodeID];
+    renderNode.worldMatrix = m_instanceMatrices.empty() ? worldMatrix : worldMatrix * m_instanceMatrices[renderNodeID];
+    renderNode.visible     = visible;
+  }
+}
+
+// Updates the lights attached to the positions [begin, end), after their world matrices
+void nvh::gltf::Scene::updateFlatLights(uint32_t begin, uint32_t end)
+{
+  const FlatHierarchy& flat  = m_flatHierarchy;
+  auto                 first = std::lower_bound(flat.lightPositions.begin(), flat.lightPositions.end(), begin);
+  for(auto it = first; it != flat.lightPositions.end() && *it < end; ++it)
+  {
+    const int nodeID                                  = flat.nodes[*it];
+    m_lights[m_model.nodes[nodeID].light].worldMatrix = m_nodesWorldMatrices[nodeID];
+  }
+}
+
+// Set the material of the render nodes, from the current variant.
+// Each primitive of a node mesh has one render node, or one per instance with EXT_mesh_gpu_instancing.
+void nvh::gltf::Scene::updateRenderNodesMaterials()
+{
+  const FlatHierarchy& flat = m_flatHierarchy;
+
+  for(uint32_t position = 0; position < flat.nodes.size(); position++)
+  {
+    uint32_t       renderNodeID   = flat.renderNodeOffsets[position];
+    const uint32_t numRenderNodes = flat.renderNodeOffsets[position + 1] - renderNodeID;
+    if(numRenderNodes == 0)
+      continue;
+
+    const tinygltf::Mesh& mesh         = m_model.meshes[m_model.nodes[flat.nodes[position]].mesh];
+    const size_t          numInstances = numRenderNodes / mesh.primitives.size();
+    for(const tinygltf::Primitive& primitive : mesh.primitives)
+    {
+      const int materialID = getMaterialVariantIndex(primitive, m_currentVariant);
+      for(size_t i = 0; i < numInstances; i++)
+      {
+        m_renderNodes[renderNodeID++].materialID = materialID;
+      }
+    }
+  }
+}
+
+// Local matrix of the node; animated nodes use their evaluated transform instead of the tinygltf::Node
+glm::mat4 nvh::gltf::Scene::getNodeLocalMatrix(int nodeID) const
+{
+  if(size_t(nodeID) < m_animatedNodes.getSize() && m_animatedNodes.getBit(nodeID))
+  {
+    const NodeTransform& transform = m_nodesLocalTransform[nodeID];
+    glm::mat4            matrix    = glm::mat4_cast(transform.rotation);
+    matrix[0] *= transform.scale.x;
+    matrix[1] *= transform.scale.y;
+    matrix[2] *= transform.scale.z;
+    matrix[3] = glm::vec4(transform.translation, 1.0f);
+    return matrix;
+  }
+  return tinygltf::utils::getNodeMatrix(m_model.nodes[nodeID]);
+}
+
+// The animation writes to m_nodesLocalTransform only, this copies the animated transforms to the tinygltf::Node
+void nvh::gltf::Scene::syncAnimationToModel()
+{
+  for(size_t nodeID = 0; nodeID < m_animatedNodes.getSize(); nodeID++)
+  {
+    if(!m_animatedNodes.getBit(nodeID))
+      continue;
+
+    const NodeTransform& transform = m_nodesLocalTransform[nodeID];
+    tinygltf::Node&      tnode     = m_model.nodes[nodeID];
+    tnode.translation              = {transform.translation.x, transform.translation.y, transform.translation.z};
+    tnode.rotation = {transform.rotation.x, transform.rotation.y, transform.rotation.z, transform.rotation.w};
+    tnode.scale    = {transform.scale.x, transform.scale.y, transform.scale.z};
+    tnode.matrix.clear();
   }
 }
 
@@ -437,7 +899,7 @@ void nvh::gltf::Scene::setCurrentVariant(int variant)
 {
   m_currentVariant = variant;
   // Updating the render nodes with the new material variant
-  updateRenderNodes();
+  updateRenderNodesMaterials();
 }
 
 
@@ -446,8 +908,13 @@ void nvh::gltf::Scene::clearParsedData()
   m_cameras.clear();
   m_lights.clear();
   m_animations.clear();
+  m_nodesLocalTransform.clear();
+  m_animatedNodes.resize(0);
   m_renderNodes.clear();
   m_renderPrimitives.clear();
+  m_flatHierarchy = {};
+  m_dirtyRenderNodes.clear();
+  m_instanceMatrices.clear();
   m_uniquePrimitiveIndex.clear();
   m_variants.clear();
   m_numTriangles    = 0;
@@ -467,10 +934,46 @@ void nvh::gltf::Scene::destroy()
 // Get the unique index of a primitive, and add it to the list if it is not already there
 int nvh::gltf::Scene::getUniqueRenderPrimitive(tinygltf::Primitive& primitive, int meshID)
 {
-  const std::string& key = tinygltf::utils::generatePrimitiveKey(primitive);
+  int  renderPrimID = -1;
+  bool inserted     = false;
+
+  // Warm load: the processed-scene cache already knows the unique primitive, the traversal order is
+  // the same as when it was recorded, so new primitives come in the order of their IDs
+  size_t flatID = 0;
+  if(m_loadCache.active)
+  {
+    flatID = m_loadCache.meshPrimOffsets[meshID] + (&primitive - m_model.meshes[meshID].primitives.data());
+    if(m_loadCache.cachedPrimitiveIDs)
+    {
+      int cachedID = m_loadCache.cachedPrimitiveIDs[flatID];
+      if(cachedID >= 0 && cachedID <= static_cast<int>(m_renderPrimitives.size()))
+      {
+        renderPrimID = cachedID;
+        inserted     = cachedID == static_cast<int>(m_renderPrimitives.size());
+      }
+      else
+      {
+        // Does not match this scene, continue with the keys
+        LOGW("Scene cache does not match the scene, ignored\n");
+        m_loadCache.cachedPrimitiveIDs = nullptr;
+        m_loadCache.complete           = false;
+        for(size_t i = 0; i < m_renderPrimitives.size(); i++)
+        {
+          m_uniquePrimitiveIndex[tinygltf::utils::generatePrimitiveKey(*m_renderPrimitives[i].pPrimitive)] = int(i);
+        }
+      }
+    }
+  }
 
-  // Attempt to insert the key with the next available index if it doesn't exist
-  auto [it, inserted] = m_uniquePrimitiveIndex.try_emplace(key, static_cast<int>(m_uniquePrimitiveIndex.size()));
+  if(renderPrimID < 0)
+  {
+    const std::string& key = tinygltf::utils::generatePrimitiveKey(primitive);
+
+    // Attempt to insert the key with the next available index if it doesn't exist
+    auto [it, newKey] = m_uniquePrimitiveIndex.try_emplace(key, static_cast<int>(m_renderPrimitives.size()));
+    renderPrimID      = it->second;
+    inserted          = newKey;
+  }
 
   // If the primitive was newly inserted, add it to the render primitives list
   if(inserted)
@@ -483,7 +986,12 @@ int nvh::gltf::Scene::getUniqueRenderPrimitive(tinygltf::Primitive& primitive, i
     m_renderPrimitives.push_back(renderPrim);
   }
 
-  return it->second;
+  if(m_loadCache.active)
+  {
+    m_loadCache.primitiveIDs[flatID] = renderPrimID;
+  }
+
+  return renderPrimID;
 }
 
 
@@ -522,13 +1030,27 @@ const std::vector<nvh::gltf::RenderCamera>& nvh::gltf::Scene::getRenderCameras(b
   if(m_cameras.empty())
   {
     assert(m_sceneRootNode > -1 && "No root node in the scene");
-    tinygltf::utils::traverseSceneGraph(m_model, m_sceneRootNode, glm::mat4(1), [&](int nodeID, const glm::mat4& worldMatrix) {
-      return handleCameraTraversal(nodeID, worldMatrix);
-    });
+    traverseCameras(m_sceneRootNode, glm::mat4(1));
   }
   return m_cameras;
 }
 
+// Like tinygltf::utils::traverseSceneGraph, but animated nodes use their evaluated local transform,
+// the animation does not update the tinygltf::Node
+void nvh::gltf::Scene::traverseCameras(int nodeID, const glm::mat4& parentMatrix)
+{
+  const tinygltf::Node& node        = m_model.nodes[nodeID];
+  const glm::mat4       worldMatrix = parentMatrix * getNodeLocalMatrix(nodeID);
+  if(node.camera > -1)
+  {
+    handleCameraTraversal(nodeID, worldMatrix);
+  }
+  for(int child : node.children)
+  {
+    traverseCameras(child, worldMatrix);
+  }
+}
+
 
 bool nvh::gltf::Scene::handleCameraTraversal(int nodeID, const glm::mat4& worldMatrix)
 {
@@ -697,6 +1219,10 @@ size_t nvh::gltf::Scene::handleGpuInstancing(const tinygltf::Value& attributes,
 
     instNode.worldMatrix = worldMatrix * mat;
     m_renderNodes.push_back(instNode);
+
+    // Keep the instance matrix to update the world matrix later, identity for the other render nodes
+    m_instanceMatrices.resize(m_renderNodes.size(), glm::mat4(1));
+    m_instanceMatrices.back() = mat;
   }
   return numInstances;
 }
@@ -724,11 +1250,43 @@ void nvh::gltf::Scene::createMissingTangents()
     }
   }
 
-  // Generate the tangents in parallel
-  nvh::parallel_batches<1>(missTangentPrimitives.size(), [&](uint64_t primID) {
-    tinygltf::Primitive& primitive = *m_renderPrimitives[missTangentPrimitives[primID]].pPrimitive;
-    tinygltf::utils::simpleCreateTangents(m_model, primitive);
-  });
+  // Tangents found in the processed-scene cache are copied, the others are generated
+  if(m_loadCache.active)
+  {
+    m_loadCache.tangentPrimitives = missTangentPrimitives;
+
+    std::vector<int> uncachedPrimitives;
+    for(int renderPrimID : missTangentPrimitives)
+    {
+      auto it = m_loadCache.cachedTangents.find(renderPrimID);
+      if(it != m_loadCache.cachedTangents.end()
+         && it->second.vertexCount == uint32_t(m_renderPrimitives[renderPrimID].vertexCount))
+      {
+        memcpy(getTangentData(renderPrimID), it->second.data, it->second.vertexCount * sizeof(glm::vec4));
+      }
+      else
+      {
+        uncachedPrimitives.push_back(renderPrimID);
+      }
+    }
+    if(!uncachedPrimitives.empty())
+    {
+      m_loadCache.complete = false;
+    }
+    missTangentPrimitives = std::move(uncachedPrimitives);
+  }
+
+  // Generate the tangents in parallel, one task per primitive; primitives differ a lot in size,
+  // work stealing keeps the threads busy until the largest ones are done
+  nvh::TaskGraph graph;
+  for(int renderPrimID : missTangentPrimitives)
+  {
+    graph.add([this, renderPrimID] {
+      tinygltf::Primitive& primitive = *m_renderPrimitives[renderPrimID].pPrimitive;
+      tinygltf::utils::simpleCreateTangents(m_model, primitive);
+    });
+  }
+  graph.run();
 }
 
 
@@ -786,6 +1344,13 @@ void nvh::gltf::Scene::setSceneRootNode(const tinygltf::Node& node)
   tinygltf::Node& rootNode = m_model.nodes[scene.nodes[0]];  // Root node
   rootNode                 = node;
 
+  // An animated root uses its local transform, which now starts from the new node values
+  if(size_t(scene.nodes[0]) < m_animatedNodes.getSize() && m_animatedNodes.getBit(scene.nodes[0]))
+  {
+    NodeTransform& transform = m_nodesLocalTransform[scene.nodes[0]];
+    tinygltf::utils::getNodeTRS(rootNode, transform.translation, transform.rotation, transform.scale);
+  }
+
   updateRenderNodes();
 }
 
@@ -799,6 +1364,14 @@ void nvh::gltf::Scene::setSceneCamera(const nvh::gltf::RenderCamera& camera)
   tnode.translation     = {camera.eye.x, camera.eye.y, camera.eye.z};
   tnode.rotation        = {q.x, q.y, q.z, q.w};
 
+  // An animated camera node uses its local transform, which must see the new camera as well
+  if(size_t(m_sceneCameraNode) < m_animatedNodes.getSize() && m_animatedNodes.getBit(m_sceneCameraNode))
+  {
+    NodeTransform& transform = m_nodesLocalTransform[m_sceneCameraNode];
+    transform.translation    = camera.eye;
+    transform.rotation       = q;
+  }
+
   // Set the tinygltf::Camera
   tinygltf::Camera& tcamera = m_model.cameras[tnode.camera];
   tcamera.type              = "perspective";
@@ -951,8 +1524,10 @@ void nvh::gltf::Scene::parseAnimations()
       animation.channels.emplace_back(channel);
     }
 
+    compileAnimationTracks(animation);
+
     animation.info.reset();
-    m_animations.emplace_back(animation);
+    m_animations.emplace_back(std::move(animation));
   }
 
   // Find all animated primitives (morph)
@@ -979,10 +1554,84 @@ void nvh::gltf::Scene::parseAnimations()
   }
 }
 
+//--------------------------------------------------------------------------------------------------
+// Moves the translation, rotation and scale channels of the animation into flat tracks, one set per path type.
+// The nodes they target get a local transform, initialized from the tinygltf::Node, that the
+// evaluation writes to directly.
+void nvh::gltf::Scene::compileAnimationTracks(Animation& animation)
+{
+  if(m_animatedNodes.getSize() != m_model.nodes.size())
+  {
+    m_animatedNodes.resize(m_model.nodes.size());
+    m_nodesLocalTransform.resize(m_model.nodes.size());
+  }
+
+  std::vector<AnimationChannel> otherChannels;
+  for(const AnimationChannel& channel : animation.channels)
+  {
+    if(channel.path != AnimationChannel::eTranslation && channel.path != AnimationChannel::eRotation
+       && channel.path != AnimationChannel::eScale)
+    {
+      otherChannels.push_back(channel);
+      continue;
+    }
+
+    if(channel.node < 0 || channel.node >= static_cast<int>(m_model.nodes.size()) || channel.samplerIndex >= animation.samplers.size())
+      continue;
+
+    const AnimationSampler& sampler      = animation.samplers[channel.samplerIndex];
+    const bool              isRotation   = channel.path == AnimationChannel::eRotation;
+    const size_t            valuesPerKey = sampler.interpolation == AnimationSampler::eCubicSpline ? 3 : 1;
+    const size_t            numValues    = isRotation ? sampler.outputsVec4.size() : sampler.outputsVec3.size();
+    if(sampler.inputs.size() < 2 || numValues < sampler.inputs.size() * valuesPerKey)
+    {
+      LOGW("Animation channel with invalid keyframes on node %d\n", channel.node);
+      continue;
+    }
+
+    AnimationTracks& tracks = animation.tracks[channel.path];
+    tracks.nodes.push_back(channel.node);
+    tracks.interpolations.push_back(static_cast<uint8_t>(sampler.interpolation));
+    tracks.keyOffsets.push_back(static_cast<uint32_t>(tracks.times.size()));
+    tracks.keyCounts.push_back(static_cast<uint32_t>(sampler.inputs.size()));
+    tracks.valueOffsets.push_back(static_cast<uint32_t>(tracks.values.size()));
+    tracks.keyCursors.push_back(0);
+    tracks.times.insert(tracks.times.end(), sampler.inputs.begin(), sampler.inputs.end());
+    if(isRotation)
+    {
+      tracks.values.insert(tracks.values.end(), sampler.outputsVec4.begin(), sampler.outputsVec4.end());
+    }
+    else
+    {
+      for(const glm::vec3& value : sampler.outputsVec3)
+        tracks.values.emplace_back(value, 0.0f);
+    }
+
+    animation.nodes.push_back(channel.node);
+    if(!m_animatedNodes.getBit(channel.node))
+    {
+      NodeTransform& transform = m_nodesLocalTransform[channel.node];
+      tinygltf::utils::getNodeTRS(m_model.nodes[channel.node], transform.translation, transform.rotation, transform.scale);
+      m_animatedNodes.enableBit(channel.node);
+    }
+  }
+  animation.channels = std::move(otherChannels);
+
+  std::sort(animation.nodes.begin(), animation.nodes.end());
+  animation.nodes.erase(std::unique(animation.nodes.begin(), animation.nodes.end()), animation.nodes.end());
+
+  // The remaining channels (weights) only use the inputs and the float outputs
+  for(AnimationSampler& sampler : animation.samplers)
+  {
+    sampler.outputsVec3 = {};
+    sampler.outputsVec4 = {};
+  }
+}
+
 //--------------------------------------------------------------------------------------------------
 // Update the animation (index)
 // The value of the animation is updated based on the current time
-// - Node transformations are updated
+// - Node transformations are updated (see syncAnimationToModel) and marked dirty
 // - Morph target weights are updated
 bool nvh::gltf::Scene::updateAnimation(uint32_t animationIndex)
 {
@@ -990,6 +1639,17 @@ bool nvh::gltf::Scene::updateAnimation(uint32_t animationIndex)
   Animation& animation = m_animations[animationIndex];
   float      time      = animation.info.currentTime;
 
+  animated |= evaluateTracks(animation.tracks[AnimationChannel::eTranslation], AnimationChannel::eTranslation, time);
+  animated |= evaluateTracks(animation.tracks[AnimationChannel::eRotation], AnimationChannel::eRotation, time);
+  animated |= evaluateTracks(animation.tracks[AnimationChannel::eScale], AnimationChannel::eScale, time);
+  if(animated)
+  {
+    for(int nodeID : animation.nodes)
+    {
+      markNodeDirty(nodeID);
+    }
+  }
+
   for(auto& channel : animation.channels)
   {
     if(channel.node < 0 || channel.node >= m_model.nodes.size())  // Invalid node
@@ -1008,201 +1668,228 @@ bool nvh::gltf::Scene::updateAnimation(uint32_t animationIndex)
       continue;
     }
 
-    animated |= processAnimationChannel(gltfNode, sampler, channel, time, animationIndex);
+    animated |= processAnimationChannel(gltfNode, sampler, channel, time);
   }
 
   return animated;
 }
 
 //--------------------------------------------------------------------------------------------------
-// Process the animation channel
-// - Interpolates the keyframes
-// - Updates the node transformation
-// - Updates the morph target weights
-bool nvh::gltf::Scene::processAnimationChannel(tinygltf::Node&         gltfNode,
-                                               AnimationSampler&       sampler,
-                                               const AnimationChannel& channel,
-                                               float                   time,
-                                               uint32_t                animationIndex)
+// Evaluates all the tracks of one path type and writes the values to the local transform of the nodes.
+// Each track targets a different node, so they are evaluated in parallel ranges.
+bool nvh::gltf::Scene::evaluateTracks(AnimationTracks& tracks, AnimationChannel::PathType path, float time)
 {
-  std::unordered_set<int> warnedAnimations;
-
-  bool animated = false;
-
-  for(size_t i = 0; i < sampler.inputs.size() - 1; i++)
-  {
-    float inputStart = sampler.inputs[i];
-    float inputEnd   = sampler.inputs[i + 1];
+  std::atomic_bool animated = false;
 
-    if(inputStart <= time && time <= inputEnd)
+  nvh::parallel_ranges<512>(tracks.size(), [&](uint64_t trackBegin, uint64_t trackEnd, uint32_t /*threadIndex*/) {
+    bool rangeAnimated = false;
+    for(uint64_t trackID = trackBegin; trackID < trackEnd; trackID++)
     {
-      float t  = calculateInterpolationFactor(inputStart, inputEnd, time);
-      animated = true;
+      glm::vec4 value;
+      if(!evaluateTrack(tracks, trackID, time, path == AnimationChannel::eRotation, value))
+        continue;
 
-      switch(sampler.interpolation)
+      NodeTransform& transform = m_nodesLocalTransform[tracks.nodes[trackID]];
+      switch(path)
       {
-        case AnimationSampler::InterpolationType::eLinear:
-          handleLinearInterpolation(gltfNode, sampler, channel, t, i);
+        case AnimationChannel::eTranslation:
+          transform.translation = glm::vec3(value);
           break;
-        case AnimationSampler::InterpolationType::eStep:
-          handleStepInterpolation(gltfNode, sampler, channel, i);
+        case AnimationChannel::eRotation:
+          transform.rotation = glm::quat(value.w, value.x, value.y, value.z);
           break;
-        case AnimationSampler::InterpolationType::eCubicSpline: {
-          float keyDelta = inputEnd - inputStart;
-          handleCubicSplineInterpolation(gltfNode, sampler, channel, t, keyDelta, i);
+        case AnimationChannel::eScale:
+          transform.scale = glm::vec3(value);
+          break;
+        default:
           break;
-        }
       }
+      rangeAnimated = true;
     }
-  }
+    if(rangeAnimated)
+      animated = true;
+  });
 
   return animated;
 }
 
-//--------------------------------------------------------------------------------------------------
-// Calculate the interpolation factor: [0..1] between two keyframes
-float nvh::gltf::Scene::calculateInterpolationFactor(float inputStart, float inputEnd, float time)
+// Weights of (v_k, b_k, v_{k+1}, a_{k+1}) for the cubic spline interpolation, see
+// https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#interpolation-cubic
+static glm::vec4 getCubicSplineCoefficients(float t, float keyDelta)
 {
-  float keyDelta = inputEnd - inputStart;
-  return std::clamp((time - inputStart) / keyDelta, 0.0f, 1.0f);
+  const float tSq = t * t;
+  const float tCb = tSq * t;
+  const float tD  = keyDelta;
+
+  const float cV1 = -2 * tCb + 3 * tSq;        // -2 t^3 + 3 t^2
+  const float cV0 = 1 - cV1;                   //  2 t^3 - 3 t^2 + 1
+  const float cA  = tD * (tCb - tSq);          // t_d (t^3 - t^2)
+  const float cB  = tD * (tCb - 2 * tSq + t);  // t_d (t^3 - 2 t^2 + t)
+  return {cV0, cB, cV1, cA};
 }
 
 //--------------------------------------------------------------------------------------------------
-// Interpolates the keyframes linearly
-void nvh::gltf::Scene::handleLinearInterpolation(tinygltf::Node&         gltfNode,
-                                                 AnimationSampler&       sampler,
-                                                 const AnimationChannel& channel,
-                                                 float                   t,
-                                                 size_t                  index)
-{
-  switch(channel.path)
-  {
-    case AnimationChannel::PathType::eRotation: {
-      const glm::quat q1 = glm::make_quat(glm::value_ptr(sampler.outputsVec4[index]));
-      const glm::quat q2 = glm::make_quat(glm::value_ptr(sampler.outputsVec4[index + 1]));
-      glm::quat       q  = glm::normalize(glm::slerp(q1, q2, t));
-      gltfNode.rotation  = {q.x, q.y, q.z, q.w};
+// Interpolates one track at `time`, returns false if the time is outside of its keys.
+// The value is a vec4 for all paths, rotations are stored as x, y, z, w.
+bool nvh::gltf::Scene::evaluateTrack(AnimationTracks& tracks, size_t trackID, float time, bool isRotation, glm::vec4& result)
+{
+  const float*     times  = tracks.times.data() + tracks.keyOffsets[trackID];
+  const glm::vec4* values = tracks.values.data() + tracks.valueOffsets[trackID];
+  size_t&          cursor = tracks.keyCursors[trackID];
+
+  if(!findKeyframeInterval({times, tracks.keyCounts[trackID]}, time, cursor))
+    return false;
+
+  const size_t i        = cursor;
+  const float  keyDelta = times[i + 1] - times[i];
+  const float  t        = calculateInterpolationFactor(times[i], times[i + 1], time);
+
+  switch(tracks.interpolations[trackID])
+  {
+    case AnimationSampler::InterpolationType::eLinear:
+      if(isRotation)
+      {
+        const glm::quat q1 = glm::make_quat(glm::value_ptr(values[i]));
+        const glm::quat q2 = glm::make_quat(glm::value_ptr(values[i + 1]));
+        const glm::quat q  = glm::normalize(glm::slerp(q1, q2, t));
+        result             = glm::vec4(q.x, q.y, q.z, q.w);
+      }
+      else
+      {
+        result = glm::mix(values[i], values[i + 1], t);
+      }
       break;
-    }
-    case AnimationChannel::PathType::eTranslation: {
-      glm::vec3 trans      = glm::mix(sampler.outputsVec3[index], sampler.outputsVec3[index + 1], t);
-      gltfNode.translation = {trans.x, trans.y, trans.z};
+    case AnimationSampler::InterpolationType::eStep:
+      result = values[i];
       break;
-    }
-    case AnimationChannel::PathType::eScale: {
-      glm::vec3 s    = glm::mix(sampler.outputsVec3[index], sampler.outputsVec3[index + 1], t);
-      gltfNode.scale = {s.x, s.y, s.z};
+    case AnimationSampler::InterpolationType::eCubicSpline: {
+      // Keys are stored as (in-tangent a, value v, out-tangent b)
+      const glm::vec4 c         = getCubicSplineCoefficients(t, keyDelta);
+      const size_t    prevIndex = i * 3;
+      const size_t    nextIndex = (i + 1) * 3;
+
+      result = c.x * values[prevIndex + 1] + c.y * values[prevIndex + 2] + c.z * values[nextIndex + 1] + c.w * values[nextIndex];
+      if(isRotation)
+      {
+        result = glm::normalize(result);
+      }
       break;
     }
-    case AnimationChannel::PathType::eWeights: {
-      {
-        // Retrieve the mesh from the node
-        if(gltfNode.mesh >= 0)
-        {
-          tinygltf::Mesh& mesh = m_model.meshes[gltfNode.mesh];
+  }
+  return true;
+}
 
-          // Make sure the weights vector is resized to match the number of morph targets
-          if(mesh.weights.size() != sampler.outputsFloat[index].size())
-          {
-            mesh.weights.resize(sampler.outputsFloat[index].size());
-          }
+//--------------------------------------------------------------------------------------------------
+// Process the animation channel
+// - Interpolates the keyframes
+// - Updates the morph target weights
+bool nvh::gltf::Scene::processAnimationChannel(tinygltf::Node& gltfNode, AnimationSampler& sampler, AnimationChannel& channel, float time)
+{
+  if(!findKeyframeInterval(sampler.inputs, time, channel.keyCursor))
+    return false;
 
-          // Interpolating between weights for morph targets
-          for(size_t j = 0; j < mesh.weights.size(); j++)
-          {
-            float weight1   = sampler.outputsFloat[index][j];
-            float weight2   = sampler.outputsFloat[index + 1][j];
-            mesh.weights[j] = glm::mix(weight1, weight2, t);
-          }
-        }
-        break;
-      }
-    }
+  const size_t i          = channel.keyCursor;
+  float        inputStart = sampler.inputs[i];
+  float        inputEnd   = sampler.inputs[i + 1];
+  float        t          = calculateInterpolationFactor(inputStart, inputEnd, time);
+
+  if(channel.path == AnimationChannel::PathType::eWeights)
+  {
+    handleWeightsInterpolation(gltfNode, sampler, t, inputEnd - inputStart, i);
   }
+
+  return true;
 }
 
 //--------------------------------------------------------------------------------------------------
-// Interpolates the keyframes with a step interpolation
-void nvh::gltf::Scene::handleStepInterpolation(tinygltf::Node& gltfNode, AnimationSampler& sampler, const AnimationChannel& channel, size_t index)
+// Find the keyframe interval [i, i+1] containing `time`, such that inputs[i] <= time < inputs[i+1]
+// (or the last interval when time is the last key). Returns false if time is outside the keys.
+// - `cursor` is the interval found on the previous call: playing forward is O(1)
+// - On a seek (or a loop), fall back to a binary search: O(log n)
+bool nvh::gltf::Scene::findKeyframeInterval(std::span<const float> inputs, float time, size_t& cursor)
 {
-  switch(channel.path)
+  const size_t numKeys = inputs.size();
+  if(numKeys < 2 || time < inputs.front() || time > inputs.back())
+    return false;
+
+  const size_t lastInterval = numKeys - 2;
+  if(time == inputs.back())
   {
-    case AnimationChannel::PathType::eRotation: {
-      glm::quat q       = glm::quat(sampler.outputsVec4[index]);
-      gltfNode.rotation = {q.x, q.y, q.z, q.w};
-      break;
-    }
-    case AnimationChannel::PathType::eTranslation: {
-      glm::vec3 t          = glm::vec3(sampler.outputsVec3[index]);
-      gltfNode.translation = {t.x, t.y, t.z};
-      break;
-    }
-    case AnimationChannel::PathType::eScale: {
-      glm::vec3 s    = glm::vec3(sampler.outputsVec3[index]);
-      gltfNode.scale = {s.x, s.y, s.z};
-      break;
+    cursor = lastInterval;
+    return true;
+  }
+
+  // Same interval as last time, or the next one
+  for(size_t i = std::min(cursor, lastInterval); i <= std::min(cursor + 1, lastInterval); i++)
+  {
+    if(inputs[i] <= time && time < inputs[i + 1])
+    {
+      cursor = i;
+      return true;
     }
   }
+
+  // Seek: first key strictly greater than time, the interval starts one before
+  auto upper = std::upper_bound(inputs.begin(), inputs.end(), time);
+  cursor     = std::min(static_cast<size_t>(std::distance(inputs.begin(), upper)) - 1, lastInterval);
+  return true;
 }
 
 //--------------------------------------------------------------------------------------------------
-// Interpolates the keyframes with a cubic spline interpolation
-void nvh::gltf::Scene::handleCubicSplineInterpolation(tinygltf::Node&         gltfNode,
-                                                      AnimationSampler&       sampler,
-                                                      const AnimationChannel& channel,
-                                                      float                   t,
-                                                      float                   keyDelta,
-                                                      size_t                  index)
-{
-  // Implements the logic in
-  // https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#interpolation-cubic
-  // for quaternions (first case) and other values (second case).
-
-  const size_t prevIndex = index * 3;
-  const size_t nextIndex = (index + 1) * 3;
-  const size_t A         = 0;  // Offset for the in-tangent
-  const size_t V         = 1;  // Offset for the value
-  const size_t B         = 2;  // Offset for the out-tangent
-
-  const float tSq = t * t;
-  const float tCb = tSq * t;
-  const float tD  = keyDelta;
+// Calculate the interpolation factor: [0..1] between two keyframes
+float nvh::gltf::Scene::calculateInterpolationFactor(float inputStart, float inputEnd, float time)
+{
+  float keyDelta = inputEnd - inputStart;
+  return std::clamp((time - inputStart) / keyDelta, 0.0f, 1.0f);
+}
 
-  // Compute each of the coefficient terms in the specification
-  const float cV1 = -2 * tCb + 3 * tSq;        // -2 t^3 + 3 t^2
-  const float cV0 = 1 - cV1;                   //  2 t^3 - 3 t^2 + 1
-  const float cA  = tD * (tCb - tSq);          // t_d (t^3 - t^2)
-  const float cB  = tD * (tCb - 2 * tSq + t);  // t_d (t^3 - 2 t^2 + t)
+//--------------------------------------------------------------------------------------------------
+// Interpolates the morph target weights of the mesh
+void nvh::gltf::Scene::handleWeightsInterpolation(tinygltf::Node& gltfNode, AnimationSampler& sampler, float t, float keyDelta, size_t index)
+{
+  // Retrieve the mesh from the node
+  if(gltfNode.mesh < 0)
+    return;
 
-  if(channel.path == AnimationChannel::PathType::eRotation)
-  {
-    const glm::vec4& v0 = sampler.outputsVec4[prevIndex + V];  // v_k
-    const glm::vec4& a  = sampler.outputsVec4[nextIndex + A];  // a_{k+1}
-    const glm::vec4& b  = sampler.outputsVec4[prevIndex + B];  // b_k
-    const glm::vec4& v1 = sampler.outputsVec4[nextIndex + V];  // v_{k+1}
+  tinygltf::Mesh&           mesh    = m_model.meshes[gltfNode.mesh];
+  const std::vector<float>& prevKey = sampler.outputsFloat[index];
+  const std::vector<float>& nextKey = sampler.outputsFloat[index + 1];
 
-    glm::vec4 result = cV0 * v0 + cB * b + cV1 * v1 + cA * a;
+  // Cubic spline keys store the in-tangents, values and out-tangents of all targets
+  const bool   cubicSpline = sampler.interpolation == AnimationSampler::InterpolationType::eCubicSpline;
+  const size_t numTargets  = cubicSpline ? prevKey.size() / 3 : prevKey.size();
 
-    glm::quat quatResult = glm::make_quat(glm::value_ptr(result));
-    quatResult           = glm::normalize(quatResult);
-    gltfNode.rotation    = {quatResult.x, quatResult.y, quatResult.z, quatResult.w};
-  }
-  else
+  // Make sure the weights vector is resized to match the number of morph targets
+  if(mesh.weights.size() != numTargets)
   {
-    const glm::vec3& v0 = sampler.outputsVec3[prevIndex + V];  // v_k
-    const glm::vec3& a  = sampler.outputsVec3[nextIndex + A];  // a_{k+1}
-    const glm::vec3& b  = sampler.outputsVec3[prevIndex + B];  // b_k
-    const glm::vec3& v1 = sampler.outputsVec3[nextIndex + V];  // v_{k+1}
-
-    glm::vec3 result = cV0 * v0 + cB * b + cV1 * v1 + cA * a;
+    mesh.weights.resize(numTargets);
+  }
 
-    if(channel.path == AnimationChannel::PathType::eTranslation)
-    {
-      gltfNode.translation = {result.x, result.y, result.z};
-    }
-    else if(channel.path == AnimationChannel::PathType::eScale)
-    {
-      gltfNode.scale = {result.x, result.y, result.z};
+  switch(sampler.interpolation)
+  {
+    case AnimationSampler::InterpolationType::eLinear:
+      for(size_t j = 0; j < numTargets; j++)
+      {
+        mesh.weights[j] = glm::mix(prevKey[j], nextKey[j], t);
+      }
+      break;
+    case AnimationSampler::InterpolationType::eStep:
+      for(size_t j = 0; j < numTargets; j++)
+      {
+        mesh.weights[j] = prevKey[j];
+      }
+      break;
+    case AnimationSampler::InterpolationType::eCubicSpline: {
+      const glm::vec4 c = getCubicSplineCoefficients(t, keyDelta);
+      for(size_t j = 0; j < numTargets; j++)
+      {
+        const float v0 = prevKey[numTargets + j];      // v_k
+        const float b  = prevKey[2 * numTargets + j];  // b_k
+        const float v1 = nextKey[numTargets + j];      // v_{k+1}
+        const float a  = nextKey[j];                   // a_{k+1}
+        mesh.weights[j] = c.x * v0 + c.y * b + c.z * v1 + c.w * a;
+      }
+      break;
     }
   }
 }
@@ -1378,27 +2065,34 @@ void nvh::GltfScene::importDrawableNodes(const tinygltf::Model& tmodel,
     }
   }
 
-  // Fixing tangents, if any were null
-  uint32_t num_threads = std::min((uint32_t)m_tangents.size(), std::thread::hardware_concurrency());
-  nvh::parallel_batches(
-      m_tangents.size(),
-      [&](uint64_t i) {
-        auto& t = m_tangents[i];
-        if(glm::length2(glm::vec3(t)) < 0.01F || std::abs(t.w) < 0.5F)
-        {
-          t = makeFastTangent(m_normals[i]);
-        }
-      },
-      num_threads);
+  // Fixing the null tangents only touches the vertex data, while flattening the hierarchy and
+  // computing the scene dimensions only read the meshes: both run at the same time.
+  nvh::TaskGraph graph;
+  graph.addRanges(m_tangents.size(), 8192, [&](uint64_t begin, uint64_t end) {
+    for(uint64_t i = begin; i < end; i++)
+    {
+      auto& t = m_tangents[i];
+      if(glm::length2(glm::vec3(t)) < 0.01F || std::abs(t.w) < 0.5F)
+      {
+        t = makeFastTangent(m_normals[i]);
+      }
+    }
+  });
 
   // Transforming the scene hierarchy to a flat list
-  for(auto nodeIdx : tscene.nodes)
-  {
-    processNode(tmodel, nodeIdx, glm::mat4(1));
-  }
-
-  computeSceneDimensions();
-  computeCamera();
+  nvh::TaskGraph::TaskID flatten = graph.add([&] {
+    for(auto nodeIdx : tscene.nodes)
+    {
+      processNode(tmodel, nodeIdx, glm::mat4(1));
+    }
+  });
+  graph.add(
+      [&] {
+        computeSceneDimensions();
+        computeCamera();
+      },
+      {flatten});
+  graph.run();
 
   m_meshToPrimMeshes.clear();
   primitiveIndices32u.clear();
@@ -31,6 +31,7 @@
 #include <unordered_map>
 #include <vector>
 #include "fileformats/tinygltf_utils.hpp"
+#include "bitarray.hpp"
 #include "boundingbox.hpp"
 
 #define KHR_LIGHTS_PUNCTUAL_EXTENSION_NAME "KHR_lights_punctual"
@@ -139,6 +140,12 @@ Note: The Scene class is a more advanced and light weight version of the GltfSce
       But it is to the user to retrieve the primitive data from the RenderPrimitives.
       Check the tinygltf_utils.hpp for more information on how to extract the primitive data.
 
+Processed-scene cache: when `setCacheDirectory()` is set, `load()` stores the data it derives from the
+file (the unique primitive of each mesh primitive and the generated tangents) in a flat binary file of
+that directory. There is one cache file per glTF path; it stores a hash of the glTF content, its
+external buffers, and the loader version, so loading the same content again memory-maps it and skips
+the primitive keys and the tangent generation. When the content changed, the file is rewritten.
+
 @DOC_END */
 
 
@@ -160,17 +167,24 @@ public:
   const std::string& getFilename() const { return m_filename; }
   void               takeModel(tinygltf::Model&& model);  // Use a model that has been loaded
 
+  // Processed-scene cache, see the documentation above. An empty directory disables it (default).
+  void               setCacheDirectory(const std::string& directory) { m_cacheDirectory = directory; }
+  const std::string& getCacheDirectory() const { return m_cacheDirectory; }
+
   // Getters
   const tinygltf::Model& getModel() const { return m_model; }
   tinygltf::Model&       getModel() { return m_model; }
   bool                   valid() const { return !m_renderNodes.empty(); }
 
   // Animation Management
-  void                 updateRenderNodes();  // Update the render nodes matrices and materials
-  bool                 updateAnimation(uint32_t animationIndex);
-  int                  getNumAnimations() const { return static_cast<int>(m_animations.size()); }
-  bool                 hasAnimation() const { return !m_animations.empty(); }
-  gltf::AnimationInfo& getAnimationInfo(int index) { return m_animations[index].info; }
+  void                         updateRenderNodes();        // Update the render nodes matrices and materials
+  const std::vector<uint32_t>& updateDirtyRenderNodes();   // Update the dirty subtrees, returns the changed render nodes
+  void                         markNodeDirty(int nodeID);  // Transform or visibility of the node changed
+  bool                         updateAnimation(uint32_t animationIndex);
+  void                         syncAnimationToModel();  // Write the animated transforms back to the tinygltf::Node (done by save())
+  int                          getNumAnimations() const { return static_cast<int>(m_animations.size()); }
+  bool                         hasAnimation() const { return !m_animations.empty(); }
+  gltf::AnimationInfo&         getAnimationInfo(int index) { return m_animations[index].info; }
 
   // Resource Management
   void destroy();  // Destroy the loaded resources
@@ -198,6 +212,7 @@ public:
   tinygltf::Node getSceneRootNode() const;
   void           setSceneRootNode(const tinygltf::Node& node);
   const std::vector<glm::mat4>& getNodesWorldMatrices() const { return m_nodesWorldMatrices; }
+  void setParallelTransforms(bool parallel) { m_parallelTransforms = parallel; }  // Full update level by level, in parallel
 
   // Variant Management
   void                            setCurrentVariant(int variant);  // Set the variant to be used
@@ -226,6 +241,15 @@ private:
     PathType path         = eTranslation;
     int      node         = -1;
     uint32_t samplerIndex = 0;
+    size_t   keyCursor    = 0;  // Last keyframe interval used, makes forward playback O(1)
+  };
+
+  // Local transform of an animated node, written by the animation instead of the tinygltf::Node
+  struct NodeTransform
+  {
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::quat rotation    = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale       = glm::vec3(1.0f);
   };
 
   struct AnimationSampler
@@ -243,11 +267,46 @@ private:
     std::vector<std::vector<float>> outputsFloat;
   };
 
+  // Compiled keyframes of all the channels animating one path type (translation, rotation or scale).
+  // Per-track data is stored in parallel arrays and the keys of all tracks are concatenated,
+  // which makes the evaluation a flat loop over the tracks.
+  struct AnimationTracks
+  {
+    std::vector<int>       nodes;           // Target node, per track
+    std::vector<uint8_t>   interpolations;  // AnimationSampler::InterpolationType, per track
+    std::vector<uint32_t>  keyOffsets;      // First key in `times`, per track
+    std::vector<uint32_t>  keyCounts;       // Number of keys, per track
+    std::vector<uint32_t>  valueOffsets;    // First value in `values`, per track
+    std::vector<size_t>    keyCursors;      // Last keyframe interval used, per track
+    std::vector<float>     times;           // Key times of all tracks
+    std::vector<glm::vec4> values;          // Key values of all tracks (vec3 in xyz), 3 per key for cubic spline
+
+    size_t size() const { return nodes.size(); }
+  };
+
   struct Animation
   {
     AnimationInfo                 info;
     std::vector<AnimationSampler> samplers;
-    std::vector<AnimationChannel> channels;
+    std::vector<AnimationChannel> channels;   // Morph weights (and unsupported pointer) channels
+    AnimationTracks               tracks[3];  // Translation, rotation and scale channels, indexed by PathType
+    std::vector<int>              nodes;      // Nodes targeted by the tracks
+  };
+
+  // Scene graph of the current scene, flattened in depth-first order: parents come before their children
+  // and the subtree of the node at position `i` covers the positions [i, i + subtreeSizes[i]).
+  struct FlatHierarchy
+  {
+    std::vector<int>      nodes;              // Node ID, per position
+    std::vector<int>      parents;            // Position of the parent, -1 for the scene nodes
+    std::vector<uint32_t> subtreeSizes;       // Number of nodes in the subtree, including the node itself
+    std::vector<uint32_t> renderNodeOffsets;  // First render node of each position, plus the total at the end
+    std::vector<uint8_t>  visible;            // Visibility, including the one inherited from the parents
+    std::vector<int>      positions;          // Position of each node ID, -1 if not in the current scene
+    std::vector<uint32_t> levelPositions;     // Positions sorted by depth in the scene graph
+    std::vector<uint32_t> levelOffsets;       // First entry of each depth in levelPositions, plus the total at the end
+    std::vector<uint32_t> lightPositions;     // Positions of the nodes with a light
+    nvh::BitArray         dirty;              // Positions whose subtree needs to be updated
   };
 
 
@@ -265,19 +324,47 @@ private:
   bool   handleRenderNode(int nodeID, glm::mat4 worldMatrix);
   size_t handleGpuInstancing(const tinygltf::Value& attributes, gltf::RenderNode renderNode, glm::mat4 worldMatrix);
   bool   handleCameraTraversal(int nodeID, const glm::mat4& worldMatrix);
+  void   traverseCameras(int nodeID, const glm::mat4& parentMatrix);
   bool   handleLightTraversal(int nodeID, const glm::mat4& worldMatrix);
-  void   updateVisibility(int nodeID, bool visible, uint32_t& renderNodeID);
+  void   buildFlatHierarchy();
+  void   updateFlatRange(uint32_t begin, uint32_t end);
+  void   updateFlatLevels();
+  void   updateFlatPosition(uint32_t position);
+  void   updateFlatLights(uint32_t begin, uint32_t end);
+  void   updateRenderNodesMaterials();
   void   createMissingTangents();
-  bool processAnimationChannel(tinygltf::Node& gltfNode, AnimationSampler& sampler, const AnimationChannel& channel, float time, uint32_t animationIndex);
-  float calculateInterpolationFactor(float inputStart, float inputEnd, float time);
-  void handleLinearInterpolation(tinygltf::Node& gltfNode, AnimationSampler& sampler, const AnimationChannel& channel, float t, size_t index);
-  void handleStepInterpolation(tinygltf::Node& gltfNode, AnimationSampler& sampler, const AnimationChannel& channel, size_t index);
-  void handleCubicSplineInterpolation(tinygltf::Node&         gltfNode,
-                                      AnimationSampler&       sampler,
-                                      const AnimationChannel& channel,
-                                      float                   t,
-                                      float                   keyDelta,
-                                      size_t                  index);
+  void compileAnimationTracks(Animation& animation);
+  bool evaluateTracks(AnimationTracks& tracks, AnimationChannel::PathType path, float time);
+  bool processAnimationChannel(tinygltf::Node& gltfNode, AnimationSampler& sampler, AnimationChannel& channel, float time);
+  void handleWeightsInterpolation(tinygltf::Node& gltfNode, AnimationSampler& sampler, float t, float keyDelta, size_t index);
+  static bool  evaluateTrack(AnimationTracks& tracks, size_t trackID, float time, bool isRotation, glm::vec4& result);
+  static bool  findKeyframeInterval(std::span<const float> inputs, float time, size_t& cursor);
+  static float calculateInterpolationFactor(float inputStart, float inputEnd, float time);
+
+  glm::mat4 getNodeLocalMatrix(int nodeID) const;
+
+  // Data reused from, or recorded for, the processed-scene cache while load() parses the scene
+  struct LoadCache
+  {
+    struct Tangents
+    {
+      const uint8_t* data        = nullptr;  // vec4 per vertex, points into the mapped cache file
+      uint32_t       vertexCount = 0;
+    };
+
+    bool                              active             = false;    // Only set during load() with a cache directory
+    bool                              complete           = false;    // Nothing new to write to the cache file
+    const int32_t*                    cachedPrimitiveIDs = nullptr;  // renderPrimID per flat primitive, from the file
+    std::unordered_map<int, Tangents> cachedTangents;                // Key: renderPrimID
+    std::vector<uint32_t>             meshPrimOffsets;               // First flat primitive of each mesh
+    std::vector<int32_t>              primitiveIDs;       // renderPrimID per flat primitive, -1 if not in the scene
+    std::vector<int>                  tangentPrimitives;  // Render primitives with generated tangents
+  };
+
+  uint64_t computeSourceHash() const;
+  void     beginLoadCache(const void* data, size_t size, uint64_t sourceHash);
+  bool     writeLoadCache(const std::string& cacheFile, uint64_t sourceHash);
+  uint8_t* getTangentData(int renderPrimID);
 
   tinygltf::Model                      m_model;                 // The glTF model
   std::string                          m_filename;              // Filename of the glTF
@@ -291,12 +378,21 @@ private:
   std::vector<uint32_t>                m_morphPrimitives;       // All the primitives that are animated
   std::vector<uint32_t>                m_skinNodes;             // All the primitives that are animated
   std::vector<glm::mat4>               m_nodesWorldMatrices;
+  std::vector<NodeTransform>           m_nodesLocalTransform;   // Local transform of the animated nodes
+  nvh::BitArray                        m_animatedNodes;         // Nodes using m_nodesLocalTransform
+  FlatHierarchy                        m_flatHierarchy;         // Scene graph used to update the transforms
+  std::vector<uint32_t>                m_dirtyRenderNodes;      // Render nodes changed by updateDirtyRenderNodes
+  std::vector<glm::mat4>               m_instanceMatrices;  // EXT_mesh_gpu_instancing, per render node (empty if unused)
+  std::string                          m_cacheDirectory;    // Processed-scene cache, empty: off
+  LoadCache                            m_loadCache;         // Cache state during load()
 
   int       m_numTriangles    = 0;   // Stat - Number of triangles
   int       m_currentScene    = 0;   // Scene index
   int       m_currentVariant  = 0;   // Variant index
   int       m_sceneRootNode   = -1;  // Node index of the root
   int       m_sceneCameraNode = -1;  // Node index of the camera
+
+  bool m_parallelTransforms = true;  // Transforms of large levels are computed in parallel
   nvh::Bbox m_sceneBounds;           // Scene bounds
 };
 
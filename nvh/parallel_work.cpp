@@ -19,6 +19,9 @@
 
 #include "parallel_work.hpp"
 
+#include <map>
+#include <mutex>
+
 namespace nvh {
 
 BS::thread_pool& get_thread_pool()
@@ -31,4 +34,57 @@ BS::thread_pool& get_thread_pool()
   return threadPool;
 }
 
+//--------------------------------------------------------------------------------------------------
+// Statistics of parallel_batches_adaptive, per call name
+//
+static std::mutex                           s_statsMutex;
+static std::map<std::string, ParallelStats> s_stats;
+
+void parallel_stats_record(const char* name, const ParallelCallStats& call)
+{
+  std::lock_guard<std::mutex> lock(s_statsMutex);
+  ParallelStats&              stats = s_stats[name];
+  stats.calls++;
+  stats.totalItems += call.items;
+  stats.totalChunks += call.chunks;
+  stats.totalWallMicroseconds += call.wallMicroseconds;
+  stats.maxImbalance = std::max(stats.maxImbalance, call.imbalance);
+  stats.last         = call;
+}
+
+bool parallel_stats_get(const char* name, ParallelStats& stats)
+{
+  std::lock_guard<std::mutex> lock(s_statsMutex);
+  auto                        it = s_stats.find(name);
+  if(it == s_stats.end())
+  {
+    return false;
+  }
+  stats = it->second;
+  return true;
+}
+
+void parallel_stats_print(std::string& stats)
+{
+  std::lock_guard<std::mutex> lock(s_statsMutex);
+  for(const auto& it : s_stats)
+  {
+    const ParallelStats& s = it.second;
+    char                 line[512];
+    snprintf(line, sizeof(line),
+             "Parallel %s;\t calls %6llu; items %10llu; chunks %8llu; wall %8d (microseconds, total); "
+             "last: chunk %llu, threads %u, imbalance %.2f; max imbalance %.2f\n",
+             it.first.c_str(), (unsigned long long)s.calls, (unsigned long long)s.totalItems,
+             (unsigned long long)s.totalChunks, (int)s.totalWallMicroseconds, (unsigned long long)s.last.chunkSize,
+             s.last.threads, s.last.imbalance, s.maxImbalance);
+    stats += line;
+  }
+}
+
+void parallel_stats_reset()
+{
+  std::lock_guard<std::mutex> lock(s_statsMutex);
+  s_stats.clear();
+}
+
 }  // namespace nvh
\ No newline at end of file
@@ -22,9 +22,14 @@
 
 #include "BS_thread_pool.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <execution>
 #include <functional>
+#include <string>
+#include <vector>
 
 namespace nvh {
 /* @DOC_START
@@ -60,6 +65,27 @@ All functions here are thread-safe. However, if the callback does
 synchronization (e.g. locking, mutexes), then it is only safe to use
 batches_indexed and ranges.
 
+## Adaptive batches
+
+`parallel_batches_adaptive(name, numItems, fn(itemIndex))` does not need a compile-time
+batch size. It runs a first probe chunk on the calling thread and measures the
+cost per item, then picks the chunk size (about `PARALLEL_ADAPTIVE_CHUNK_MICROSECONDS`
+of work per chunk) and the number of threads, or finishes serially when the remaining
+work is too small to be worth distributing. The threads grab chunks dynamically.
+
+If `name` is not null, each call is recorded under that name: number of calls,
+items, chunks, chunk size and threads of the last call, wall time and
+imbalance (busiest thread time divided by the average thread time, 1.0 is perfect).
+`parallel_stats_print` or `nvh::Profiler::print(stats, true)` dump them, which makes it
+possible to tune loaders without recompiling.
+
+```cpp
+nvh::parallel_batches_adaptive("fixTangents", tangents.size(), [&](uint64_t i) { fixTangent(i); });
+...
+std::string stats;
+profiler.print(stats, true);
+```
+
 @DOC_END */
 
 // Utility to support parallel execution with indices without unnecessarily
@@ -301,4 +327,140 @@ inline void parallel_ranges(uint64_t numItems, F&& fn, uint32_t numThreads = 0)
   }
 }
 
+
+//--------------------------------------------------------------------------------------------------
+// Adaptive batches and their statistics
+//
+
+// Target amount of work per chunk, big enough to hide the cost of fetching a chunk
+static constexpr double PARALLEL_ADAPTIVE_CHUNK_MICROSECONDS = 100.0;
+// Below this much estimated work, running on multiple threads costs more than it saves
+static constexpr double PARALLEL_ADAPTIVE_MIN_PARALLEL_MICROSECONDS = 200.0;
+// The probe chunk grows until it took at least that long
+static constexpr double PARALLEL_ADAPTIVE_PROBE_MICROSECONDS = 20.0;
+
+struct ParallelCallStats
+{
+  uint64_t items            = 0;
+  uint64_t chunks           = 0;
+  uint64_t chunkSize        = 0;
+  uint32_t threads          = 1;
+  double   wallMicroseconds = 0;
+  double   imbalance        = 1.0;  // max thread busy time / average thread busy time
+};
+
+struct ParallelStats
+{
+  uint64_t          calls                 = 0;
+  uint64_t          totalItems            = 0;
+  uint64_t          totalChunks           = 0;
+  double            totalWallMicroseconds = 0;
+  double            maxImbalance          = 1.0;
+  ParallelCallStats last;
+};
+
+// Accumulates the statistics of one call into the entry `name`, thread-safe
+void parallel_stats_record(const char* name, const ParallelCallStats& call);
+// Returns false if no call was recorded under `name`
+bool parallel_stats_get(const char* name, ParallelStats& stats);
+// Appends one line per recorded name
+void parallel_stats_print(std::string& stats);
+void parallel_stats_reset();
+
+template <typename F>
+inline void parallel_batches_adaptive(const char* name, uint64_t numItems, F&& fn, uint32_t numThreads = 0)
+{
+  using Clock = std::chrono::steady_clock;
+  auto microsecondsSince = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+  };
+
+  const Clock::time_point callStart = Clock::now();
+  ParallelCallStats       call;
+  call.items = numItems;
+
+  // Probe: run a growing number of items on this thread until it is long enough to measure
+  uint64_t itemsDone = 0;
+  uint64_t probeSize = 16;
+  double   probeTime = 0;
+  while(itemsDone < numItems && probeTime < PARALLEL_ADAPTIVE_PROBE_MICROSECONDS)
+  {
+    const uint64_t end = std::min(numItems, itemsDone + probeSize);
+    for(uint64_t i = itemsDone; i < end; i++)
+    {
+      fn(i);
+    }
+    itemsDone = end;
+    probeSize *= 2;
+    probeTime = microsecondsSince(callStart);
+    call.chunks++;
+  }
+
+  const uint64_t remaining    = numItems - itemsDone;
+  const double   itemCost     = probeTime / double(std::max(itemsDone, uint64_t(1)));
+  const bool     nested       = BS::this_thread::get_index().has_value();
+  const double   expectedWork = itemCost * double(remaining);
+
+  if(remaining == 0 || numThreads == 1 || nested || expectedWork < PARALLEL_ADAPTIVE_MIN_PARALLEL_MICROSECONDS)
+  {
+    for(uint64_t i = itemsDone; i < numItems; i++)
+    {
+      fn(i);
+    }
+    call.chunks += remaining ? 1 : 0;
+    call.chunkSize = remaining;
+  }
+  else
+  {
+    BS::thread_pool& threadPool = get_thread_pool();
+    const uint64_t   chunkSize =
+        std::max(uint64_t(1), static_cast<uint64_t>(PARALLEL_ADAPTIVE_CHUNK_MICROSECONDS / std::max(itemCost, 1e-6)));
+    const uint64_t numChunks = (remaining + chunkSize - 1) / chunkSize;
+    uint32_t       threads   = static_cast<uint32_t>(std::min<uint64_t>(threadPool.get_thread_count(), numChunks));
+    if(numThreads != 0)
+    {
+      threads = std::min(threads, numThreads);
+    }
+    threads = std::max(threads, 1u);
+
+    // Threads take the next chunk until there are none left
+    std::atomic_uint64_t nextChunk{0};
+    std::vector<double>  busyTimes(threads, 0.0);
+    auto                 worker = [&](uint32_t threadIndex) {
+      const Clock::time_point start = Clock::now();
+      for(uint64_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++)
+      {
+        const uint64_t begin = itemsDone + chunk * chunkSize;
+        const uint64_t end   = std::min(numItems, begin + chunkSize);
+        for(uint64_t i = begin; i < end; i++)
+        {
+          fn(i);
+        }
+      }
+      busyTimes[threadIndex] = microsecondsSince(start);
+    };
+
+    BS::multi_future<void> future = threadPool.submit_sequence<uint32_t>(0, threads, worker);
+    future.wait();
+
+    double busyMax = 0;
+    double busySum = 0;
+    for(double busy : busyTimes)
+    {
+      busyMax = std::max(busyMax, busy);
+      busySum += busy;
+    }
+    call.chunks += numChunks;
+    call.chunkSize = chunkSize;
+    call.threads   = threads;
+    call.imbalance = busySum > 0 ? busyMax * double(threads) / busySum : 1.0;
+  }
+
+  call.wallMicroseconds = microsecondsSince(callStart);
+  if(name)
+  {
+    parallel_stats_record(name, call);
+  }
+}
+
 }  // namespace nvh
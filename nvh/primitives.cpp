@@ -18,15 +18,23 @@
  */
 
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#endif
 
 #define _USE_MATH_DEFINES
 #include <math.h>
-#include <unordered_map>
 #include <unordered_set>
 #include <random>
 #include "primitives.hpp"
-#include "container_utils.hpp"
+#include "parallel_work.hpp"
+#include "radixsort.hpp"
 
 
 namespace nvh {
@@ -740,56 +748,165 @@ nvh::PrimitiveMesh wobblePrimitive(const nvh::PrimitiveMesh& mesh, float amplitu
 }
 
 // Takes a 3D mesh as input and returns a new mesh with duplicate vertices removed.
-// This function iterates through each triangle in the original PrimitiveMesh,
-// compares its vertices, and creates a new set of unique vertices in uniqueVertices.
-// We use an unordered_map called vertexIndexMap to keep track of the mapping between
-// the original vertices and their corresponding indices in the uniqueVertices vector.
-PrimitiveMesh removeDuplicateVertices(const PrimitiveMesh& mesh, bool testNormal, bool testUv)
+// Vertices are compared through a key made of the bits of the tested attributes, quantized when
+// epsilon > 0. Instead of a hash map, the vertices are sorted (radix sort) by a 32-bit hash of their
+// key, so equal vertices end up next to each other and each run of equal hashes is resolved by
+// comparing the keys. Hashing, grouping and remapping run in parallel; only the numbering of the
+// unique vertices walks the triangles in order, which keeps the order of the original algorithm:
+// vertices are numbered by their first use in the triangle list.
+PrimitiveMesh removeDuplicateVertices(const PrimitiveMesh&   mesh,
+                                      bool                   testNormal,
+                                      bool                   testUv,
+                                      float                  epsilon,
+                                      std::vector<uint32_t>* remap)
 {
-  auto hash = [&](const PrimitiveVertex& v) {
+  const uint32_t numVertices = static_cast<uint32_t>(mesh.vertices.size());
+  const float    invEpsilon  = epsilon > 0.0F ? 1.0F / epsilon : 0.0F;
+
+  // Bits of the tested attributes, unused entries stay 0
+  using VertexKey = std::array<uint32_t, 8>;
+  auto makeKey    = [&](const PrimitiveVertex& v) {
+    VertexKey key{};
+    uint32_t  count = 0;
+    auto      add   = [&](float f) {
+      // Quantized in double and clamped, casting an out of range value to int32_t is undefined
+      double q = std::floor(double(f) * double(invEpsilon) + 0.5);
+      if(invEpsilon > 0.0F && !std::isnan(q))
+        key[count++] = static_cast<uint32_t>(static_cast<int32_t>(std::clamp(q, double(INT32_MIN), double(INT32_MAX))));
+      else
+        key[count++] = glm::floatBitsToUint(f == 0.0F ? 0.0F : f);  // -0 and +0 are the same value
+    };
+    add(v.p.x);
+    add(v.p.y);
+    add(v.p.z);
     if(testNormal)
     {
-      if(testUv)
-        return nvh::hashVal(v.p.x, v.p.y, v.p.z, v.n.x, v.n.y, v.n.z, v.t.x, v.t.y);
-      else
-        return nvh::hashVal(v.p.x, v.p.y, v.p.z, v.n.x, v.n.y, v.n.z);
+      add(v.n.x);
+      add(v.n.y);
+      add(v.n.z);
     }
-    else if(testUv)
-      return nvh::hashVal(v.p.x, v.p.y, v.p.z, v.t.x, v.t.y);
-    return nvh::hashVal(v.p.x, v.p.y, v.p.z);
-  };
-  auto equal = [&](const PrimitiveVertex& l, const PrimitiveVertex& r) {
-    return (l.p == r.p) && (testNormal ? l.n == r.n : true) && (testUv ? l.t == r.t : true);
+    if(testUv)
+    {
+      add(v.t.x);
+      add(v.t.y);
+    }
+    return key;
   };
-  std::unordered_map<PrimitiveVertex, uint32_t, decltype(hash), decltype(equal)> vertexIndexMap(0, hash, equal);
 
-  std::vector<PrimitiveVertex>   uniqueVertices;
-  std::vector<PrimitiveTriangle> uniqueTriangles;
+  // Hash of each vertex key, sorted with the vertex indices
+  std::vector<uint32_t> hashes(numVertices);
+  std::vector<uint32_t> hashesTemp(numVertices);
+  std::vector<uint32_t> order(numVertices);
+  std::vector<uint32_t> orderTemp(numVertices);
+  nvh::parallel_batches(numVertices, [&](uint64_t i) {
+    VertexKey key  = makeKey(mesh.vertices[i]);
+    uint64_t  hash = 0;
+    for(uint32_t k : key)
+    {
+      hash = (hash ^ k) * 0x9e3779b97f4a7c15ULL;
+      hash ^= hash >> 29;
+    }
+    hashes[i] = static_cast<uint32_t>(hash ^ (hash >> 32));
+    order[i]  = static_cast<uint32_t>(i);
+  });
+  const uint32_t* sortedHashes =
+      nvh::radixsort_keyvalue(numVertices, hashes.data(), hashesTemp.data(), order.data(), orderTemp.data());
+  const uint32_t* sortedOrder = sortedHashes == hashes.data() ? order.data() : orderTemp.data();
+
+  // Within each run of equal hashes, a vertex refers to the first vertex with the same key.
+  // Ranges start and end on run boundaries so that each run is handled by a single thread.
+  std::vector<uint32_t> classOf(numVertices);
+  nvh::parallel_ranges<16384>(numVertices, [&](uint64_t begin, uint64_t end, uint32_t) {
+    while(begin > 0 && begin < end && sortedHashes[begin] == sortedHashes[begin - 1])
+      begin++;
+    if(begin == end)
+      return;  // No run starts in this range, the run crossing it belongs to an earlier range
+    while(end < numVertices && sortedHashes[end] == sortedHashes[end - 1])
+      end++;
+
+    // The vertices are read in hash order, which is random in memory: fetch them ahead of use
+    std::vector<VertexKey> runKeys;
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+    uint64_t prefetched = begin;
+#endif
+    for(uint64_t runBegin = begin; runBegin < end;)
+    {
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+      for(; prefetched < std::min<uint64_t>(runBegin + 64, end); prefetched++)
+        _mm_prefetch(reinterpret_cast<const char*>(&mesh.vertices[sortedOrder[prefetched]]), _MM_HINT_T0);
+#endif
+      uint64_t runEnd = runBegin + 1;
+      while(runEnd < numVertices && sortedHashes[runEnd] == sortedHashes[runBegin])
+        runEnd++;
+
+      if(runEnd - runBegin == 1)
+      {
+        classOf[sortedOrder[runBegin]] = sortedOrder[runBegin];
+      }
+      else
+      {
+        runKeys.clear();
+        for(uint64_t i = runBegin; i < runEnd; i++)
+        {
+          runKeys.push_back(makeKey(mesh.vertices[sortedOrder[i]]));
+          uint64_t first = runBegin;
+          while(runKeys[first - runBegin] != runKeys.back())
+            first++;
+          classOf[sortedOrder[i]] = first == i ? sortedOrder[i] : classOf[sortedOrder[first]];
+        }
+      }
+      runBegin = runEnd;
+    }
+  });
+
+#ifndef NDEBUG
+  // Each key must have a single representative within its run
+  for(uint32_t runBegin = 0; runBegin < numVertices;)
+  {
+    uint32_t runEnd = runBegin + 1;
+    while(runEnd < numVertices && sortedHashes[runEnd] == sortedHashes[runBegin])
+      runEnd++;
+    std::vector<VertexKey> representatives;
+    for(uint32_t i = runBegin; i < runEnd; i++)
+    {
+      if(classOf[sortedOrder[i]] != sortedOrder[i])
+        continue;
+      VertexKey key = makeKey(mesh.vertices[sortedOrder[i]]);
+      assert(std::find(representatives.begin(), representatives.end(), key) == representatives.end());
+      representatives.push_back(key);
+    }
+    runBegin = runEnd;
+  }
+#endif
 
+  // Number the unique vertices by first use, as the triangles reference them
+  std::vector<uint32_t>        newIndex(numVertices, ~0U);
+  std::vector<PrimitiveVertex> uniqueVertices;
   for(const auto& triangle : mesh.triangles)
   {
-    PrimitiveTriangle uniqueTriangle = {};
     for(int i = 0; i < 3; i++)
     {
-      const PrimitiveVertex& vertex = mesh.vertices[triangle.v[i]];
-
-      // Check if the vertex is already in the uniqueVertices list
-      auto it = vertexIndexMap.find(vertex);
-      if(it == vertexIndexMap.end())
-      {
-        // Vertex not found, add it to uniqueVertices and update the index map
-        uint32_t newIndex      = static_cast<uint32_t>(uniqueVertices.size());
-        vertexIndexMap[vertex] = newIndex;
-        uniqueVertices.push_back(vertex);
-        uniqueTriangle.v[i] = newIndex;
-      }
-      else
+      uint32_t& index = newIndex[classOf[triangle.v[i]]];
+      if(index == ~0U)
       {
-        // Vertex found, use its index in uniqueVertices
-        uniqueTriangle.v[i] = it->second;
+        index = static_cast<uint32_t>(uniqueVertices.size());
+        uniqueVertices.push_back(mesh.vertices[triangle.v[i]]);
       }
     }
-    uniqueTriangles.push_back(uniqueTriangle);
+  }
+
+  std::vector<PrimitiveTriangle> uniqueTriangles(mesh.triangles.size());
+  nvh::parallel_batches(mesh.triangles.size(), [&](uint64_t t) {
+    for(int i = 0; i < 3; i++)
+    {
+      uniqueTriangles[t].v[i] = newIndex[classOf[mesh.triangles[t].v[i]]];
+    }
+  });
+
+  if(remap)
+  {
+    remap->resize(numVertices);
+    nvh::parallel_batches(numVertices, [&](uint64_t i) { (*remap)[i] = newIndex[classOf[i]]; });
   }
 
   // nvprintf("Before: %d vertex, %d triangles\n", mesh.vertices.size(), mesh.triangles.size());
@@ -798,5 +915,4 @@ PrimitiveMesh removeDuplicateVertices(const PrimitiveMesh& mesh, bool testNormal
   return {std::move(uniqueVertices), std::move(uniqueTriangles)};
 }
 
-
 }  // namespace nvh
@@ -106,7 +106,14 @@ std::vector<Node> sunflower(int seeds = 3000);
 
 // Utilities
 PrimitiveMesh mergeNodes(const std::vector<Node>& nodes, const std::vector<PrimitiveMesh> meshes);
-PrimitiveMesh removeDuplicateVertices(const PrimitiveMesh& mesh, bool testNormal = true, bool testUv = true);
+// Welds the vertices that are equal in position, and optionally normal and uv, keeping only the vertices used by
+// triangles. With epsilon > 0, the compared attributes are snapped to a grid of that cell size and vertices falling
+// in the same cells are merged. `remap`, if provided, receives the new index of each input vertex (~0u if unused).
+PrimitiveMesh removeDuplicateVertices(const PrimitiveMesh&   mesh,
+                                      bool                   testNormal = true,
+                                      bool                   testUv     = true,
+                                      float                  epsilon    = 0.0F,
+                                      std::vector<uint32_t>* remap      = nullptr);
 PrimitiveMesh wobblePrimitive(const PrimitiveMesh& mesh, float amplitude = 0.05F);
 
 }  // namespace nvh
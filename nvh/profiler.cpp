@@ -19,11 +19,13 @@
 
 
 #include "profiler.hpp"
+#include "parallel_work.hpp"
 
 #include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <thread>
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -34,16 +36,25 @@ const uint32_t Profiler::CONFIG_DELAY;
 const uint32_t Profiler::FRAME_DELAY;
 const uint32_t Profiler::START_SECTIONS;
 const uint32_t Profiler::MAX_NUM_AVERAGE;
+const uint32_t Profiler::THREAD_RECORDS;
+const uint32_t Profiler::THREAD_LEVELS;
+
+static std::atomic<uint64_t> s_dataUid = 1;
 
 Profiler::Profiler(Profiler* master)
 {
   m_data = master ? master->m_data : std::shared_ptr<Data>(new Data);
+  if(!master)
+  {
+    m_data->uid = s_dataUid++;
+  }
   grow(START_SECTIONS);
 }
 
 Profiler::Profiler(uint32_t startSections)
 {
-  m_data = std::shared_ptr<Data>(new Data);
+  m_data      = std::shared_ptr<Data>(new Data);
+  m_data->uid = s_dataUid++;
   grow(startSections);
 }
 
@@ -58,6 +69,12 @@ void Profiler::setAveragingSize(uint32_t num)
     m_data->entries[i].gpuTime.init(num);
   }
   m_data->cpuTime.init(num);
+
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+  for(ThreadTimer& timer : m_data->threadTimers)
+  {
+    timer.cpuTime.init(num);
+  }
 }
 
 void Profiler::beginFrame()
@@ -75,6 +92,8 @@ void Profiler::endFrame()
 
   m_data->cpuCurrentTime += m_clock.getMicroSeconds();
 
+  mergeThreadSections();
+
   if(!m_data->frameSections.empty() && ((uint32_t)m_data->frameSections.size() != m_data->numLastEntries))
   {
     m_data->numLastEntries  = (uint32_t)m_data->frameSections.size();
@@ -97,6 +116,13 @@ void Profiler::endFrame()
     }
     m_data->cpuTime.reset();
     m_data->numFrames = 0;
+
+    std::lock_guard<std::mutex> lock(m_data->threadMutex);
+    for(ThreadTimer& timer : m_data->threadTimers)
+    {
+      timer.numTimes = 0;
+      timer.cpuTime.reset();
+    }
   }
 
   if(m_data->numFrames > FRAME_DELAY)
@@ -165,6 +191,10 @@ void Profiler::clear()
 {
   m_data->entries.clear();
   m_data->singleSections.clear();
+
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+  m_data->threadTimers.clear();
+  m_data->threadTimerIndices.clear();
 }
 
 void Profiler::reset(uint32_t delay)
@@ -270,10 +300,25 @@ bool Profiler::getTimerInfo(const char* name, TimerInfo& info)
     return getTimerInfo(i, info);
   }
 
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+  for(ThreadTimer& timer : m_data->threadTimers)
+  {
+    if(!timer.numTimes || m_data->threadNames[timer.name] != name)
+      continue;
+
+    info                 = TimerInfo();
+    info.cpu.average     = timer.cpuTime.getAveraged();
+    info.cpu.absMinValue = timer.cpuTime.absMinValue;
+    info.cpu.absMaxValue = timer.cpuTime.absMaxValue;
+    info.accumulated     = timer.accumulated;
+    info.numAveraged     = timer.cpuTime.numValid;
+    return true;
+  }
+
   return false;
 }
 
-void Profiler::print(std::string& stats)
+void Profiler::print(std::string& stats, bool parallelStats)
 {
   stats.clear();
 
@@ -313,6 +358,31 @@ void Profiler::print(std::string& stats)
                       (uint32_t)(info.gpu.average), (uint32_t)(info.cpu.average), (uint32_t)entry.cpuTime.numValid);
     }
   }
+
+  {
+    std::lock_guard<std::mutex> lock(m_data->threadMutex);
+    for(ThreadTimer& timer : m_data->threadTimers)
+    {
+      static const char* spaces = "        ";  // 8
+      if(!timer.numTimes)
+        continue;
+
+      uint32_t level = 7 - (timer.level > 7 ? 7 : timer.level);
+      stats += format("%sTimer %s;\t N/A %6d; CPU %6d; (microseconds, threads%s, avg %d)\n", &spaces[level],
+                      m_data->threadNames[timer.name].c_str(), 0, (uint32_t)timer.cpuTime.getAveraged(),
+                      timer.accumulated ? " accumulated" : "", (uint32_t)timer.cpuTime.numValid);
+    }
+    uint32_t dropped = m_data->threadDropped.load();
+    if(dropped)
+    {
+      stats += format("Thread sections dropped: %d (increase Profiler::THREAD_RECORDS)\n", dropped);
+    }
+  }
+
+  if(parallelStats)
+  {
+    parallel_stats_print(stats);
+  }
 }
 
 uint32_t Profiler::getTotalFrames() const
@@ -377,12 +447,15 @@ Profiler::SectionID Profiler::beginSection(const char* name, const char* api, gp
   Entry&   entry = m_data->entries[sec];
   uint32_t level = singleShot ? LEVEL_SINGLESHOT : (m_data->level++);
 
-  const std::string name_str = (name ? name : "");
-  const std::string api_str  = (api ? api : "");
-  if(entry.name != name_str || entry.api != api_str || entry.level != level)
+  // compare in place, the strings are only assigned (allocated) when the configuration changes
+  if(!name)
+    name = "";
+  if(!api)
+    api = "";
+  if(entry.name.compare(name) != 0 || entry.api.compare(api) != 0 || entry.level != level)
   {
-    entry.name = name_str;
-    entry.api  = api_str;
+    entry.name = name;
+    entry.api  = api;
 
     if(!singleShot)
     {
@@ -446,6 +519,174 @@ void Profiler::endSection(SectionID sec)
   }
 }
 
+Profiler::NameID Profiler::internName(const char* name)
+{
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+
+  auto [it, inserted] = m_data->threadNameIDs.try_emplace(name ? name : "", (NameID)m_data->threadNames.size());
+  if(inserted)
+  {
+    m_data->threadNames.push_back(it->first);
+  }
+  return it->second;
+}
+
+Profiler::ThreadBuffer& Profiler::getThreadBuffer()
+{
+  // hands the buffers of this thread back to their profiler database when the thread exits,
+  // the records still in flight are merged by the next endFrame and the buffer is reused
+  // by the next new thread
+  struct ThreadRelease
+  {
+    std::vector<std::pair<std::weak_ptr<Data>, ThreadBuffer*>> buffers;
+
+    ~ThreadRelease()
+    {
+      for(auto& [weakData, buffer] : buffers)
+      {
+        if(std::shared_ptr<Data> data = weakData.lock())
+        {
+          std::lock_guard<std::mutex> lock(data->threadMutex);
+          buffer->threadID = std::thread::id();
+        }
+      }
+    }
+  };
+
+  // the buffer of the last profiler database used by this thread, the uid protects from
+  // a database that was destroyed in the meantime
+  thread_local uint64_t      t_uid    = 0;
+  thread_local ThreadBuffer* t_buffer = nullptr;
+  thread_local ThreadRelease t_release;
+
+  if(t_uid != m_data->uid)
+  {
+    std::lock_guard<std::mutex> lock(m_data->threadMutex);
+
+    std::thread::id threadID = std::this_thread::get_id();
+    ThreadBuffer*   released = nullptr;
+    t_buffer                 = nullptr;
+    for(std::unique_ptr<ThreadBuffer>& buffer : m_data->threadBuffers)
+    {
+      if(buffer->threadID == threadID)
+      {
+        t_buffer = buffer.get();
+        break;
+      }
+      if(!released && buffer->threadID == std::thread::id())
+      {
+        released = buffer.get();
+      }
+    }
+    if(!t_buffer)
+    {
+      if(released)
+      {
+        t_buffer        = released;
+        t_buffer->level = 0;  // sections left open by the exited thread
+      }
+      else
+      {
+        m_data->threadBuffers.push_back(std::make_unique<ThreadBuffer>());
+        t_buffer = m_data->threadBuffers.back().get();
+      }
+      t_buffer->threadID = threadID;
+
+      auto& buffers = t_release.buffers;
+      buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](const auto& it) { return it.first.expired(); }),
+                    buffers.end());
+      buffers.emplace_back(m_data, t_buffer);
+    }
+    t_uid = m_data->uid;
+  }
+  return *t_buffer;
+}
+
+void Profiler::beginThreadSection(NameID name)
+{
+  ThreadBuffer& buffer = getThreadBuffer();
+  assert(buffer.level < THREAD_LEVELS && "thread sections nested too deep");
+
+  buffer.stackNames[buffer.level] = name;
+  buffer.stackTimes[buffer.level] = getMicroSeconds();
+  buffer.level++;
+}
+
+void Profiler::endThreadSection()
+{
+  double        endTime = getMicroSeconds();
+  ThreadBuffer& buffer  = getThreadBuffer();
+  assert(buffer.level > 0 && "endThreadSection without beginThreadSection");
+
+  buffer.level--;
+
+  uint32_t write = buffer.writeIndex.load(std::memory_order_relaxed);
+  if(write - buffer.readIndex.load(std::memory_order_acquire) >= THREAD_RECORDS)
+  {
+    m_data->threadDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  ThreadRecord& record = buffer.records[write % THREAD_RECORDS];
+  record.name          = buffer.stackNames[buffer.level];
+  record.level         = buffer.level;
+  record.beginTime     = buffer.stackTimes[buffer.level];
+  record.cpuTime       = endTime - record.beginTime;
+  buffer.writeIndex.store(write + 1, std::memory_order_release);
+}
+
+void Profiler::mergeThreadSections()
+{
+  std::lock_guard<std::mutex> lock(m_data->threadMutex);
+
+  // sections are recorded when they end, sort by begin time so that the timers are created
+  // in the order the sections started, parents before their children
+  std::vector<ThreadRecord>& merge = m_data->threadMerge;
+  merge.clear();
+  for(std::unique_ptr<ThreadBuffer>& buffer : m_data->threadBuffers)
+  {
+    uint32_t read  = buffer->readIndex.load(std::memory_order_relaxed);
+    uint32_t write = buffer->writeIndex.load(std::memory_order_acquire);
+    for(; read != write; read++)
+    {
+      merge.push_back(buffer->records[read % THREAD_RECORDS]);
+    }
+    buffer->readIndex.store(read, std::memory_order_release);
+  }
+  std::sort(merge.begin(), merge.end(),
+            [](const ThreadRecord& a, const ThreadRecord& b) { return a.beginTime < b.beginTime; });
+
+  for(const ThreadRecord& record : merge)
+  {
+    uint64_t key        = (uint64_t(record.level) << 32) | record.name;
+    auto [it, inserted] = m_data->threadTimerIndices.try_emplace(key, (uint32_t)m_data->threadTimers.size());
+    if(inserted)
+    {
+      ThreadTimer timer;
+      timer.name  = record.name;
+      timer.level = record.level;
+      timer.cpuTime.init(m_data->numAveraging);
+      m_data->threadTimers.push_back(timer);
+    }
+
+    ThreadTimer& timer = m_data->threadTimers[it->second];
+    timer.frameTime += record.cpuTime;
+    timer.frameCount++;
+  }
+
+  for(ThreadTimer& timer : m_data->threadTimers)
+  {
+    if(timer.frameCount)
+    {
+      timer.cpuTime.add(timer.frameTime);
+      timer.accumulated = timer.frameCount > 1;
+      timer.numTimes++;
+      timer.frameTime  = 0;
+      timer.frameCount = 0;
+    }
+  }
+}
+
 Profiler::Clock::Clock()
 {
   m_init = std::chrono::high_resolution_clock::now();
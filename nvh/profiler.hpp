@@ -23,14 +23,18 @@
 
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <float.h>  // DBL_MAX
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>  //memset
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #ifdef NVP_SUPPORTS_NVTOOLSEXT
@@ -56,6 +60,29 @@ namespace nvh {
     derived classes reference it to share the same database.
 
     Profiler::Clock can be used standalone for time measuring.
+
+    The regular sections (beginSection/endSection, timeRecurring, timeSingle)
+    must be used from the thread calling beginFrame/endFrame. Worker threads
+    (loaders, parallel command recording...) use the thread sections instead,
+    which measure cpu time only:
+
+    ```cpp
+    // once, interning the name is thread-safe but takes a lock
+    static const nvh::Profiler::NameID s_loadID = profiler.internName("load");
+
+    // on any thread, without locks or heap allocations
+    {
+      auto section = profiler.timeThread(s_loadID);
+      ...
+    }
+    ```
+
+    Each thread records into its own stack and a fixed-size ring buffer
+    (registered on its first section). endFrame merges the buffers: times
+    with the same name and nesting level are summed over all threads and
+    sections of the frame, and are then averaged like the other timers.
+    getTimerInfo and print report them after the regular sections.
+    Sections completed while a ring buffer is full are dropped.
 @DOC_END  */
 
 class Profiler
@@ -69,10 +96,15 @@ public:
   static const uint32_t START_SECTIONS = 64;
   /// cyclic window for averaging
   static const uint32_t MAX_NUM_AVERAGE = 128;
+  /// completed thread sections each thread can hold until the next endFrame
+  static const uint32_t THREAD_RECORDS = 4096;
+  /// maximum nesting of thread sections
+  static const uint32_t THREAD_LEVELS = 32;
 
 public:
   typedef uint32_t SectionID;
   typedef uint32_t OnceID;
+  typedef uint32_t NameID;
 
   class Clock
   {
@@ -110,6 +142,24 @@ public:
   // single shot, results are available after FRAME_DELAY many endFrame
   Section timeSingle(const char* name) { return Section(*this, name, true); }
 
+  // utility class for automatic calling of beginThreadSection/endThreadSection within a local scope
+  class ThreadSection
+  {
+  public:
+    ThreadSection(Profiler& profiler, NameID name)
+        : m_profiler(profiler)
+    {
+      profiler.beginThreadSection(name);
+    }
+    ~ThreadSection() { m_profiler.endThreadSection(); }
+
+  private:
+    Profiler& m_profiler;
+  };
+
+  // cpu section on any thread, see the documentation above
+  ThreadSection timeThread(NameID name) { return ThreadSection(*this, name); }
+
   //////////////////////////////////////////////////////////////////////////
 
   // num <= MAX_NUM_AVERAGE
@@ -141,6 +191,15 @@ public:
   // pass.
   void accumulationSplit();
 
+  // thread sections, may be called from any thread.
+  // internName returns the same id for the same name, it locks and may allocate,
+  // so the ids should be kept rather than interned every time.
+  // begin/end do not lock nor allocate, except when a thread records its first section.
+  // The per-thread buffer is handed back when the thread exits and reused by the next new thread.
+  NameID internName(const char* name);
+  void   beginThreadSection(NameID name);
+  void   endThreadSection();
+
 
   inline double getMicroSeconds() const { return m_clock.getMicroSeconds(); }
 
@@ -156,8 +215,9 @@ public:
   // previous frame.
   void reset(uint32_t delay = CONFIG_DELAY);
 
-  // pretty print current averaged timers
-  void print(std::string& stats);
+  // pretty print current averaged timers,
+  // parallelStats appends the statistics of nvh::parallel_batches_adaptive (see parallel_work.hpp)
+  void print(std::string& stats, bool parallelStats = false);
 
   // returns number of frames since reset
   uint32_t getTotalFrames() const;
@@ -334,6 +394,41 @@ protected:
     bool accumulated = false;
   };
 
+  // completed thread section
+  struct ThreadRecord
+  {
+    NameID   name;
+    uint32_t level;
+    double   beginTime;
+    double   cpuTime;
+  };
+
+  // per-thread recording, single producer (the thread) single consumer (endFrame)
+  struct ThreadBuffer
+  {
+    ThreadRecord          records[THREAD_RECORDS];
+    std::atomic<uint32_t> writeIndex = 0;
+    std::atomic<uint32_t> readIndex  = 0;
+    std::thread::id       threadID;
+
+    // open sections, only accessed by the thread
+    uint32_t level = 0;
+    NameID   stackNames[THREAD_LEVELS];
+    double   stackTimes[THREAD_LEVELS];
+  };
+
+  // merged thread sections with the same name and level
+  struct ThreadTimer
+  {
+    NameID     name        = 0;
+    uint32_t   level       = 0;
+    uint32_t   numTimes    = 0;
+    uint32_t   frameCount  = 0;  // sections merged in the current frame
+    double     frameTime   = 0;
+    bool       accumulated = false;
+    TimeValues cpuTime;
+  };
+
   struct Data
   {
     uint32_t numAveraging = MAX_NUM_AVERAGE;
@@ -353,6 +448,17 @@ protected:
     TimeValues cpuTime;
 
     std::vector<Entry> entries;
+
+    // thread sections, the mutex protects everything below
+    std::mutex                                 threadMutex;
+    uint64_t                                   uid = 0;  // identifies the data for the per-thread lookup
+    std::vector<std::string>                   threadNames;
+    std::unordered_map<std::string, NameID>    threadNameIDs;
+    std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+    std::vector<ThreadTimer>                   threadTimers;
+    std::unordered_map<uint64_t, uint32_t>     threadTimerIndices;  // key: level << 32 | name
+    std::vector<ThreadRecord>                  threadMerge;         // scratch space of mergeThreadSections
+    std::atomic<uint32_t>                      threadDropped = 0;
   };
 
 
@@ -363,6 +469,9 @@ protected:
 
   bool getTimerInfo(uint32_t i, TimerInfo& info);
   void grow(uint32_t newsize);
+
+  ThreadBuffer& getThreadBuffer();
+  void          mergeThreadSections();
 };
 }  // namespace nvh
 
@@ -21,6 +21,13 @@
 #ifndef NV_RADIXSORT_INCLUDED
 #define NV_RADIXSORT_INCLUDED
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "parallel_work.hpp"
+
 namespace nvh {
 
 /** @DOC_START
@@ -103,6 +110,181 @@ uint32_t* radixsort(uint32_t numIndices, const TKey* keys, uint32_t* indicesIn,
   return tempIn;
 }
 
+/** @DOC_START
+      # function nvh::radixsort_keyvalue
+
+      Sorts 32-bit keys directly, moving optional values along with them
+      (stable LSD radix sort). Unlike `radixsort` there is no indirection through
+      `keys[idx]`, so the passes stream through memory instead of gathering.
+
+      The keys are sorted by digits of DIGITBITS bits, the default of 11 bits
+      needs 3 passes. Passes where all keys have the same digit are skipped.
+      Large arrays are split in blocks, one per thread of `nvh::get_thread_pool()`.
+      Each block builds its own histogram, and the blocks scatter their keys in
+      parallel to the offsets given by the prefix sum over all the histograms.
+      Runs single-threaded if numThreads == 1, for small arrays or if called
+      from a thread of the pool.
+
+      ```cpp
+      // draw keys and the draw each belongs to
+      uint32_t* sortedKeys = radixsort_keyvalue(numDraws, keys, keysTemp, drawIDs, drawIDsTemp);
+
+      // result can point either to keys or keysTemp (the arrays are swapped
+      // after each pass), the values are in the matching array
+      uint32_t* sortedDraws = sortedKeys == keys ? drawIDs : drawIDsTemp;
+      ```
+
+      To only sort the keys, use the overload without values:
+
+      ```cpp
+      uint32_t* sortedKeys = radixsort_keyvalue(numKeys, keys, keysTemp);
+      ```
+@DOC_END    */
+
+template <uint32_t DIGITBITS = 11, typename TValue>
+uint32_t* radixsort_keyvalue(uint32_t  numItems,
+                             uint32_t* keysIn,
+                             uint32_t* keysTemp,
+                             TValue*   valuesIn,
+                             TValue*   valuesTemp,
+                             uint32_t  numThreads = 0)
+{
+  static_assert(DIGITBITS >= 1 && DIGITBITS <= 16, "DIGITBITS must be in [1,16]");
+  constexpr uint32_t NUM_BINS   = 1u << DIGITBITS;
+  constexpr uint32_t NUM_PASSES = (32 + DIGITBITS - 1) / DIGITBITS;
+  constexpr uint32_t MASK       = NUM_BINS - 1;
+  // below that many keys per thread, the histograms cost more than the threads save
+  constexpr uint32_t MIN_BLOCK_SIZE = 1u << 16;
+
+  const bool hasValues = valuesIn != nullptr && valuesTemp != nullptr;
+
+  uint32_t numBlocks = 1;
+  if(numThreads != 1 && numItems >= 2 * MIN_BLOCK_SIZE && !BS::this_thread::get_index().has_value())
+  {
+    numBlocks = std::min(static_cast<uint32_t>(get_thread_pool().get_thread_count()), numItems / MIN_BLOCK_SIZE);
+    numBlocks = std::max(numThreads ? std::min(numBlocks, numThreads) : numBlocks, 1u);
+  }
+  const uint32_t blockSize = (numItems + numBlocks - 1) / numBlocks;
+
+  auto forEachBlock = [&](auto&& fn) {
+    if(numBlocks == 1)
+    {
+      fn(0u);
+    }
+    else
+    {
+      get_thread_pool().submit_sequence<uint32_t>(0, numBlocks, fn).wait();
+    }
+  };
+
+  // histograms[(block * NUM_PASSES + pass) * NUM_BINS + bin]
+  std::vector<uint32_t> histograms(size_t(numBlocks) * NUM_PASSES * NUM_BINS, 0);
+
+  // The histograms of all passes at once; the counts summed over the blocks don't depend on the order
+  // of the keys, which tells which passes can be skipped
+  forEachBlock([&](uint32_t block) {
+    uint32_t*      hist  = &histograms[size_t(block) * NUM_PASSES * NUM_BINS];
+    const uint32_t begin = std::min(numItems, block * blockSize);
+    const uint32_t end   = std::min(numItems, begin + blockSize);
+    for(uint32_t i = begin; i < end; i++)
+    {
+      const uint32_t key = keysIn[i];
+      for(uint32_t p = 0; p < NUM_PASSES; p++)
+      {
+        hist[p * NUM_BINS + ((key >> (p * DIGITBITS)) & MASK)]++;
+      }
+    }
+  });
+
+  // The block histograms match the current order of the keys until the first pass moved them
+  bool histogramsValid = true;
+
+  for(uint32_t p = 0; p < NUM_PASSES; p++)
+  {
+    const uint32_t shift = p * DIGITBITS;
+
+    bool trivialPass = false;
+    for(uint32_t bin = 0; bin < NUM_BINS && !trivialPass; bin++)
+    {
+      uint32_t count = 0;
+      for(uint32_t block = 0; block < numBlocks; block++)
+      {
+        count += histograms[(size_t(block) * NUM_PASSES + p) * NUM_BINS + bin];
+      }
+      trivialPass = count == numItems;
+    }
+    if(trivialPass)
+    {
+      continue;
+    }
+
+    if(!histogramsValid)
+    {
+      forEachBlock([&](uint32_t block) {
+        uint32_t*      hist  = &histograms[(size_t(block) * NUM_PASSES + p) * NUM_BINS];
+        const uint32_t begin = std::min(numItems, block * blockSize);
+        const uint32_t end   = std::min(numItems, begin + blockSize);
+        std::fill(hist, hist + NUM_BINS, 0u);
+        for(uint32_t i = begin; i < end; i++)
+        {
+          hist[(keysIn[i] >> shift) & MASK]++;
+        }
+      });
+    }
+    histogramsValid = false;
+
+    // Exclusive prefix sum in (bin, block) order keeps the sort stable
+    uint32_t offset = 0;
+    for(uint32_t bin = 0; bin < NUM_BINS; bin++)
+    {
+      for(uint32_t block = 0; block < numBlocks; block++)
+      {
+        uint32_t& hist = histograms[(size_t(block) * NUM_PASSES + p) * NUM_BINS + bin];
+        uint32_t  num  = hist;
+        hist           = offset;
+        offset += num;
+      }
+    }
+    assert(offset == numItems);
+
+    forEachBlock([&](uint32_t block) {
+      uint32_t*      hist  = &histograms[(size_t(block) * NUM_PASSES + p) * NUM_BINS];
+      const uint32_t begin = std::min(numItems, block * blockSize);
+      const uint32_t end   = std::min(numItems, begin + blockSize);
+      if(hasValues)
+      {
+        for(uint32_t i = begin; i < end; i++)
+        {
+          const uint32_t key = keysIn[i];
+          const uint32_t pos = hist[(key >> shift) & MASK]++;
+          keysTemp[pos]      = key;
+          valuesTemp[pos]    = valuesIn[i];
+        }
+      }
+      else
+      {
+        for(uint32_t i = begin; i < end; i++)
+        {
+          const uint32_t key = keysIn[i];
+          keysTemp[hist[(key >> shift) & MASK]++] = key;
+        }
+      }
+    });
+
+    std::swap(keysIn, keysTemp);
+    std::swap(valuesIn, valuesTemp);
+  }
+
+  return keysIn;
+}
+
+// keys only
+template <uint32_t DIGITBITS = 11>
+uint32_t* radixsort_keyvalue(uint32_t numItems, uint32_t* keysIn, uint32_t* keysTemp, uint32_t numThreads = 0)
+{
+  return radixsort_keyvalue<DIGITBITS, uint32_t>(numItems, keysIn, keysTemp, nullptr, nullptr, numThreads);
+}
+
 }  // namespace nvh
 
 #endif
@@ -27,11 +27,13 @@
 #include "shaderfilemanager.hpp"
 #include <algorithm>
 #include <assert.h>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string_view>
 
 #include "fileoperations.hpp"
 
@@ -82,70 +84,208 @@ inline std::string ShaderFileManager::markerString(int line, std::string const&
   }
 }
 
-std::string ShaderFileManager::getIncludeContent(IncludeID idx, std::string& filename)
+struct ShaderFileManager::ParsedFile
 {
-  IncludeEntry& entry = m_includes[idx];
+  enum DirectiveType
+  {
+    DIRECTIVE_VERSION,
+    DIRECTIVE_INCLUDE,
+  };
 
-  filename = entry.filename;
+  struct Directive
+  {
+    DirectiveType type;
+    bool          commented;   // a "//" precedes the directive, the line is dropped
+    int           lineNumber;  // 1-based
+    size_t        lineBegin;
+    size_t        lineEnd;  // excluding '\n'
+    std::string   include;  // between the quotes of an #include
+  };
+
+  std::string            content;
+  std::vector<Directive> directives;
+  int64_t                fileTime = 0;
+  uint64_t               fileSize = 0;
+
+  // Lines are split like std::getline, and the directives are detected with the same
+  // rules as the previous line-by-line processing, so the expanded text is unchanged.
+  void parse()
+  {
+    directives.clear();
 
-  if(m_forceIncludeContent)
+    int    lineNumber = 0;
+    size_t lineBegin  = 0;
+    while(lineBegin < content.size())
+    {
+      size_t lineEnd = content.find('\n', lineBegin);
+      if(lineEnd == std::string::npos)
+      {
+        lineEnd = content.size();
+      }
+      lineNumber++;
+
+      std::string_view line(content.data() + lineBegin, lineEnd - lineBegin);
+      if(line.find('#') != std::string_view::npos)
+      {
+        DirectiveType type   = DIRECTIVE_VERSION;
+        size_t        offset = line.find("#version");
+        if(offset == std::string_view::npos)
+        {
+          type   = DIRECTIVE_INCLUDE;
+          offset = line.find("#include");
+        }
+
+        if(offset != std::string_view::npos)
+        {
+          size_t commentOffset = line.find("//");
+
+          Directive directive;
+          directive.type       = type;
+          directive.commented  = commentOffset != std::string_view::npos && commentOffset < offset;
+          directive.lineNumber = lineNumber;
+          directive.lineBegin  = lineBegin;
+          directive.lineEnd    = lineEnd;
+          if(type == DIRECTIVE_INCLUDE)
+          {
+            size_t firstQuote  = line.find('"', offset);
+            size_t secondQuote = line.find('"', firstQuote + 1);
+            directive.include  = std::string(line.substr(firstQuote + 1, secondQuote - firstQuote - 1));
+          }
+          directives.push_back(std::move(directive));
+        }
+      }
+
+      lineBegin = lineEnd + 1;
+    }
+  }
+
+  // in-memory content, not cached
+  static ParsedFilePtr fromText(std::string const& text)
   {
-    return entry.content;
+    auto file     = std::make_shared<ParsedFile>();
+    file->content = text;
+    file->parse();
+    return file;
   }
+};
 
-  if(!entry.content.empty() && !findFile(entry.filename, m_directories).empty())
+ShaderFileManager::ParsedFilePtr ShaderFileManager::loadParsedFile(std::string const& filenameFound)
+{
+  namespace fs = std::filesystem;
+
+  std::error_code ec;
+  int64_t         fileTime = fs::last_write_time(filenameFound, ec).time_since_epoch().count();
+  uint64_t        fileSize = ec ? 0 : fs::file_size(filenameFound, ec);
+  bool            cacheable = !ec;
+
+  if(cacheable)
   {
-    return entry.content;
+    std::lock_guard<std::mutex> lock(m_fileCacheMutex);
+    auto                        it = m_fileCache.find(filenameFound);
+    if(it != m_fileCache.end() && it->second->fileTime == fileTime && it->second->fileSize == fileSize)
+    {
+      return it->second;
+    }
   }
 
-  std::string content = loadFile(entry.filename, false, m_directories, filename, true);
-  return content.empty() ? entry.content : content;
+  auto file      = std::make_shared<ParsedFile>();
+  file->content  = loadFile(filenameFound, false);
+  file->fileTime = fileTime;
+  file->fileSize = fileSize;
+  file->parse();
+
+  if(cacheable)
+  {
+    std::lock_guard<std::mutex> lock(m_fileCacheMutex);
+    m_fileCache[filenameFound] = file;
+  }
+  return file;
 }
 
-std::string ShaderFileManager::getContent(std::string const& filename, std::string& filenameFound)
+void ShaderFileManager::clearFileCache()
 {
-  if(filename.empty())
+  std::lock_guard<std::mutex> lock(m_fileCacheMutex);
+  m_fileCache.clear();
+}
+
+ShaderFileManager::ParsedFilePtr ShaderFileManager::getParsedIncludeContent(IncludeID idx, std::string& filename)
+{
+  IncludeEntry& entry = m_includes[idx];
+
+  filename = entry.filename;
+
+  if(m_forceIncludeContent)
   {
-    return std::string();
+    return ParsedFile::fromText(entry.content);
   }
 
-  IncludeID idx = findInclude(filename);
-
-  if(idx.isValid())
+  if(!entry.content.empty() && !findFile(entry.filename, m_directories).empty())
   {
-    return getIncludeContent(idx, filenameFound);
+    return ParsedFile::fromText(entry.content);
   }
 
-  // fall back
-  filenameFound = filename;
-  return loadFile(filename, false, m_directories, filenameFound, true);
+  filename           = findFile(entry.filename, m_directories, true);
+  ParsedFilePtr file = filename.empty() ? nullptr : loadParsedFile(filename);
+  return (!file || file->content.empty()) ? ParsedFile::fromText(entry.content) : file;
 }
 
-std::string ShaderFileManager::getContentWithRequestingSourceDirectory(std::string const& filename,
-                                                                       std::string&       filenameFound,
-                                                                       std::string const& requestingSource)
+ShaderFileManager::ParsedFilePtr ShaderFileManager::getParsedContent(std::string const& filename,
+                                                                     std::string&       filenameFound,
+                                                                     std::string const* requestingSource)
 {
   if(filename.empty())
   {
-    return std::string();
+    return nullptr;
   }
 
   IncludeID idx = findInclude(filename);
 
   if(idx.isValid())
   {
-    return getIncludeContent(idx, filenameFound);
+    return getParsedIncludeContent(idx, filenameFound);
   }
 
-  // fall back; check requestingSource's directory first.
-  filenameFound = filename;
-  m_extendedDirectories.resize(m_directories.size() + 1);
-  m_extendedDirectories[0] = getDirectoryComponent(requestingSource);
-  for(size_t i = 0; i < m_directories.size(); ++i)
+  // fall back
+  if(requestingSource)
+  {
+    // check requestingSource's directory first.
+    // Per-thread temporary storage, saves on dynamic allocation.
+    thread_local std::vector<std::string> extendedDirectories;
+
+    extendedDirectories.resize(m_directories.size() + 1);
+    extendedDirectories[0] = getDirectoryComponent(*requestingSource);
+    for(size_t i = 0; i < m_directories.size(); ++i)
+    {
+      extendedDirectories[i + 1] = m_directories[i];
+    }
+    filenameFound = findFile(filename, extendedDirectories, true);
+  }
+  else
   {
-    m_extendedDirectories[i + 1] = m_directories[i];
+    filenameFound = findFile(filename, m_directories, true);
   }
-  return loadFile(filename, false, m_extendedDirectories, filenameFound, true);
+
+  return filenameFound.empty() ? nullptr : loadParsedFile(filenameFound);
+}
+
+std::string ShaderFileManager::getIncludeContent(IncludeID idx, std::string& filenameFound)
+{
+  ParsedFilePtr file = getParsedIncludeContent(idx, filenameFound);
+  return file ? file->content : std::string();
+}
+
+std::string ShaderFileManager::getContent(std::string const& filename, std::string& filenameFound)
+{
+  ParsedFilePtr file = getParsedContent(filename, filenameFound, nullptr);
+  return file ? file->content : std::string();
+}
+
+std::string ShaderFileManager::getContentWithRequestingSourceDirectory(std::string const& filename,
+                                                                       std::string&       filenameFound,
+                                                                       std::string const& requestingSource)
+{
+  ParsedFilePtr file = getParsedContent(filename, filenameFound, &requestingSource);
+  return file ? file->content : std::string();
 }
 
 std::string ShaderFileManager::getDirectoryComponent(std::string filename)
@@ -170,25 +310,58 @@ exitLoop:
   return filename;
 }
 
-std::string ShaderFileManager::manualInclude(std::string const& filename, std::string& filenameFound, std::string const& prepend, bool foundVersion)
+std::string ShaderFileManager::manualInclude(std::string const&        filename,
+                                             std::string&              filenameFound,
+                                             std::string const&        prepend,
+                                             bool                      foundVersion,
+                                             std::vector<std::string>* includedFiles)
 {
-  std::string source = getContent(filename, filenameFound);
-  return manualIncludeText(source, filenameFound, prepend, foundVersion);
+  ParsedFilePtr file = getParsedContent(filename, filenameFound, nullptr);
+  if(!file || file->content.empty())
+  {
+    return std::string();
+  }
+  if(includedFiles)
+  {
+    includedFiles->push_back(filenameFound);
+  }
+
+  std::string text;
+  text.reserve(prepend.size() + file->content.size() * 2);
+  expandParsedContent(*file, filenameFound, prepend, foundVersion, includedFiles, text);
+  return text;
 }
 
-std::string ShaderFileManager::manualIncludeText(std::string const& sourceText,
-                                                 std::string const& textFilename,
-                                                 std::string const& prepend,
-                                                 bool               foundVersion)
+std::string ShaderFileManager::manualIncludeText(std::string const&        sourceText,
+                                                 std::string const&        textFilename,
+                                                 std::string const&        prepend,
+                                                 bool                      foundVersion,
+                                                 std::vector<std::string>* includedFiles)
 {
   if(sourceText.empty())
   {
     return std::string();
   }
 
-  std::stringstream stream;
-  stream << sourceText;
-  std::string line, text;
+  ParsedFile file;
+  file.content = sourceText;
+  file.parse();
+
+  std::string text;
+  text.reserve(prepend.size() + sourceText.size() * 2);
+  expandParsedContent(file, textFilename, prepend, foundVersion, includedFiles, text);
+  return text;
+}
+
+void ShaderFileManager::expandParsedContent(ParsedFile const&         file,
+                                            std::string const&        textFilename,
+                                            std::string const&        prepend,
+                                            bool                      foundVersion,
+                                            std::vector<std::string>* includedFiles,
+                                            std::string&              text)
+{
+  const std::string& content   = file.content;
+  const size_t       textBegin = text.size();  // where this file's text starts
 
   // Handle command line defines
   text += prepend;
@@ -197,69 +370,66 @@ std::string ShaderFileManager::manualIncludeText(std::string const& sourceText,
     text += markerString(1, textFilename, 0);
   }
 
-  int lineCount = 0;
-  while(std::getline(stream, line))
+  // Lines between directives are copied in one go
+  size_t copyBegin = 0;
+  for(const ParsedFile::Directive& directive : file.directives)
   {
-    std::size_t offset = 0;
-    lineCount++;
+    bool isInclude = directive.type == ParsedFile::DIRECTIVE_INCLUDE;
 
-    // Version
-    offset = line.find("#version");
-    if(offset != std::string::npos)
-    {
-      std::size_t commentOffset = line.find("//");
-      if(commentOffset != std::string::npos && commentOffset < offset)
-        continue;
+    // Handle replacing #include with text if configured to do so.
+    // Otherwise just insert the #include command verbatim, for shaderc to handle.
+    if(isInclude && !m_handleIncludePasting)
+      continue;
 
-      if(foundVersion)
-      {
-        // someone else already set the version, so just comment out
-        text += std::string("//") + line + std::string("\n");
-      }
-      else
+    text.append(content, copyBegin, directive.lineBegin - copyBegin);
+    copyBegin = std::min(directive.lineEnd + 1, content.size());
+
+    if(directive.commented)
+      continue;
+
+    std::string_view line(content.data() + directive.lineBegin, directive.lineEnd - directive.lineBegin);
+    if(!isInclude)
+    {
+      if(!foundVersion)
       {
         // Reorder so that the #version line is always the first of a shader text
-        text         = line + std::string("\n") + text + std::string("//") + line + std::string("\n");
+        text.insert(textBegin, std::string(line) + "\n");
         foundVersion = true;
       }
-      continue;
+      // the version is already set, so just comment out
+      text += "//";
+      text += line;
+      text += '\n';
     }
-
-    // Handle replacing #include with text if configured to do so.
-    // Otherwise just insert the #include command verbatim, for shaderc to handle.
-    if(m_handleIncludePasting)
+    else
     {
-      offset = line.find("#include");
-      if(offset != std::string::npos)
+      std::string   includeFound;
+      ParsedFilePtr includeFile = getParsedContent(directive.include, includeFound, nullptr);
+      if(includeFile && !includeFile->content.empty())
       {
-        std::size_t commentOffset = line.find("//");
-        if(commentOffset != std::string::npos && commentOffset < offset)
-          continue;
-
-        size_t firstQuote  = line.find("\"", offset);
-        size_t secondQuote = line.find("\"", firstQuote + 1);
-
-        std::string include = line.substr(firstQuote + 1, secondQuote - firstQuote - 1);
-
-        std::string includeFound;
-        std::string includeContent = manualInclude(include, includeFound, std::string(), foundVersion);
-
-        if(!includeContent.empty())
+        if(includedFiles)
         {
-          text += includeContent;
-          if(m_lineMarkers)
-          {
-            text += std::string("\n") + markerString(lineCount + 1, textFilename, 0);
-          }
+          includedFiles->push_back(includeFound);
+        }
+        expandParsedContent(*includeFile, includeFound, std::string(), foundVersion, includedFiles, text);
+        if(m_lineMarkers)
+        {
+          text += '\n';
+          text += markerString(directive.lineNumber + 1, textFilename, 0);
         }
-        continue;  // Skip adding the original #include line.
       }
     }
-
-    text += line + "\n";
   }
 
-  return text;
+  // remaining lines, the last one gets a newline like all others
+  if(copyBegin < content.size())
+  {
+    text.append(content, copyBegin, std::string::npos);
+    if(content.back() != '\n')
+    {
+      text += '\n';
+    }
+  }
 }
 
 
@@ -22,9 +22,12 @@
 #define NV_SHADERFILEMANAGER_INCLUDED
 
 
+#include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace nvh {
@@ -52,6 +55,14 @@ class ShaderFileManager
     for #defines) after the #version statement of GLSL files,
     regardless of m_handleIncludePasting's value.
 
+    Files loaded from disk are kept in memory, keyed by their found path
+    and validated by their modification time and size, so a header
+    included by many shaders is read and scanned for directives only once.
+    clearFileCache() frees them.
+
+    Loading content is safe from multiple threads, as long as includes
+    and directories are not registered at the same time.
+
 @DOC_END  */
 
 public:
@@ -172,7 +183,27 @@ public:
 
   std::string getProcessedContent(std::string const& filename, std::string& filenameFound);
 
+  void clearFileCache();
+
 protected:
+  // File content with the lines manualIncludeText acts on (#version, #include) located once.
+  struct ParsedFile;
+  typedef std::shared_ptr<const ParsedFile> ParsedFilePtr;
+
+  ParsedFilePtr getParsedIncludeContent(IncludeID idx, std::string& filenameFound);
+  // requestingSource is optional, its directory is searched first
+  ParsedFilePtr getParsedContent(std::string const& filename, std::string& filenameFound, std::string const* requestingSource);
+  // cached by path, modification time and size
+  ParsedFilePtr loadParsedFile(std::string const& filenameFound);
+
+  // appends the expanded content to `text`
+  void expandParsedContent(ParsedFile const&         file,
+                           std::string const&        textFilename,
+                           std::string const&        prepend,
+                           bool                      foundVersion,
+                           std::vector<std::string>* includedFiles,
+                           std::string&              text);
+
   std::string markerString(int line, std::string const& filename, int fileid);
   std::string getIncludeContent(IncludeID idx, std::string& filenameFound);
   std::string getContent(std::string const& filename, std::string& filenameFound);
@@ -182,8 +213,17 @@ protected:
 
   static std::string getDirectoryComponent(std::string filename);
 
-  std::string manualInclude(std::string const& filename, std::string& filenameFound, std::string const& prepend, bool foundVersion);
-  std::string manualIncludeText(std::string const& sourceText, std::string const& textFilename, std::string const& prepend, bool foundVersion);
+  // if `includedFiles` is provided, the found filenames of the loaded file and of all files it includes are appended
+  std::string manualInclude(std::string const&        filename,
+                            std::string&              filenameFound,
+                            std::string const&        prepend,
+                            bool                      foundVersion,
+                            std::vector<std::string>* includedFiles = nullptr);
+  std::string manualIncludeText(std::string const&        sourceText,
+                                std::string const&        textFilename,
+                                std::string const&        prepend,
+                                bool                      foundVersion,
+                                std::vector<std::string>* includedFiles = nullptr);
 
   bool m_lineMarkers;
   bool m_forceLineFilenames;
@@ -194,8 +234,8 @@ protected:
   std::vector<std::string> m_directories;
   IncludeRegistry          m_includes;
 
-  // Used as temporary storage in getContentWithRequestingSourceDirectory; saves on dynamic allocation.
-  std::vector<std::string> m_extendedDirectories;
+  std::mutex                                     m_fileCacheMutex;
+  std::unordered_map<std::string, ParsedFilePtr> m_fileCache;  // by found filename
 };
 
 }  // namespace nvh
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2025, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2025 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "spirvcache.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string.h>  // memcpy
+#include <thread>
+#include <vector>
+
+#include "container_utils.hpp"
+#include "fileoperations.hpp"
+#include "nvprint.hpp"
+
+namespace fs = std::filesystem;
+
+namespace nvh {
+//////////////////////////////////////////////////////////////////////////
+
+static const uint32_t SPIRV_CACHE_MAGIC     = 0x43565053;  // "SPVC"
+static const uint32_t SPIRV_CACHE_VERSION   = 1;
+static const char*    SPIRV_CACHE_EXTENSION = ".spvc";
+
+struct SpirvCacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t keyLo;
+  uint64_t keyHi;
+  uint64_t size;  // of the SPIR-V following the header
+};
+
+static int64_t fileTimeNow()
+{
+  return fs::file_time_type::clock::now().time_since_epoch().count();
+}
+
+SpirvDiskCache::KeyBuilder& SpirvDiskCache::KeyBuilder::add(const void* data, size_t size)
+{
+  uint64_t size64 = size;
+  m_data.append(reinterpret_cast<const char*>(&size64), sizeof(size64));
+  m_data.append(reinterpret_cast<const char*>(data), size);
+  return *this;
+}
+
+SpirvDiskCache::Key SpirvDiskCache::KeyBuilder::finish() const
+{
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(m_data.data());
+
+  Key key;
+  key.lo = hashBytes(data, m_data.size(), SPIRV_CACHE_VERSION);
+  key.hi = hashBytes(data, m_data.size(), key.lo ^ 0x2545f4914f6cdd1dULL);
+  return key;
+}
+
+bool SpirvDiskCache::init(const std::string& directory, uint64_t maxBytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_stats     = Stats();
+  m_directory = directory;
+  m_maxBytes  = maxBytes;
+  m_valid     = false;
+
+  std::error_code ec;
+  fs::create_directories(m_directory, ec);
+  if(!fs::is_directory(m_directory, ec))
+  {
+    LOGW("SPIR-V cache directory %s could not be created, cache disabled\n", m_directory.c_str());
+    return false;
+  }
+
+  for(const fs::directory_entry& it : fs::directory_iterator(m_directory, ec))
+  {
+    if(!it.is_regular_file(ec) || it.path().extension() != SPIRV_CACHE_EXTENSION)
+      continue;
+
+    Entry entry;
+    entry.size    = it.file_size(ec);
+    entry.lastUse = it.last_write_time(ec).time_since_epoch().count();
+    m_entries[it.path().filename().string()] = entry;
+    m_stats.bytes += entry.size;
+  }
+  m_stats.files = m_entries.size();
+  m_valid       = true;
+
+  evict();
+  return true;
+}
+
+void SpirvDiskCache::deinit()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_directory.clear();
+  m_valid = false;
+}
+
+std::string SpirvDiskCache::getFilename(const Key& key) const
+{
+  char name[64];
+  snprintf(name, sizeof(name), "%016llx%016llx%s", (unsigned long long)key.hi, (unsigned long long)key.lo, SPIRV_CACHE_EXTENSION);
+  return name;
+}
+
+bool SpirvDiskCache::load(const Key& key, std::string& spirv)
+{
+  std::string name = getFilename(key);
+  fs::path    path;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_valid)
+      return false;
+    path = fs::path(m_directory) / name;
+  }
+
+  // the file is tried even if not indexed, another process may have added it
+  std::string      data = nvh::loadFile(path.string(), true);
+  SpirvCacheHeader header{};
+  bool             valid = data.size() >= sizeof(header);
+  if(valid)
+  {
+    memcpy(&header, data.data(), sizeof(header));
+    valid = header.magic == SPIRV_CACHE_MAGIC && header.version == SPIRV_CACHE_VERSION && header.keyLo == key.lo
+            && header.keyHi == key.hi && header.size == data.size() - sizeof(header) && header.size % 4 == 0;
+  }
+
+  std::error_code             ec;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto                        it = m_entries.find(name);
+  if(!valid)
+  {
+    if(!data.empty())
+    {
+      LOGW("SPIR-V cache file %s is corrupt, removed\n", path.string().c_str());
+      fs::remove(path, ec);
+    }
+    if(it != m_entries.end())
+    {
+      m_stats.bytes -= it->second.size;
+      m_entries.erase(it);
+      m_stats.files = m_entries.size();
+    }
+    m_stats.misses++;
+    return false;
+  }
+
+  spirv.assign(data.data() + sizeof(header), header.size);
+
+  // refresh the file time, it is the LRU order for the next runs
+  fs::file_time_type now = fs::file_time_type::clock::now();
+  fs::last_write_time(path, now, ec);
+
+  if(it == m_entries.end())
+  {
+    it = m_entries.insert({name, Entry()}).first;
+    it->second.size = data.size();
+    m_stats.bytes += data.size();
+    m_stats.files = m_entries.size();
+  }
+  it->second.lastUse = now.time_since_epoch().count();
+  m_stats.hits++;
+  return true;
+}
+
+void SpirvDiskCache::store(const Key& key, const void* spirv, size_t size)
+{
+  std::string name = getFilename(key);
+  fs::path    path;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_valid)
+      return;
+    path = fs::path(m_directory) / name;
+  }
+
+  SpirvCacheHeader header;
+  header.magic   = SPIRV_CACHE_MAGIC;
+  header.version = SPIRV_CACHE_VERSION;
+  header.keyLo   = key.lo;
+  header.keyHi   = key.hi;
+  header.size    = size;
+
+  // unique per thread, the same key may be stored concurrently
+  std::string tempFile = path.string() + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  {
+    std::ofstream stream(tempFile, std::ios::binary | std::ios::trunc);
+    if(!stream.write(reinterpret_cast<const char*>(&header), sizeof(header))
+       || !stream.write(reinterpret_cast<const char*>(spirv), std::streamsize(size)))
+    {
+      LOGW("Failed to write the SPIR-V cache file %s\n", tempFile.c_str());
+      return;
+    }
+  }
+
+  std::error_code ec;
+  fs::rename(tempFile, path, ec);
+  if(ec)
+  {
+    LOGW("Failed to write the SPIR-V cache file %s\n", path.string().c_str());
+    fs::remove(tempFile, ec);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Entry&                      entry = m_entries[name];
+  m_stats.bytes -= entry.size;
+  entry.size    = sizeof(header) + size;
+  entry.lastUse = fileTimeNow();
+  m_stats.bytes += entry.size;
+  m_stats.files = m_entries.size();
+  m_stats.stores++;
+
+  evict();
+}
+
+void SpirvDiskCache::evict()
+{
+  if(m_stats.bytes <= m_maxBytes)
+    return;
+
+  std::vector<std::pair<int64_t, std::string>> byAge;
+  byAge.reserve(m_entries.size());
+  for(const auto& it : m_entries)
+  {
+    byAge.push_back({it.second.lastUse, it.first});
+  }
+  std::sort(byAge.begin(), byAge.end());
+
+  std::error_code ec;
+  for(size_t i = 0; i < byAge.size() && m_stats.bytes > m_maxBytes; i++)
+  {
+    auto it = m_entries.find(byAge[i].second);
+    fs::remove(fs::path(m_directory) / it->first, ec);
+    m_stats.bytes -= it->second.size;
+    m_stats.evictions++;
+    m_entries.erase(it);
+  }
+  m_stats.files = m_entries.size();
+}
+
+SpirvDiskCache::Stats SpirvDiskCache::getStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void SpirvDiskCache::resetStats()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.hits      = 0;
+  m_stats.misses    = 0;
+  m_stats.stores    = 0;
+  m_stats.evictions = 0;
+}
+
+}  // namespace nvh
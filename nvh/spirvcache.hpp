@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2025, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2025 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace nvh {
+//////////////////////////////////////////////////////////////////////////
+/** @DOC_START
+  # class nvh::SpirvDiskCache
+
+  The nvh::SpirvDiskCache class stores compiled SPIR-V in a directory, one file
+  per compilation, addressed by a 128-bit key over everything that determines
+  the compiler output. It is used by nvvk::ShaderModuleManager and
+  nvvkhl::GlslCompiler, which build the key from the fully preprocessed source,
+  the prepend/defines, the shader stage, the target environment and the
+  compiler options. A changed header or define therefore simply produces
+  another key, there is no explicit invalidation.
+
+  The total size of the directory is capped: each hit refreshes the
+  modification time of its file, and when a store exceeds the cap the least
+  recently used files are deleted. Using the file times keeps the LRU order
+  across runs.
+
+  Files are written to a temporary file and renamed, several processes can
+  share a cache directory. All functions are thread-safe.
+
+  Example :
+  ```cpp
+  nvh::SpirvDiskCache spirvCache;
+  spirvCache.init(NVPSystem::exePath() + "spirv_cache", 128 * 1024 * 1024);
+
+  shaderModuleManager.setSpirvCache(&spirvCache);
+  // ... create shader modules
+
+  nvh::SpirvDiskCache::Stats stats = spirvCache.getStats();
+  LOGI("spirv cache: %llu hits, %llu misses\n", stats.hits, stats.misses);
+  ```
+@DOC_END */
+
+class SpirvDiskCache
+{
+public:
+  struct Key
+  {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+  };
+
+  // Accumulates the inputs of a compilation, every add() is length-prefixed
+  // so that different splits of the same bytes produce different keys.
+  class KeyBuilder
+  {
+  public:
+    KeyBuilder& add(const void* data, size_t size);
+    KeyBuilder& add(std::string_view str) { return add(str.data(), str.size()); }
+    KeyBuilder& add(uint64_t value) { return add(&value, sizeof(value)); }
+
+    Key finish() const;
+
+  private:
+    std::string m_data;
+  };
+
+  struct Stats
+  {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t stores    = 0;
+    uint64_t evictions = 0;
+    uint64_t files     = 0;  // currently in the cache directory
+    uint64_t bytes     = 0;
+  };
+
+  SpirvDiskCache(SpirvDiskCache const&)            = delete;
+  SpirvDiskCache& operator=(SpirvDiskCache const&) = delete;
+
+  SpirvDiskCache() {}
+  SpirvDiskCache(const std::string& directory, uint64_t maxBytes = DEFAULT_MAX_BYTES) { init(directory, maxBytes); }
+
+  // creates the directory if needed and indexes the existing entries,
+  // evicting entries if they exceed maxBytes
+  bool init(const std::string& directory, uint64_t maxBytes = DEFAULT_MAX_BYTES);
+  void deinit();
+
+  bool               isValid() const { return m_valid; }
+  const std::string& getDirectory() const { return m_directory; }
+
+  // returns true and fills `spirv` on a hit
+  bool load(const Key& key, std::string& spirv);
+  // adds the SPIR-V of a successful compilation
+  void store(const Key& key, const void* spirv, size_t size);
+
+  Stats getStats() const;
+  void  resetStats();
+
+  static constexpr uint64_t DEFAULT_MAX_BYTES = 256 * 1024 * 1024;
+
+private:
+  struct Entry
+  {
+    uint64_t size    = 0;
+    int64_t  lastUse = 0;  // file time ticks
+  };
+
+  std::string getFilename(const Key& key) const;
+  void        evict();
+
+  mutable std::mutex                     m_mutex;
+  std::unordered_map<std::string, Entry> m_entries;  // by filename
+  std::string                            m_directory;
+  uint64_t                               m_maxBytes = DEFAULT_MAX_BYTES;
+  std::atomic_bool                       m_valid    = false;  // also read without the mutex by isValid()
+  Stats                                  m_stats;
+};
+
+}  // namespace nvh
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2025, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2025, NVIDIA CORPORATION.
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "task_graph.hpp"
+#include "parallel_work.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <future>
+
+namespace nvh {
+
+TaskGraph::TaskID TaskGraph::add(std::function<void()> fn, std::initializer_list<TaskID> dependencies)
+{
+  const TaskID id = static_cast<TaskID>(m_tasks.size());
+  m_tasks.emplace_back();
+  m_tasks.back().fn = std::move(fn);
+  for(TaskID dependency : dependencies)
+  {
+    addDependency(id, dependency);
+  }
+  return id;
+}
+
+TaskGraph::TaskID TaskGraph::addRanges(uint64_t                                numItems,
+                                       uint64_t                                batchSize,
+                                       std::function<void(uint64_t, uint64_t)> fn,
+                                       std::initializer_list<TaskID>           dependencies)
+{
+  batchSize = std::max(batchSize, uint64_t(1));
+
+  // The ranges share one copy of the callback
+  auto         sharedFn = std::make_shared<std::function<void(uint64_t, uint64_t)>>(std::move(fn));
+  const TaskID join     = add(nullptr);
+  for(uint64_t begin = 0; begin < numItems; begin += batchSize)
+  {
+    const uint64_t end   = std::min(begin + batchSize, numItems);
+    const TaskID   range = add([sharedFn, begin, end] { (*sharedFn)(begin, end); }, dependencies);
+    addDependency(join, range);
+  }
+  // With no items, the join task still has to wait on the dependencies
+  if(numItems == 0)
+  {
+    for(TaskID dependency : dependencies)
+    {
+      addDependency(join, dependency);
+    }
+  }
+  return join;
+}
+
+void TaskGraph::addDependency(TaskID task, TaskID dependency)
+{
+  assert(task < m_tasks.size() && dependency < m_tasks.size() && task != dependency);
+  m_tasks[dependency].successors.push_back(task);
+  m_tasks[task].numDependencies++;
+}
+
+void TaskGraph::clear()
+{
+  m_tasks.clear();
+  m_pending.reset();
+  m_workers.clear();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Topological order on the calling thread (Kahn's algorithm)
+//
+void TaskGraph::runSerial()
+{
+  std::vector<uint32_t> pending(m_tasks.size());
+  std::vector<TaskID>   ready;
+  for(TaskID id = 0; id < m_tasks.size(); id++)
+  {
+    pending[id] = m_tasks[id].numDependencies;
+    if(pending[id] == 0)
+    {
+      ready.push_back(id);
+    }
+  }
+
+  while(!ready.empty())
+  {
+    const TaskID id = ready.back();
+    ready.pop_back();
+    if(m_tasks[id].fn)
+    {
+      m_tasks[id].fn();
+    }
+    for(TaskID successor : m_tasks[id].successors)
+    {
+      if(--pending[successor] == 0)
+      {
+        ready.push_back(successor);
+      }
+    }
+  }
+}
+
+bool TaskGraph::popOrSteal(uint32_t workerIndex, TaskID& task)
+{
+  // Own deque first, newest task
+  {
+    Worker&                     self = *m_workers[workerIndex];
+    std::lock_guard<std::mutex> lock(self.mutex);
+    if(!self.ready.empty())
+    {
+      task = self.ready.back();
+      self.ready.pop_back();
+      return true;
+    }
+  }
+
+  // Steal the oldest task of another worker; the lock is not tried only, as the worker goes to sleep if this fails
+  const uint32_t numWorkers = static_cast<uint32_t>(m_workers.size());
+  for(uint32_t i = 1; i < numWorkers; i++)
+  {
+    Worker&                     victim = *m_workers[(workerIndex + i) % numWorkers];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if(!victim.ready.empty())
+    {
+      task = victim.ready.front();
+      victim.ready.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskGraph::execute(uint32_t workerIndex, TaskID task)
+{
+  // After a failure the remaining tasks are skipped, but still complete so that run() returns
+  if(m_tasks[task].fn && !m_failed.load(std::memory_order_relaxed))
+  {
+    try
+    {
+      m_tasks[task].fn();
+    }
+    catch(...)
+    {
+      std::lock_guard<std::mutex> lock(m_idleMutex);
+      if(!m_failed.exchange(true))
+      {
+        m_exception = std::current_exception();
+      }
+    }
+  }
+
+  // Successors whose last dependency this was become ready on this worker
+  size_t numQueued = 0;
+  for(TaskID successor : m_tasks[task].successors)
+  {
+    if(m_pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+      Worker&                     self = *m_workers[workerIndex];
+      std::lock_guard<std::mutex> lock(self.mutex);
+      self.ready.push_back(successor);
+      numQueued = self.ready.size();
+    }
+  }
+
+  const bool done = m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+
+  // This worker runs the next queued task itself, the others can be stolen
+  if(done || numQueued > 1)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_idleMutex);
+      m_readyEpoch++;
+    }
+    m_idleCondition.notify_all();
+  }
+}
+
+void TaskGraph::workerLoop(uint32_t workerIndex)
+{
+  for(;;)
+  {
+    uint64_t epoch;
+    {
+      std::lock_guard<std::mutex> lock(m_idleMutex);
+      epoch = m_readyEpoch;
+    }
+
+    TaskID task;
+    if(popOrSteal(workerIndex, task))
+    {
+      execute(workerIndex, task);
+      continue;
+    }
+
+    // Nothing to do: sleep unless tasks were pushed since the deques were checked
+    std::unique_lock<std::mutex> lock(m_idleMutex);
+    m_idleCondition.wait(lock, [&] { return m_readyEpoch != epoch || m_remaining.load(std::memory_order_acquire) == 0; });
+    if(m_remaining.load(std::memory_order_acquire) == 0)
+    {
+      return;
+    }
+  }
+}
+
+void TaskGraph::run(uint32_t numThreads)
+{
+  if(m_tasks.empty())
+  {
+    return;
+  }
+
+  // Nested in a pool thread: the other pool threads may all be waiting on us
+  if(numThreads == 1 || m_tasks.size() == 1 || BS::this_thread::get_index().has_value())
+  {
+    runSerial();
+    return;
+  }
+
+  BS::thread_pool& pool       = get_thread_pool();
+  uint32_t         numWorkers = static_cast<uint32_t>(pool.get_thread_count());
+  if(numThreads != 0)
+  {
+    numWorkers = std::min(numWorkers, numThreads);
+  }
+  numWorkers = std::max(std::min(numWorkers, static_cast<uint32_t>(m_tasks.size())), 1u);
+
+  m_pending = std::make_unique<std::atomic_uint32_t[]>(m_tasks.size());
+  m_workers.clear();
+  for(uint32_t i = 0; i < numWorkers; i++)
+  {
+    m_workers.push_back(std::make_unique<Worker>());
+  }
+
+  // Deal the initially ready tasks to the workers round robin
+  uint32_t nextWorker = 0;
+  for(TaskID id = 0; id < m_tasks.size(); id++)
+  {
+    m_pending[id].store(m_tasks[id].numDependencies, std::memory_order_relaxed);
+    if(m_tasks[id].numDependencies == 0)
+    {
+      m_workers[nextWorker]->ready.push_back(id);
+      nextWorker = (nextWorker + 1) % numWorkers;
+    }
+  }
+  m_remaining.store(static_cast<uint32_t>(m_tasks.size()), std::memory_order_release);
+  m_failed.store(false, std::memory_order_relaxed);
+  m_exception = nullptr;
+
+  // The calling thread is worker 0
+  std::vector<std::future<void>> futures;
+  futures.reserve(numWorkers - 1);
+  for(uint32_t i = 1; i < numWorkers; i++)
+  {
+    futures.push_back(pool.submit_task([this, i] { workerLoop(i); }));
+  }
+  workerLoop(0);
+  for(auto& future : futures)
+  {
+    future.wait();
+  }
+
+  m_pending.reset();
+  m_workers.clear();
+
+  if(m_exception)
+  {
+    std::exception_ptr exception = m_exception;
+    m_exception                  = nullptr;
+    std::rethrow_exception(exception);
+  }
+}
+
+}  // namespace nvh
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2025, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2025, NVIDIA CORPORATION.
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nvh {
+/* @DOC_START
+# class nvh::TaskGraph
+
+> Runs a set of tasks with dependencies on the thread pool of `nvh::parallel_work`.
+
+Where `parallel_batches` runs one loop at a time, the task graph lets
+independent stages of work overlap: a task starts as soon as all the tasks it
+depends on are done.
+
+Each worker owns a deque of ready tasks. Tasks that become ready are pushed to
+the back of the deque of the worker that finished their last dependency, and
+the owner pops from the back (most recent first, which is usually still in
+cache). A worker with an empty deque steals from the front of the other deques.
+The thread calling `run()` is one of the workers. Workers without anything to
+pop or steal sleep until a task becomes ready or the graph is done.
+
+```cpp
+nvh::TaskGraph graph;
+nvh::TaskGraph::TaskID meshes  = graph.add([&] { loadMeshes(); });
+nvh::TaskGraph::TaskID nodes   = graph.add([&] { flattenNodes(); });
+nvh::TaskGraph::TaskID tangent = graph.addRanges(numVertices, 4096,
+                                   [&](uint64_t begin, uint64_t end) { fixTangents(begin, end); }, {meshes});
+graph.add([&] { computeBounds(); }, {meshes, nodes});
+graph.run();  // Returns when all tasks are done
+```
+
+Notes:
+- Tasks must not block on other tasks of the same graph; express this as a dependency instead.
+- Dependency cycles are not allowed, `run()` would never return.
+- If a task throws, the tasks that did not start yet are skipped and `run()`
+  rethrows the first exception once the running tasks are done.
+- If `run()` is called from a thread of the pool (nested parallelism), or with
+  numThreads == 1, the tasks run serially on the calling thread in dependency order.
+- After `run()`, the graph can be run again or cleared.
+
+@DOC_END */
+
+class TaskGraph
+{
+public:
+  using TaskID = uint32_t;
+
+  // Adds a task that runs after all `dependencies` are done
+  TaskID add(std::function<void()> fn, std::initializer_list<TaskID> dependencies = {});
+
+  // Splits [0, numItems) in ranges of batchSize items, one task each calling fn(itemBegin, itemEnd).
+  // Returns a task that is done when all ranges are done, to be used as dependency.
+  TaskID addRanges(uint64_t                                numItems,
+                   uint64_t                                batchSize,
+                   std::function<void(uint64_t, uint64_t)> fn,
+                   std::initializer_list<TaskID>           dependencies = {});
+
+  // `task` will run after `dependency` is done
+  void addDependency(TaskID task, TaskID dependency);
+
+  // Executes all tasks and waits for them.
+  // numThreads == 0 uses all threads of nvh::get_thread_pool(), the calling thread included
+  void run(uint32_t numThreads = 0);
+
+  void   clear();
+  size_t size() const { return m_tasks.size(); }
+
+private:
+  struct Task
+  {
+    std::function<void()> fn;
+    std::vector<TaskID>   successors;
+    uint32_t              numDependencies = 0;
+  };
+
+  struct Worker
+  {
+    std::mutex         mutex;
+    std::deque<TaskID> ready;
+  };
+
+  bool popOrSteal(uint32_t workerIndex, TaskID& task);
+  void execute(uint32_t workerIndex, TaskID task);
+  void workerLoop(uint32_t workerIndex);
+  void runSerial();
+
+  std::vector<Task> m_tasks;
+
+  // Execution state, only valid during run()
+  std::unique_ptr<std::atomic_uint32_t[]> m_pending;  // Number of unfinished dependencies, per task
+  std::vector<std::unique_ptr<Worker>>    m_workers;
+  std::atomic_uint32_t                    m_remaining{0};  // Number of unfinished tasks
+  std::atomic_bool                        m_failed{false};
+  std::exception_ptr                      m_exception;  // First exception thrown by a task
+
+  // Idle workers wait for m_readyEpoch to change, which happens when tasks are pushed or all are done
+  std::mutex              m_idleMutex;
+  std::condition_variable m_idleCondition;
+  uint64_t                m_readyEpoch = 0;
+};
+
+}  // namespace nvh
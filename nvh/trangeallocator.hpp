@@ -25,7 +25,13 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <bit>
+#include <map>
+#include <numeric>
+#include <vector>
 #include <NvFoundation.h>
+#if defined(_WIN32)
+#include <intrin.h>
+#endif
 
 namespace nvh {
 
@@ -36,7 +42,21 @@ namespace nvh {
   maximum size. Ranges are allocated at GRANULARITY and are merged back on freeing.
   Its primary use is within allocators that sub-allocate from fixed-size blocks.
 
-  The implementation is based on [MakeID by Emil Persson](http://www.humus.name/3D/MakeID.h).
+  Offsets and sizes are 32-bit by default, nvh::TRangeAllocator64<GRANULARITY> uses 64-bit
+  offsets and sizes for pools larger than 4 GB.
+
+  `defragment` compacts a fragmented pool: given all live sub-allocations it returns
+  a plan of moves (source offset to destination offset) and updates its state accordingly.
+
+  The interface is based on [MakeID by Emil Persson](http://www.humus.name/3D/MakeID.h).
+  Free ranges are found in O(1) through segregated size classes with two-level bitmaps (as in TLSF),
+  and merged back in O(log n) through an ordered map of the free ranges. Allocations take a
+  free range of the smallest non-empty size class that fits, not the lowest offset. Requests are
+  rounded up to the next size class (at most 1/16 larger), only the first range of their own
+  class is tested as well, so an allocation can fail while a free range of that class would fit.
+
+  `defragment` walks the free ranges in offset order for each moved allocation, O(n * m) for
+  n free ranges and m allocations; it is meant for occasional compaction, not per frame.
 
   Example :
 
@@ -73,12 +93,13 @@ namespace nvh {
 @DOC_END */
 
 // GRANULARITY must be power of two
-template <uint32_t GRANULARITY = 256>
+// TOffset is the type of offsets and sizes, uint32_t or uint64_t, the number of pages is limited to 32 bits
+template <uint32_t GRANULARITY = 256, typename TOffset = uint32_t>
 class TRangeAllocator
 {
 private:
-  uint32_t m_size;
-  uint32_t m_used;
+  TOffset m_size;
+  TOffset m_used;
 
 public:
   TRangeAllocator()
@@ -86,18 +107,19 @@ public:
       , m_used(0)
   {
   }
-  TRangeAllocator(uint32_t size) { init(size); }
+  TRangeAllocator(TOffset size) { init(size); }
 
   ~TRangeAllocator() { deinit(); }
 
-  static uint32_t alignedSize(uint32_t size) { return (size + GRANULARITY - 1) & (~(GRANULARITY - 1)); }
+  static TOffset alignedSize(TOffset size) { return (size + GRANULARITY - 1) & (~TOffset(GRANULARITY - 1)); }
 
-  void init(uint32_t size)
+  void init(TOffset size)
   {
     assert(size % GRANULARITY == 0 && "managed total size must be aligned to GRANULARITY");
 
-    uint32_t pages = ((size + GRANULARITY - 1) / GRANULARITY);
-    rangeInit(pages - 1);
+    TOffset pages = ((size + GRANULARITY - 1) / GRANULARITY);
+    assert(pages - 1 <= TOffset(~uint32_t(0)) && "number of pages must fit in 32 bits");
+    rangeInit(uint32_t(pages - 1));
     m_used = 0;
     m_size = size;
   }
@@ -105,10 +127,10 @@ public:
 
   bool isEmpty() const { return m_used == 0; }
 
-  bool isAvailable(uint32_t size, uint32_t align) const
+  bool isAvailable(TOffset size, TOffset align) const
   {
-    uint32_t alignRest    = align - 1;
-    uint32_t sizeReserved = size;
+    TOffset alignRest    = align - 1;
+    TOffset sizeReserved = size;
 
     if(m_used >= m_size)
     {
@@ -120,29 +142,19 @@ public:
       sizeReserved += alignRest;
     }
 
-    uint32_t countReserved = (sizeReserved + GRANULARITY - 1) / GRANULARITY;
-    return isRangeAvailable(countReserved);
+    TOffset countReserved = (sizeReserved + GRANULARITY - 1) / GRANULARITY;
+    return countReserved <= TOffset(~uint32_t(0)) && isRangeAvailable(uint32_t(countReserved));
   }
 
-  bool subAllocate(uint32_t size, uint32_t align, uint32_t& outOffset, uint32_t& outAligned, uint32_t& outSize)
+  bool subAllocate(TOffset size, TOffset align, TOffset& outOffset, TOffset& outAligned, TOffset& outSize)
   {
     if(align == 0)
     {
       align = 1;
     }
-    uint32_t alignRest    = align - 1;
-    uint32_t sizeReserved = size;
-
-#if (__cplusplus >= 202002L)
-    bool alignIsPOT = std::popcount(align) == 1;
-#else
-    // fallback for pre or incomplete C++20 like gcc11
-#if defined(_WIN32)
-    bool alignIsPOT = __popcnt(align) == 1;
-#else
-    bool alignIsPOT = __builtin_popcount(align) == 1;
-#endif
-#endif
+    TOffset alignRest    = align - 1;
+    TOffset sizeReserved = size;
+    bool    alignIsPOT   = (align & alignRest) == 0;
 
     if(m_used >= m_size)
     {
@@ -157,12 +169,13 @@ public:
       sizeReserved += alignRest;
     }
 
-    uint32_t countReserved = (sizeReserved + GRANULARITY - 1) / GRANULARITY;
+    TOffset  pagesReserved = (sizeReserved + GRANULARITY - 1) / GRANULARITY;
+    uint32_t countReserved = uint32_t(pagesReserved);
 
     uint32_t startID;
-    if(createRangeID(startID, countReserved))
+    if(pagesReserved <= TOffset(~uint32_t(0)) && createRangeID(startID, countReserved))
     {
-      outOffset  = startID * GRANULARITY;
+      outOffset  = TOffset(startID) * GRANULARITY;
       outAligned = ((outOffset + alignRest) / align) * align;
 
       // due to custom alignment, we may be able to give
@@ -174,11 +187,11 @@ public:
 
       // correct start (warning could yield more fragmentation)
 
-      uint32_t skipFront = (outAligned - outOffset) / GRANULARITY;
+      uint32_t skipFront = uint32_t((outAligned - outOffset) / GRANULARITY);
       if(skipFront)
       {
         destroyRangeID(startID, skipFront);
-        outOffset += skipFront * GRANULARITY;
+        outOffset += TOffset(skipFront) * GRANULARITY;
         startID += skipFront;
         countReserved -= skipFront;
       }
@@ -186,10 +199,10 @@ public:
       assert(outOffset <= outAligned);
 
       // correct end
-      uint32_t outLast = alignedSize(outAligned + size);
-      outSize          = outLast - outOffset;
+      TOffset outLast = alignedSize(outAligned + size);
+      outSize         = outLast - outOffset;
 
-      uint32_t usedCount = outSize / GRANULARITY;
+      uint32_t usedCount = uint32_t(outSize / GRANULARITY);
       assert(usedCount <= countReserved);
 
       if(usedCount < countReserved)
@@ -214,342 +227,500 @@ public:
     }
   }
 
-  void subFree(uint32_t offset, uint32_t size)
+  void subFree(TOffset offset, TOffset size)
   {
     assert(offset % GRANULARITY == 0);
     assert(size % GRANULARITY == 0);
 
     m_used -= size;
-    destroyRangeID(offset / GRANULARITY, size / GRANULARITY);
+    destroyRangeID(uint32_t(offset / GRANULARITY), uint32_t(size / GRANULARITY));
 
     //checkRanges();
   }
 
-  TRangeAllocator& operator=(const TRangeAllocator& other)
+  // A live sub-allocation for defragment(): `offset` and `size` as returned by
+  // subAllocate (outOffset, outSize) and the `alignment` that was requested.
+  struct DefragRange
   {
-    m_size = other.m_size;
-    m_used = other.m_used;
-
-    m_Ranges   = other.m_Ranges;
-    m_Count    = other.m_Count;
-    m_Capacity = other.m_Capacity;
-    m_MaxID    = other.m_MaxID;
-
-    if(m_Ranges)
-    {
-      m_Ranges = static_cast<Range*>(::malloc(m_Capacity * sizeof(Range)));
-      memcpy(m_Ranges, other.m_Ranges, m_Capacity * sizeof(Range));
-    }
+    TOffset offset    = 0;
+    TOffset size      = 0;
+    TOffset alignment = 1;
+  };
 
-    return *this;
-  }
+  struct DefragMove
+  {
+    uint32_t index;  // of the range passed to defragment()
+    TOffset  srcOffset;
+    TOffset  dstOffset;
+    TOffset  size;
+  };
 
-  TRangeAllocator(const TRangeAllocator& other)
+  // One compaction pass. `ranges` must contain all live sub-allocations.
+  // Starting with the highest offset, each range moves to the lowest free space below it that keeps
+  // its alignment (`dst - src` is a multiple of the alignment), until maxMoveSize bytes were moved.
+  //
+  // The destinations never overlap any source, so all copies of a pass can be done at once
+  // (for example a single vkCmdCopyBuffer with one region per move). The offsets in `ranges` are
+  // updated and the sources are freed when this returns: the copies must be done before the
+  // next sub-allocation. Running more passes compacts further. Returns the number of bytes moved.
+  TOffset defragment(std::vector<DefragRange>& ranges,
+                     std::vector<DefragMove>&  moves,
+                     TOffset                   maxMoveSize = ~TOffset(0))
   {
-    m_size = other.m_size;
-    m_used = other.m_used;
+    moves.clear();
 
-    m_Ranges   = other.m_Ranges;
-    m_Count    = other.m_Count;
-    m_Capacity = other.m_Capacity;
-    m_MaxID    = other.m_MaxID;
+    std::vector<uint32_t> order(ranges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return ranges[a].offset > ranges[b].offset; });
 
-    if(m_Ranges)
+    TOffset moved = 0;
+    for(uint32_t index : order)
     {
-      m_Ranges = static_cast<Range*>(::malloc(m_Capacity * sizeof(Range)));
-      assert(m_Ranges);  // Make sure allocation succeeded
-      memcpy(m_Ranges, other.m_Ranges, m_Capacity * sizeof(Range));
-    }
-  }
-
-  TRangeAllocator& operator=(TRangeAllocator&& other)
-  {
-    m_size = other.m_size;
-    m_used = other.m_used;
-
-    m_Ranges   = other.m_Ranges;
-    m_Count    = other.m_Count;
-    m_Capacity = other.m_Capacity;
-    m_MaxID    = other.m_MaxID;
+      DefragRange& range = ranges[index];
+      assert(range.offset % GRANULARITY == 0 && range.size % GRANULARITY == 0);
+      if(range.size > maxMoveSize - moved)
+      {
+        break;
+      }
 
-    other.m_Ranges = nullptr;
+      const uint32_t srcID     = uint32_t(range.offset / GRANULARITY);
+      const uint32_t count     = uint32_t(range.size / GRANULARITY);
+      const TOffset  step      = std::lcm(std::max(range.alignment, TOffset(1)), TOffset(GRANULARITY));
+      const uint32_t stepCount = uint32_t(step / GRANULARITY);
 
-    return *this;
-  }
+      uint32_t dstID;
+      if(count == 0 || !findRangeBelow(srcID, count, stepCount, dstID))
+      {
+        continue;
+      }
+      reserveRangeID(dstID, count);
 
-  TRangeAllocator(TRangeAllocator&& other)
-  {
-    m_size = other.m_size;
-    m_used = other.m_used;
+      const TOffset dstOffset = TOffset(dstID) * GRANULARITY;
+      moves.push_back({index, range.offset, dstOffset, range.size});
+      range.offset = dstOffset;
+      moved += range.size;
+    }
 
-    m_Ranges   = other.m_Ranges;
-    m_Count    = other.m_Count;
-    m_Capacity = other.m_Capacity;
-    m_MaxID    = other.m_MaxID;
+    // Sources are freed only once all destinations are chosen, so no destination overlaps a source
+    for(const DefragMove& move : moves)
+    {
+      destroyRangeID(uint32_t(move.srcOffset / GRANULARITY), uint32_t(move.size / GRANULARITY));
+    }
 
-    other.m_Ranges = nullptr;
+    return moved;
   }
 
+  TRangeAllocator(const TRangeAllocator& other)            = default;
+  TRangeAllocator(TRangeAllocator&& other)                 = default;
+  TRangeAllocator& operator=(const TRangeAllocator& other) = default;
+  TRangeAllocator& operator=(TRangeAllocator&& other)      = default;
+
 private:
   //////////////////////////////////////////////////////////////////////////
-  // most of the following code is taken from Emil Persson's MakeID
+  // The interface of the following code is taken from Emil Persson's MakeID
   // http://www.humus.name/3D/MakeID.h (v1.02)
+  //
+  // Instead of searching a sorted array of free ranges, the free ranges are kept in
+  // segregated lists by size, two-level bitmaps as in TLSF find a list with a large enough
+  // range in O(1). For coalescing on free, the ranges are also ordered by their first ID.
 
   struct Range
   {
     uint32_t m_First;
     uint32_t m_Last;
+    uint32_t m_PrevFree;  // linked list of the ranges of the same size class
+    uint32_t m_NextFree;
   };
 
-  Range*   m_Ranges   = nullptr;  // Sorted array of ranges of free IDs
-  uint32_t m_Count    = 0;        // Number of ranges in list
-  uint32_t m_Capacity = 0;        // Total capacity of range list
-  uint32_t m_MaxID    = 0;
+  static constexpr uint32_t INVALID_RANGE = ~0u;
 
-public:
-  void rangeInit(const uint32_t max_id)
+  // size classes: the first level is the power of two of the count, the second level
+  // splits each power of two in SL_COUNT linear steps. Counts below SL_COUNT map to first level 0.
+  static constexpr uint32_t SL_BITS  = 4;
+  static constexpr uint32_t SL_COUNT = 1 << SL_BITS;
+  static constexpr uint32_t FL_COUNT = 32 - SL_BITS + 1;
+
+  std::vector<Range>           m_Ranges;        // pool of free ranges, referenced by index
+  std::vector<uint32_t>        m_UnusedRanges;  // recycled entries of m_Ranges
+  std::map<uint32_t, uint32_t> m_RangeByFirst;  // first ID -> index of the free range, ordered for coalescing
+
+  uint32_t m_FlBitmap                  = 0;   // bit fl set if any list of first level fl is not empty
+  uint32_t m_SlBitmap[FL_COUNT]        = {};  // bit sl set if list [fl][sl] is not empty
+  uint32_t m_Heads[FL_COUNT][SL_COUNT] = {};  // first range of each list, valid if its bitmap bit is set
+  uint32_t m_MaxID                     = 0;
+
+  static uint32_t bitScanForward(uint32_t bits)
   {
-    // Start with a single range, from 0 to max allowed ID (specified)
-    m_Ranges = static_cast<Range*>(::malloc(sizeof(Range)));
-    assert(m_Ranges != nullptr);  // Make sure allocation succeeded
-    m_Ranges[0].m_First = 0;
-    m_Ranges[0].m_Last  = max_id;
-    m_Count             = 1;
-    m_Capacity          = 1;
-    m_MaxID             = max_id;
+#if (__cplusplus >= 202002L)
+    return std::countr_zero(bits);
+#elif defined(_WIN32)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return index;
+#else
+    return __builtin_ctz(bits);
+#endif
   }
 
-  void rangeDeinit()
+  static uint32_t bitScanReverse(uint32_t bits)
+  {
+#if (__cplusplus >= 202002L)
+    return 31 - std::countl_zero(bits);
+#elif defined(_WIN32)
+    unsigned long index;
+    _BitScanReverse(&index, bits);
+    return index;
+#else
+    return 31 - __builtin_clz(bits);
+#endif
+  }
+
+  // size class containing ranges of `count` IDs
+  static void mappingInsert(uint32_t count, uint32_t& fl, uint32_t& sl)
   {
-    if(m_Ranges)
+    if(count < SL_COUNT)
+    {
+      fl = 0;
+      sl = count;
+    }
+    else
     {
-      ::free(m_Ranges);
-      m_Ranges = nullptr;
+      uint32_t log2 = bitScanReverse(count);
+      fl            = log2 - SL_BITS + 1;
+      sl            = (count >> (log2 - SL_BITS)) - SL_COUNT;
     }
   }
 
-  bool createID(uint32_t& id)
+  // smallest size class in which all ranges have at least `count` IDs, false if there is none
+  static bool mappingSearch(uint32_t count, uint32_t& fl, uint32_t& sl)
   {
-    if(m_Ranges[0].m_First <= m_Ranges[0].m_Last)
+    uint64_t rounded = count;
+    if(count >= SL_COUNT)
     {
-      id = m_Ranges[0].m_First;
-
-      // If current range is full and there is another one, that will become the new current range
-      if(m_Ranges[0].m_First == m_Ranges[0].m_Last && m_Count > 1)
-      {
-        destroyRange(0);
-      }
-      else
+      rounded += (uint64_t(1) << (bitScanReverse(count) - SL_BITS)) - 1;
+      if(rounded > 0xFFFFFFFFull)
       {
-        ++m_Ranges[0].m_First;
+        return false;
       }
-      return true;
     }
+    mappingInsert(uint32_t(rounded), fl, sl);
+    return true;
+  }
 
-    // No availble ID left
-    return false;
+  static uint32_t rangeCount(const Range& range) { return range.m_Last - range.m_First + 1; }
+
+  void linkRange(uint32_t index)
+  {
+    Range&   range = m_Ranges[index];
+    uint32_t fl, sl;
+    mappingInsert(rangeCount(range), fl, sl);
+
+    range.m_PrevFree = INVALID_RANGE;
+    range.m_NextFree = m_Heads[fl][sl];
+    if(range.m_NextFree != INVALID_RANGE)
+    {
+      m_Ranges[range.m_NextFree].m_PrevFree = index;
+    }
+    m_Heads[fl][sl] = index;
+    m_FlBitmap |= 1u << fl;
+    m_SlBitmap[fl] |= 1u << sl;
   }
 
-  bool createRangeID(uint32_t& id, const uint32_t count)
+  void unlinkRange(uint32_t index)
   {
-    uint32_t i = 0;
-    do
+    Range&   range = m_Ranges[index];
+    uint32_t fl, sl;
+    mappingInsert(rangeCount(range), fl, sl);
+
+    if(range.m_PrevFree != INVALID_RANGE)
+    {
+      m_Ranges[range.m_PrevFree].m_NextFree = range.m_NextFree;
+    }
+    else
     {
-      const uint32_t range_count = 1 + m_Ranges[i].m_Last - m_Ranges[i].m_First;
-      if(count <= range_count)
+      m_Heads[fl][sl] = range.m_NextFree;
+      if(range.m_NextFree == INVALID_RANGE)
       {
-        id = m_Ranges[i].m_First;
-
-        // If current range is full and there is another one, that will become the new current range
-        if(count == range_count && i + 1 < m_Count)
+        m_SlBitmap[fl] &= ~(1u << sl);
+        if(!m_SlBitmap[fl])
         {
-          destroyRange(i);
+          m_FlBitmap &= ~(1u << fl);
         }
-        else
-        {
-          m_Ranges[i].m_First += count;
-        }
-        return true;
       }
-      ++i;
-    } while(i < m_Count);
-
-    // No range of free IDs was large enough to create the requested continuous ID sequence
-    return false;
+    }
+    if(range.m_NextFree != INVALID_RANGE)
+    {
+      m_Ranges[range.m_NextFree].m_PrevFree = range.m_PrevFree;
+    }
   }
 
-  bool destroyID(const uint32_t id) { return destroyRangeID(id, 1); }
-
-  bool destroyRangeID(const uint32_t id, const uint32_t count)
+  void insertRange(uint32_t first, uint32_t last)
   {
-    const uint32_t end_id = id + count;
+    uint32_t index;
+    if(!m_UnusedRanges.empty())
+    {
+      index = m_UnusedRanges.back();
+      m_UnusedRanges.pop_back();
+    }
+    else
+    {
+      index = uint32_t(m_Ranges.size());
+      m_Ranges.push_back({});
+    }
+    m_Ranges[index].m_First = first;
+    m_Ranges[index].m_Last  = last;
+    linkRange(index);
+    m_RangeByFirst.emplace(first, index);
+  }
 
-    assert(end_id <= m_MaxID + 1);
+  void destroyRange(uint32_t index)
+  {
+    unlinkRange(index);
+    m_RangeByFirst.erase(m_Ranges[index].m_First);
+    m_UnusedRanges.push_back(index);
+  }
 
-    // Binary search of the range list
-    uint32_t i0 = 0;
-    uint32_t i1 = m_Count - 1;
+  // changes the bounds of a free range, re-keys and re-links it without allocating
+  void resizeRange(uint32_t index, uint32_t first, uint32_t last)
+  {
+    Range& range = m_Ranges[index];
+    unlinkRange(index);
+    if(range.m_First != first)
+    {
+      auto node  = m_RangeByFirst.extract(range.m_First);
+      node.key() = first;
+      m_RangeByFirst.insert(std::move(node));
+    }
+    range.m_First = first;
+    range.m_Last  = last;
+    linkRange(index);
+  }
 
-    for(;;)
+  // a free range with at least `count` IDs, INVALID_RANGE if there is none
+  uint32_t findRange(uint32_t count) const
+  {
+    if(count == 0 || !m_FlBitmap)
     {
-      const uint32_t i = (i0 + i1) / 2;
+      return INVALID_RANGE;
+    }
 
-      if(id < m_Ranges[i].m_First)
+    // good fit: any range of the rounded up size class is large enough
+    uint32_t fl, sl;
+    if(mappingSearch(count, fl, sl))
+    {
+      uint32_t slBits = m_SlBitmap[fl] & (~0u << sl);
+      if(!slBits)
       {
-        // Before current range, check if neighboring
-        if(end_id >= m_Ranges[i].m_First)
-        {
-          if(end_id != m_Ranges[i].m_First)
-            return false;  // Overlaps a range of free IDs, thus (at least partially) invalid IDs
-
-          // Neighbor id, check if neighboring previous range too
-          if(i > i0 && id - 1 == m_Ranges[i - 1].m_Last)
-          {
-            // Merge with previous range
-            m_Ranges[i - 1].m_Last = m_Ranges[i].m_Last;
-            destroyRange(i);
-          }
-          else
-          {
-            // Just grow range
-            m_Ranges[i].m_First = id;
-          }
-          return true;
-        }
-        else
+        uint32_t flBits = fl + 1 < 32 ? m_FlBitmap & (~0u << (fl + 1)) : 0;
+        if(flBits)
         {
-          // Non-neighbor id
-          if(i != i0)
-          {
-            // Cull upper half of list
-            i1 = i - 1;
-          }
-          else
-          {
-            // Found our position in the list, insert the deleted range here
-            insertRange(i);
-            m_Ranges[i].m_First = id;
-            m_Ranges[i].m_Last  = end_id - 1;
-            return true;
-          }
+          fl     = bitScanForward(flBits);
+          slBits = m_SlBitmap[fl];
         }
       }
-      else if(id > m_Ranges[i].m_Last)
+      if(slBits)
       {
-        // After current range, check if neighboring
-        if(id - 1 == m_Ranges[i].m_Last)
-        {
-          // Neighbor id, check if neighboring next range too
-          if(i < i1 && end_id == m_Ranges[i + 1].m_First)
-          {
-            // Merge with next range
-            m_Ranges[i].m_Last = m_Ranges[i + 1].m_Last;
-            destroyRange(i + 1);
-          }
-          else
-          {
-            // Just grow range
-            m_Ranges[i].m_Last += count;
-          }
-          return true;
-        }
-        else
-        {
-          // Non-neighbor id
-          if(i != i1)
-          {
-            // Cull bottom half of list
-            i0 = i + 1;
-          }
-          else
-          {
-            // Found our position in the list, insert the deleted range here
-            insertRange(i + 1);
-            m_Ranges[i + 1].m_First = id;
-            m_Ranges[i + 1].m_Last  = end_id - 1;
-            return true;
-          }
-        }
+        return m_Heads[fl][bitScanForward(slBits)];
       }
-      else
+    }
+
+    // The size class of count itself may hold a range that is large enough, only its head is tested to stay O(1).
+    // As in TLSF, this can fail while another range of that class would fit.
+    mappingInsert(count, fl, sl);
+    uint32_t index = (m_SlBitmap[fl] & (1u << sl)) ? m_Heads[fl][sl] : INVALID_RANGE;
+    return index != INVALID_RANGE && rangeCount(m_Ranges[index]) >= count ? index : INVALID_RANGE;
+  }
+
+  // lowest free ID below srcID where `count` IDs fit with (srcID - id) a multiple of stepCount
+  bool findRangeBelow(uint32_t srcID, uint32_t count, uint32_t stepCount, uint32_t& id) const
+  {
+    for(auto it = m_RangeByFirst.begin(); it != m_RangeByFirst.end() && it->first < srcID; ++it)
+    {
+      const Range&   range     = m_Ranges[it->second];
+      const uint32_t candidate = range.m_First + (srcID - range.m_First) % stepCount;
+      if(candidate < srcID && uint64_t(candidate) + count - 1 <= range.m_Last)
       {
-        // Inside a free block, not a valid ID
-        return false;
+        id = candidate;
+        return true;
       }
     }
+    return false;
   }
 
-  bool isRangeAvailable(uint32_t searchCount) const
+  // marks [id, id + count) as used, it must be within a single free range
+  void reserveRangeID(uint32_t id, uint32_t count)
   {
-    uint32_t i = 0;
-    do
+    auto it = m_RangeByFirst.upper_bound(id);
+    assert(it != m_RangeByFirst.begin());
+    const uint32_t index = std::prev(it)->second;
+    const Range    range = m_Ranges[index];
+    assert(range.m_First <= id && id + count - 1 <= range.m_Last);
+
+    if(range.m_First < id)
     {
-      uint32_t count = m_Ranges[i].m_Last - m_Ranges[i].m_First + 1;
-      if(count >= searchCount)
-        return true;
+      resizeRange(index, range.m_First, id - 1);
+    }
+    else
+    {
+      destroyRange(index);
+    }
+    if(id + count - 1 < range.m_Last)
+    {
+      insertRange(id + count, range.m_Last);
+    }
+  }
 
-      ++i;
-    } while(i < m_Count);
+public:
+  void rangeInit(const uint32_t max_id)
+  {
+    rangeDeinit();
+    // Start with a single range, from 0 to max allowed ID (specified)
+    insertRange(0, max_id);
+    m_MaxID = max_id;
+  }
 
-    return false;
+  void rangeDeinit()
+  {
+    m_Ranges.clear();
+    m_UnusedRanges.clear();
+    m_RangeByFirst.clear();
+    m_FlBitmap = 0;
+    std::fill_n(m_SlBitmap, FL_COUNT, 0u);
+    std::fill_n(&m_Heads[0][0], FL_COUNT * SL_COUNT, INVALID_RANGE);
   }
 
-  void printRanges() const
+  bool createID(uint32_t& id) { return createRangeID(id, 1); }
+
+  bool createRangeID(uint32_t& id, const uint32_t count)
   {
-    uint32_t i = 0;
-    for(;;)
+    uint32_t index = findRange(count);
+    if(index == INVALID_RANGE)
     {
-      if(m_Ranges[i].m_First < m_Ranges[i].m_Last)
-        printf("%u-%u", m_Ranges[i].m_First, m_Ranges[i].m_Last);
-      else if(m_Ranges[i].m_First == m_Ranges[i].m_Last)
-        printf("%u", m_Ranges[i].m_First);
-      else
-        printf("-");
-
-      ++i;
-      if(i >= m_Count)
-      {
-        printf("\n");
-        return;
-      }
+      // No range of free IDs was large enough to create the requested continuous ID sequence
+      return false;
+    }
 
-      printf(", ");
+    const Range range = m_Ranges[index];
+    id                = range.m_First;
+    if(count == rangeCount(range))
+    {
+      destroyRange(index);
+    }
+    else
+    {
+      resizeRange(index, range.m_First + count, range.m_Last);
     }
+    return true;
   }
 
-  void checkRanges() const
+  bool destroyID(const uint32_t id) { return destroyRangeID(id, 1); }
+
+  bool destroyRangeID(const uint32_t id, const uint32_t count)
   {
-    for(uint32_t i = 0; i < m_Count; i++)
+    const uint32_t end_id = id + count;
+
+    assert(end_id <= m_MaxID + 1);
+
+    // Free neighbors before and after the IDs
+    auto     next      = m_RangeByFirst.upper_bound(id);
+    uint32_t nextIndex = next != m_RangeByFirst.end() ? next->second : INVALID_RANGE;
+    uint32_t prevIndex = next != m_RangeByFirst.begin() ? std::prev(next)->second : INVALID_RANGE;
+
+    // Overlaps a range of free IDs, thus (at least partially) invalid IDs
+    if((prevIndex != INVALID_RANGE && m_Ranges[prevIndex].m_Last >= id)
+       || (nextIndex != INVALID_RANGE && m_Ranges[nextIndex].m_First < end_id))
     {
-      assert(m_Ranges[i].m_Last <= m_MaxID);
+      return false;
+    }
 
-      if(m_Ranges[i].m_First == m_Ranges[i].m_Last + 1)
-      {
-        continue;
-      }
-      assert(m_Ranges[i].m_First <= m_Ranges[i].m_Last);
-      assert(m_Ranges[i].m_First <= m_MaxID);
+    bool mergePrev = prevIndex != INVALID_RANGE && m_Ranges[prevIndex].m_Last + 1 == id;
+    bool mergeNext = nextIndex != INVALID_RANGE && m_Ranges[nextIndex].m_First == end_id;
+
+    if(mergePrev && mergeNext)
+    {
+      uint32_t last = m_Ranges[nextIndex].m_Last;
+      destroyRange(nextIndex);
+      resizeRange(prevIndex, m_Ranges[prevIndex].m_First, last);
     }
+    else if(mergePrev)
+    {
+      resizeRange(prevIndex, m_Ranges[prevIndex].m_First, end_id - 1);
+    }
+    else if(mergeNext)
+    {
+      resizeRange(nextIndex, id, m_Ranges[nextIndex].m_Last);
+    }
+    else
+    {
+      insertRange(id, end_id - 1);
+    }
+    return true;
   }
 
-  void insertRange(const uint32_t index)
+  bool isRangeAvailable(uint32_t searchCount) const { return findRange(searchCount) != INVALID_RANGE; }
+
+  void printRanges() const
   {
-    if(m_Count >= m_Capacity)
+    if(m_RangeByFirst.empty())
     {
-      m_Capacity += m_Capacity;
-      m_Ranges = (Range*)realloc(m_Ranges, m_Capacity * sizeof(Range));
-      assert(m_Ranges);  // Make sure reallocation succeeded
+      printf("-\n");
+      return;
     }
 
-    ::memmove(m_Ranges + index + 1, m_Ranges + index, (m_Count - index) * sizeof(Range));
-    ++m_Count;
+    bool first = true;
+    for(const auto& it : m_RangeByFirst)
+    {
+      const Range& range = m_Ranges[it.second];
+      if(!first)
+      {
+        printf(", ");
+      }
+      if(range.m_First < range.m_Last)
+        printf("%u-%u", range.m_First, range.m_Last);
+      else
+        printf("%u", range.m_First);
+      first = false;
+    }
+    printf("\n");
   }
 
-  void destroyRange(const uint32_t index)
+  void checkRanges() const
   {
-    --m_Count;
-    ::memmove(m_Ranges + index, m_Ranges + index + 1, (m_Count - index) * sizeof(Range));
+    uint32_t numLinked = 0;
+    for(uint32_t fl = 0; fl < FL_COUNT; fl++)
+    {
+      for(uint32_t sl = 0; sl < SL_COUNT; sl++)
+      {
+        assert((m_Heads[fl][sl] != INVALID_RANGE) == ((m_SlBitmap[fl] >> sl) & 1));
+        for(uint32_t index = m_Heads[fl][sl]; index != INVALID_RANGE; index = m_Ranges[index].m_NextFree)
+        {
+          uint32_t rangeFl, rangeSl;
+          mappingInsert(rangeCount(m_Ranges[index]), rangeFl, rangeSl);
+          assert(rangeFl == fl && rangeSl == sl);
+          numLinked++;
+        }
+      }
+      assert(((m_FlBitmap >> fl) & 1) == (m_SlBitmap[fl] != 0));
+    }
+    assert(numLinked == m_RangeByFirst.size());
+
+    const Range* prev = nullptr;
+    for(const auto& it : m_RangeByFirst)
+    {
+      const Range& range = m_Ranges[it.second];
+      assert(range.m_First == it.first);
+      assert(range.m_First <= range.m_Last);
+      assert(range.m_Last <= m_MaxID);
+      // free ranges are disjoint and never adjacent, they would have been merged
+      assert(!prev || prev->m_Last + 1 < range.m_First);
+      prev = &range;
+    }
+    (void)numLinked;
+    (void)prev;
   }
 };
 
+template <uint32_t GRANULARITY = 256>
+using TRangeAllocator64 = TRangeAllocator<GRANULARITY, uint64_t>;
+
 }  // namespace nvh
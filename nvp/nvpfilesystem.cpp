@@ -22,10 +22,82 @@
 #include <unordered_map>
 #include <array>
 #include <cassert>
+#include <filesystem>
 #include <string.h>
 
 using namespace nvp;
 
+void FileSystemEventQueue::push(const FileSystemMonitor::EventData& ev, Clock::time_point now)
+{
+  if(m_events.empty())
+  {
+    m_firstEvent = now;
+  }
+
+  auto key = std::make_pair(ev.path, ev.userPtr);
+  auto it  = m_eventIndex.find(key);
+  if(it == m_eventIndex.end())
+  {
+    m_eventIndex.emplace(std::move(key), m_events.size());
+    m_events.push_back(FileSystemMonitor::PathEvents{ev.path, uint32_t(ev.event), ev.userPtr});
+  }
+  else
+  {
+    // Keep the final state of the path: the file exists again after a delete (e.g. an editor saving
+    // through delete + create), or is gone after a delete
+    uint32_t& events = m_events[it->second].events;
+    if(ev.event & FileSystemMonitor::FSM_DELETE)
+    {
+      events &= ~uint32_t(FileSystemMonitor::FSM_CREATE | FileSystemMonitor::FSM_MODIFY);
+    }
+    else
+    {
+      events &= ~uint32_t(FileSystemMonitor::FSM_DELETE);
+    }
+    events |= ev.event;
+  }
+  m_lastEvent = now;
+}
+
+FileSystemEventQueue::Duration FileSystemEventQueue::timeUntilReady(Clock::time_point now) const
+{
+  if(m_events.empty())
+    return Duration::max();
+
+  auto sinceLast  = std::chrono::duration_cast<Duration>(now - m_lastEvent);
+  auto sinceFirst = std::chrono::duration_cast<Duration>(now - m_firstEvent);
+  if(sinceLast >= m_settleWindow || sinceFirst >= m_maxLatency)
+    return Duration::zero();
+  return std::min(m_settleWindow - sinceLast, m_maxLatency - sinceFirst);
+}
+
+std::vector<FileSystemMonitor::PathEvents> FileSystemEventQueue::popReady(Clock::time_point now)
+{
+  std::vector<FileSystemMonitor::PathEvents> batch;
+  if(!m_events.empty() && timeUntilReady(now) == Duration::zero())
+  {
+    batch.swap(m_events);
+    m_eventIndex.clear();
+  }
+  return batch;
+}
+
+void FileSystemEventQueue::erase(void* userPtr)
+{
+  auto removed = std::remove_if(m_events.begin(), m_events.end(),
+                                [&](const FileSystemMonitor::PathEvents& ev) { return ev.userPtr == userPtr; });
+  if(removed == m_events.end())
+    return;
+  m_events.erase(removed, m_events.end());
+
+  // the remaining events moved
+  m_eventIndex.clear();
+  for(size_t i = 0; i < m_events.size(); i++)
+  {
+    m_eventIndex.emplace(std::make_pair(m_events[i].path, m_events[i].userPtr), i);
+  }
+}
+
 #if defined(_WIN32)
 #include <locale>
 #include <filesystem>
@@ -348,12 +420,13 @@ class FileSystemMonitorWindows : public FileSystemMonitor
     }
   }
 
-  virtual bool checkEvents(const Callback& callback) override
+  virtual bool checkEvents(const Callback& callback, int timeoutMs) override
   {
     DWORD       bytesTransferred = 0;  // FILE_NOTIFY_EXTENDED_INFORMATION struct size
     ULONG_PTR   userObject       = 0;
     OVERLAPPED* overlapped       = NULL;
-    if(GetQueuedCompletionStatus(m_ioCompletionPort, &bytesTransferred, &userObject, &overlapped, INFINITE) == FALSE)
+    DWORD       timeout          = timeoutMs < 0 ? INFINITE : DWORD(timeoutMs);
+    if(GetQueuedCompletionStatus(m_ioCompletionPort, &bytesTransferred, &userObject, &overlapped, timeout) == FALSE)
     {
       return true;
     }
@@ -445,6 +518,7 @@ struct InotifyPath
   {
     void*    userPtr;
     uint32_t inotifyMask;
+    bool     recursive;  // new subdirectories get watched as well
   };
 
   std::unordered_map<FileSystemMonitor::PathID, MonitorInstance> instances;
@@ -456,62 +530,62 @@ class FileSystemMonitorInotify : public FileSystemMonitor
 
   virtual int add(const std::string& path, uint32_t eventMask, void* userPtr) override
   {
-    // Translate the event mask
+    // Translate the event mask. Moves are reported as create/delete, editors often save by renaming a temporary file.
     uint32_t inotifyMask = 0;
     if(eventMask & FSM_CREATE)
-      inotifyMask |= IN_CREATE;
+      inotifyMask |= IN_CREATE | IN_MOVED_TO;
     if(eventMask & FSM_MODIFY)
       inotifyMask |= IN_MODIFY;
     if(eventMask & FSM_DELETE)
-      inotifyMask |= IN_DELETE;
+      inotifyMask |= IN_DELETE | IN_MOVED_FROM;
 
     assert(inotifyMask);
     if(!inotifyMask)
       return INVALID_PATH_ID;
 
-    int watchDescriptor = inotify_add_watch(m_inotifyFd, path.c_str(), inotifyMask);
-    if(watchDescriptor == -1)
+    // inotify watches are not recursive, every subdirectory needs its own watch
+    std::error_code ec;
+    bool            recursive = (eventMask & FSM_RECURSIVE) && std::filesystem::is_directory(path, ec);
+
+    auto                         id = nextPathID();
+    InotifyPath::MonitorInstance instance{userPtr, inotifyMask, recursive};
+    if(!addWatch(path, id, instance))
       return INVALID_PATH_ID;
 
-    auto id = nextPathID();
     //LOGI("FileSystemMonitor %i added %i %s\n", m_inotifyFd, id, path.c_str());
-
-    auto it = m_paths.find(watchDescriptor);
-    if(it != m_paths.end())
+    if(recursive)
     {
-      // Path has already been added before. May need to combine the mask and re-add.
-      auto allBits = it->second.inotifyMaskAll | inotifyMask;
-      if(allBits != inotifyMask)
-        (void)inotify_add_watch(m_inotifyFd, path.c_str(), allBits);
-      it->second.inotifyMaskAll = allBits;
-
-      it->second.instances[id] = {userPtr, inotifyMask};
+      addSubdirectoryWatches(path, id, instance, nullptr);
     }
-    else
-    {
-      m_paths[watchDescriptor] = InotifyPath{path, inotifyMask, {{id, InotifyPath::MonitorInstance{userPtr, inotifyMask}}}};
-    }
-    m_idToWatchDescriptor[id] = watchDescriptor;
     return id;
   }
 
   virtual void remove(const PathID& pathID) override
   {
-    int   watchDescriptor = m_idToWatchDescriptor[pathID];
-    auto& path            = m_paths[watchDescriptor];
-    //LOGI("FileSystemMonitor %i removed %i %s\n", m_inotifyFd, pathID, path.path.c_str());
-    m_idToWatchDescriptor.erase(pathID);
-    path.instances.erase(pathID);
-    if(path.instances.empty())
+    auto idIt = m_idToWatchDescriptors.find(pathID);
+    if(idIt == m_idToWatchDescriptors.end())
+      return;
+
+    for(int watchDescriptor : idIt->second)
     {
-      //LOGI("FileSystemMonitor %i removing inotify watch\n", m_inotifyFd);
-      int result = inotify_rm_watch(m_inotifyFd, watchDescriptor);
-      assert(result == 0);
-      m_paths.erase(watchDescriptor);
+      auto pathIt = m_paths.find(watchDescriptor);
+      if(pathIt == m_paths.end())
+        continue;
+
+      //LOGI("FileSystemMonitor %i removed %i %s\n", m_inotifyFd, pathID, pathIt->second.path.c_str());
+      pathIt->second.instances.erase(pathID);
+      if(pathIt->second.instances.empty())
+      {
+        // May fail if the directory was deleted and the IN_IGNORED event is still queued
+        //LOGI("FileSystemMonitor %i removing inotify watch\n", m_inotifyFd);
+        (void)inotify_rm_watch(m_inotifyFd, watchDescriptor);
+        m_paths.erase(pathIt);
+      }
     }
+    m_idToWatchDescriptors.erase(idIt);
   }
 
-  virtual bool checkEvents(const Callback& callback) override
+  virtual bool checkEvents(const Callback& callback, int timeoutMs) override
   {
     struct pollfd fds[]{
         {m_inotifyFd, POLLIN},
@@ -519,11 +593,10 @@ class FileSystemMonitorInotify : public FileSystemMonitor
     };
     const auto nfds = sizeof(fds) / sizeof(fds[0]);
 
-    // Block until there are inotify events, or cancel() is called.
+    // Block until there are inotify events, cancel() is called or the timeout passed.
     //LOGI("FileSystemMonitor %i poll enter\n", m_inotifyFd);
-    int fdsReady = poll(fds, nfds, -1);
+    int fdsReady = poll(fds, nfds, timeoutMs);
     //LOGI("FileSystemMonitor %i poll exit\n", m_inotifyFd);
-    assert(fdsReady >= 0);
     if(fdsReady == 0)
     {
       return true;
@@ -559,6 +632,18 @@ class FileSystemMonitorInotify : public FileSystemMonitor
     size_t bytesRead = read(m_inotifyFd, readFrom, bytesLeft);
     m_eventBufferBytes += bytesRead;
 
+    // Subdirectories created in recursively watched directories, watched after the events are processed
+    struct NewDirectory
+    {
+      std::string                  path;
+      PathID                       id;
+      InotifyPath::MonitorInstance instance;
+    };
+    std::vector<NewDirectory> newDirectories;
+
+    // Subdirectories moved out of recursively watched directories, their watches would keep reporting the old paths
+    std::vector<std::pair<std::string, PathID>> movedDirectories;
+
     // Process whole events in the buffer
     size_t offset = 0;
     while(offset + sizeof(inotify_event) <= m_eventBufferBytes)
@@ -570,30 +655,55 @@ class FileSystemMonitorInotify : public FileSystemMonitor
         // Incomplete event read() into buffer
         break;
       }
+      offset += eventSize;
 
       // If remove() is called, there may still be queued events. Ignore any for
       // unknown watch descriptors. IN_Q_OVERFLOW can also generate wd == -1.
       auto pathIt = m_paths.find(event.wd);
-      if(pathIt != m_paths.end())
+      if(pathIt == m_paths.end())
+        continue;
+
+      // The watch was removed by the kernel, e.g. the directory was deleted
+      if(event.mask & IN_IGNORED)
       {
-        const auto& path = pathIt->second;
-        for(const auto& instanceIt : path.instances)
+        for(const auto& instanceIt : pathIt->second.instances)
         {
-          const auto& instance   = instanceIt.second;
-          auto        reportMask = event.mask & instance.inotifyMask;
-
-          // inotify only gives a name when watching directories, not files.
-          auto filename = event.len ? std::string(event.name) : path.path;
-          LOGI("FileSystemMonitor %i event (mask %x) for '%s'\n", m_inotifyFd, reportMask, filename.c_str());
-          if(reportMask & IN_CREATE)
-            callback(EventData{FSM_CREATE, filename, instance.userPtr});
-          if(reportMask & IN_MODIFY)
-            callback(EventData{FSM_MODIFY, filename, instance.userPtr});
-          if(reportMask & IN_DELETE)
-            callback(EventData{FSM_DELETE, filename, instance.userPtr});
+          auto& watchDescriptors = m_idToWatchDescriptors[instanceIt.first];
+          watchDescriptors.erase(std::remove(watchDescriptors.begin(), watchDescriptors.end(), event.wd), watchDescriptors.end());
         }
+        m_paths.erase(pathIt);
+        continue;
+      }
+
+      const auto& path = pathIt->second;
+
+      // inotify only gives a name when watching directories, not files.
+      auto filename = event.len ? path.path + "/" + std::string(event.name) : path.path;
+      for(const auto& instanceIt : path.instances)
+      {
+        const auto& instance   = instanceIt.second;
+        auto        reportMask = event.mask & instance.inotifyMask;
+
+        if(instance.recursive && (event.mask & IN_ISDIR) && (event.mask & (IN_CREATE | IN_MOVED_TO)))
+        {
+          newDirectories.push_back({filename, instanceIt.first, instance});
+        }
+        if(instance.recursive && (event.mask & IN_ISDIR) && (event.mask & IN_MOVED_FROM))
+        {
+          movedDirectories.push_back({filename, instanceIt.first});
+        }
+
+        if(!reportMask)
+          continue;
+
+        LOGI("FileSystemMonitor %i event (mask %x) for '%s'\n", m_inotifyFd, reportMask, filename.c_str());
+        if(reportMask & (IN_CREATE | IN_MOVED_TO))
+          callback(EventData{FSM_CREATE, filename, instance.userPtr});
+        if(reportMask & IN_MODIFY)
+          callback(EventData{FSM_MODIFY, filename, instance.userPtr});
+        if(reportMask & (IN_DELETE | IN_MOVED_FROM))
+          callback(EventData{FSM_DELETE, filename, instance.userPtr});
       }
-      offset += eventSize;
     }
 
     // Shift any remainder to the start of the buffer
@@ -602,6 +712,20 @@ class FileSystemMonitorInotify : public FileSystemMonitor
     {
       memmove(m_eventBuffer.data(), m_eventBuffer.data() + offset, m_eventBufferBytes);
     }
+
+    // Removed first, a directory renamed within the tree keeps its watch descriptor and is added again below
+    for(const auto& [directory, id] : movedDirectories)
+    {
+      removeSubtreeWatches(directory, id);
+    }
+    for(const NewDirectory& directory : newDirectories)
+    {
+      if(addWatch(directory.path, directory.id, directory.instance))
+      {
+        // Files may have been created before the watch existed, e.g. by a git checkout
+        addSubdirectoryWatches(directory.path, directory.id, directory.instance, &callback);
+      }
+    }
     return true;
   }
 
@@ -612,6 +736,86 @@ class FileSystemMonitorInotify : public FileSystemMonitor
     assert(numBytes == sizeof(val));
   }
 
+  // Adds the path to the watch of the inotify path, creating it if needed
+  bool addWatch(const std::string& path, PathID id, const InotifyPath::MonitorInstance& instance)
+  {
+    // Recursive instances need to know about new and moved subdirectories
+    uint32_t watchMask = instance.inotifyMask | (instance.recursive ? IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM : 0);
+
+    int watchDescriptor = inotify_add_watch(m_inotifyFd, path.c_str(), watchMask | IN_MASK_ADD);
+    if(watchDescriptor == -1)
+      return false;
+
+    auto it = m_paths.find(watchDescriptor);
+    if(it != m_paths.end())
+    {
+      // Path has already been added before, IN_MASK_ADD combined the masks.
+      it->second.inotifyMaskAll |= watchMask;
+      if(it->second.instances.count(id))
+        return true;
+      it->second.instances[id] = instance;
+    }
+    else
+    {
+      m_paths[watchDescriptor] = InotifyPath{path, watchMask, {{id, instance}}};
+    }
+    m_idToWatchDescriptors[id].push_back(watchDescriptor);
+    return true;
+  }
+
+  // Watches all subdirectories. If `callback` is given, existing files are reported as created.
+  void addSubdirectoryWatches(const std::string& path, PathID id, const InotifyPath::MonitorInstance& instance, const Callback* callback)
+  {
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    for(fs::recursive_directory_iterator it(path, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end;
+        it.increment(ec))
+    {
+      // Symlinks are not followed, neither watched nor reported, even if they point to a directory
+      if(it->is_symlink(ec))
+      {
+        continue;
+      }
+      if(it->is_directory(ec))
+      {
+        addWatch(it->path().string(), id, instance);
+      }
+      else if(callback && (instance.inotifyMask & IN_CREATE))
+      {
+        (*callback)(EventData{FSM_CREATE, it->path().string(), instance.userPtr});
+      }
+    }
+  }
+
+  // Removes the watches of the instance for the directory and its subdirectories
+  void removeSubtreeWatches(const std::string& path, PathID id)
+  {
+    auto idIt = m_idToWatchDescriptors.find(id);
+    if(idIt == m_idToWatchDescriptors.end())
+      return;
+
+    std::vector<int>& watchDescriptors = idIt->second;
+    for(auto wdIt = watchDescriptors.begin(); wdIt != watchDescriptors.end();)
+    {
+      auto pathIt = m_paths.find(*wdIt);
+      if(pathIt == m_paths.end()
+         || (pathIt->second.path != path && pathIt->second.path.compare(0, path.size() + 1, path + "/") != 0))
+      {
+        ++wdIt;
+        continue;
+      }
+
+      pathIt->second.instances.erase(id);
+      if(pathIt->second.instances.empty())
+      {
+        (void)inotify_rm_watch(m_inotifyFd, *wdIt);
+        m_paths.erase(pathIt);
+      }
+      wdIt = watchDescriptors.erase(wdIt);
+    }
+  }
+
   FileSystemMonitorInotify()
   {
     m_inotifyFd = inotify_init();
@@ -637,8 +841,8 @@ class FileSystemMonitorInotify : public FileSystemMonitor
   /** Monitored paths, indexed by the inotify watch descriptor */
   std::unordered_map<int, InotifyPath> m_paths;
 
-  /* Path instance lookup, to provide multiple events for the same path */
-  std::unordered_map<PathID, int> m_idToWatchDescriptor;
+  /* Path instance lookup, to provide multiple events for the same path. Recursive paths have one watch per directory. */
+  std::unordered_map<PathID, std::vector<int>> m_idToWatchDescriptors;
 };
 #endif
 
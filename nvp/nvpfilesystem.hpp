@@ -19,14 +19,18 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <nvh/nvprint.hpp>
 #include <nvh/threading.hpp>
+#include <chrono>
 #include <functional>
+#include <map>
 #include <thread>
 #include <mutex>
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace nvp {
 
@@ -38,6 +42,13 @@ namespace nvp {
   This cross-platform wrapper does not create any threads, but is designed for
   it. checkEvents() will block until either an event is generated, or cancel()
   is called. See ModifiedFilesMonitor for an example.
+
+  Event paths are the monitored path, or for directories the monitored
+  directory joined with the path of the changed file.
+
+  Adding a directory with FSM_RECURSIVE also watches all its subdirectories,
+  including ones created later. Windows directory watches always include
+  subdirectories.
 @DOC_END */
 class FileSystemMonitor
 {
@@ -52,6 +63,8 @@ public:
     FSM_CREATE = (1 << 0),
     FSM_DELETE = (1 << 1),
     FSM_MODIFY = (1 << 2),
+    // not an event, add() flag to watch the subdirectories of a directory as well
+    FSM_RECURSIVE = (1 << 3),
   };
 
   struct EventData
@@ -61,9 +74,19 @@ public:
     void*             userPtr;
   };
 
-  using CallbackType = void(const EventData&);
-  using Callback     = std::function<CallbackType>;
-  using PathID       = int;
+  // All events of one path during a burst, see FileSystemEventQueue
+  struct PathEvents
+  {
+    std::string path;
+    uint32_t    events;  // Event bits
+    void*       userPtr;
+  };
+
+  using CallbackType      = void(const EventData&);
+  using Callback          = std::function<CallbackType>;
+  using BatchCallbackType = void(const std::vector<PathEvents>&);
+  using BatchCallback     = std::function<BatchCallbackType>;
+  using PathID            = int;
 
   static const PathID INVALID_PATH_ID = 0;
 
@@ -83,12 +106,13 @@ public:
    *  It is not safe to call remove() at the same time as checkEvents(). Call cancel() first. */
   virtual void remove(const PathID& pathID) = 0;
 
-  /** Process the event queue, blocking until there is another event or cancel() is called.
+  /** Process the event queue, blocking until there is another event, cancel() is called or timeoutMs milliseconds
+   *  passed (-1 waits indefinitely).
    *
    *  \return True if the thread should keep looping, i.e. there are no errors and cancel() has not been called. It is
    * expected this is called in a loop by an event thread.
    */
-  virtual bool checkEvents(const Callback& callback) = 0;
+  virtual bool checkEvents(const Callback& callback, int timeoutMs = -1) = 0;
 
   /** Abort checkEvents, if it is currently being called. */
   virtual void cancel() = 0;
@@ -107,20 +131,83 @@ private:
   PathID m_nextPathID = 0;
 };
 
+/** @DOC_START
+  # class nvp::FileSystemEventQueue
+
+  Coalesces the bursts of events caused by an editor save or a git checkout.
+
+  Events are merged per path and userPtr, keeping the order in which the
+  paths first changed. The merged events describe the final state of the
+  path: a create or modify after a delete drops the delete, a delete drops
+  the previous create and modify. So a path has at most one of
+  FSM_CREATE and FSM_DELETE.
+
+  The batch is ready once no event arrived for the settle window, every new
+  event restarts it. With a max latency, the batch is ready at the latest
+  that long after its first event, even if events keep arriving.
+@DOC_END */
+class FileSystemEventQueue
+{
+public:
+  using Clock    = nvh::DefaultDelayClock;
+  using Duration = nvh::DefaultDelayDuration;
+
+  FileSystemEventQueue(const Duration& settleWindow = Duration::zero(), const Duration& maxLatency = Duration::max())
+      : m_settleWindow(settleWindow)
+      , m_maxLatency(maxLatency)
+  {
+  }
+
+  void push(const FileSystemMonitor::EventData& ev, Clock::time_point now = Clock::now());
+
+  bool            empty() const { return m_events.empty(); }
+  const Duration& getSettleWindow() const { return m_settleWindow; }
+  const Duration& getMaxLatency() const { return m_maxLatency; }
+  // zero once the batch is ready, Duration::max() if the queue is empty
+  Duration timeUntilReady(Clock::time_point now = Clock::now()) const;
+  // returns the batch and clears the queue if it is ready, otherwise nothing
+  std::vector<FileSystemMonitor::PathEvents> popReady(Clock::time_point now = Clock::now());
+  // drops the pending events of a userPtr, e.g. before the object it points to is destroyed
+  void erase(void* userPtr);
+
+private:
+  Duration                                        m_settleWindow;
+  Duration                                        m_maxLatency;
+  Clock::time_point                               m_firstEvent;  // of the pending batch
+  Clock::time_point                               m_lastEvent;
+  std::vector<FileSystemMonitor::PathEvents>      m_events;
+  std::map<std::pair<std::string, void*>, size_t> m_eventIndex;  // into m_events
+};
+
 /** @DOC_START
   # class nvp::FSMRunner
 
   Adds a thread to nvp::FileSystemMonitor that repeatedly calls
   nvp::FileSystemMonitor::checkEvents().
+
+  With a BatchCallback, events are collected in a nvp::FileSystemEventQueue
+  and delivered as one batch after the settle window, or after the max
+  latency if events keep arriving.
 @DOC_END */
 class FSMRunner
 {
 public:
+  using Clock    = FileSystemEventQueue::Clock;
+  using Duration = FileSystemEventQueue::Duration;
+
   FSMRunner(const FileSystemMonitor::Callback& callback)
       : m_callback(callback)
   {
     m_monitor = FileSystemMonitor::create();
   }
+  FSMRunner(const FileSystemMonitor::BatchCallback& batchCallback,
+            const Duration&                         settleWindow,
+            const Duration&                         maxLatency = Duration::max())
+      : m_batchCallback(batchCallback)
+      , m_queue(settleWindow, maxLatency)
+  {
+    m_monitor = FileSystemMonitor::create();
+  }
   ~FSMRunner()
   {
     stop();
@@ -142,20 +229,65 @@ protected:
     }
   }
 
+  // must be called while stopped, the runner must not deliver events to a destroyed userPtr
+  void eraseQueuedEvents(void* userPtr)
+  {
+    assert(!m_thread.joinable());
+    m_queue.erase(userPtr);
+  }
+
+  // must be called before start()
+  void setBatchCallback(const FileSystemMonitor::BatchCallback& batchCallback,
+                        const Duration&                         settleWindow,
+                        const Duration&                         maxLatency = Duration::max())
+  {
+    assert(!m_thread.joinable());
+    m_batchCallback = batchCallback;
+    m_queue         = FileSystemEventQueue(settleWindow, maxLatency);
+  }
+
   FileSystemMonitor* m_monitor;
 
 private:
   void entrypoint()
   {
+    if(!m_batchCallback)
+    {
+      for(;;)
+      {
+        if(!m_monitor->checkEvents(m_callback))
+          break;
+      }
+      return;
+    }
+
+    // The queue is kept across stop()/start(), pending events are delivered after a restart.
+    // Path sets erase their events while the thread is stopped, before they get destroyed.
+    FileSystemMonitor::Callback push = [this](const FileSystemMonitor::EventData& ev) { m_queue.push(ev); };
+    // The timeout is bounded by the max latency, a steady stream of events does not hold the batch back.
     for(;;)
     {
-      if(!m_monitor->checkEvents(m_callback))
+      int timeoutMs = -1;
+      if(!m_queue.empty())
+      {
+        timeoutMs = int(std::chrono::ceil<std::chrono::milliseconds>(m_queue.timeUntilReady()).count());
+      }
+
+      if(!m_monitor->checkEvents(push, timeoutMs))
         break;
+
+      std::vector<FileSystemMonitor::PathEvents> batch = m_queue.popReady();
+      if(!batch.empty())
+      {
+        m_batchCallback(batch);
+      }
     }
   }
 
-  std::thread                 m_thread;
-  FileSystemMonitor::Callback m_callback;
+  std::thread                      m_thread;
+  FileSystemMonitor::Callback      m_callback;
+  FileSystemMonitor::BatchCallback m_batchCallback;
+  FileSystemEventQueue             m_queue;
 };
 
 /** @DOC_START
@@ -166,6 +298,12 @@ private:
   Make sure PathSetCallback objects returned by add() do not outlive the FSMCallbacks.
   Be careful not to destroy a PathCallback during a callback.
 
+  If a settle window is given at construction, the events are coalesced
+  (see nvp::FileSystemEventQueue), and delivered at the latest after the
+  optional max latency. Path sets added with a BatchCallback then
+  get one call per burst with all their changed paths; the others get one
+  call per path and event kind.
+
   Example:
   ```cpp
   FSMCallbacks callbacks;
@@ -182,14 +320,20 @@ private:
 
   // When callbackFile1 goes out of scope, file1.txt stops being monitored
   callbackFile1.reset()
+
+  // Reload shaders once per burst of changes
+  FSMCallbacks batchedCallbacks(std::chrono::milliseconds(100));
+  auto callbackShaders = batchedCallbacks.add(std::vector<std::string>{"shaders"},
+                                              nvp::FileSystemMonitor::FSM_MODIFY | nvp::FileSystemMonitor::FSM_CREATE
+                                                  | nvp::FileSystemMonitor::FSM_RECURSIVE,
+                                              [this](const std::vector<nvp::FileSystemMonitor::PathEvents>& events) {
+                                                // Reload the shaders using the changed files
+                                              });
   ```
 @DOC_END */
 class FSMCallbacks : public FSMRunner
 {
 public:
-  using Clock    = nvh::DefaultDelayClock;
-  using Duration = nvh::DefaultDelayDuration;
-
   struct PathSetCallbackData
   {
     FSMCallbacks&                          owner;
@@ -197,6 +341,7 @@ public:
     FileSystemMonitor::Callback            callback;
     const Duration                         consolidateDelay;
     nvh::delayed_call<Clock, Duration>     delayedCall;
+    FileSystemMonitor::BatchCallback       batchCallback;  // replaces callback if set
     ~PathSetCallbackData()
     {
       if(!ids.empty())
@@ -205,6 +350,7 @@ public:
         owner.stop();
         for(const auto& id : ids)
           owner.m_monitor->remove(id);
+        owner.eraseQueuedEvents(this);
         owner.start();
       }
     }
@@ -212,9 +358,13 @@ public:
 
   using PathSetCallback = std::shared_ptr<PathSetCallbackData>;
 
-  FSMCallbacks()
+  FSMCallbacks(const Duration& settleWindow = Duration::zero(), const Duration& maxLatency = Duration::max())
       : FSMRunner(&FSMCallbacks::callback)
   {
+    if(settleWindow != Duration::zero())
+    {
+      setBatchCallback(&FSMCallbacks::batchCallback, settleWindow, maxLatency);
+    }
   }
 
   template <class List>
@@ -222,11 +372,26 @@ public:
                       uint32_t                           eventMask,
                       const FileSystemMonitor::Callback& callback,
                       const Duration&                    consolidateDelay = Duration::zero())
+  {
+    return addPathSet(pathList, eventMask,
+                      PathSetCallback{new PathSetCallbackData{*this, {}, callback, consolidateDelay, {}, {}}});
+  }
+
+  // Without a settle window, every batch holds a single event
+  template <class List>
+  PathSetCallback add(const List& pathList, uint32_t eventMask, const FileSystemMonitor::BatchCallback& batchCallback)
+  {
+    return addPathSet(pathList, eventMask,
+                      PathSetCallback{new PathSetCallbackData{*this, {}, {}, Duration::zero(), {}, batchCallback}});
+  }
+
+private:
+  template <class List>
+  PathSetCallback addPathSet(const List& pathList, uint32_t eventMask, PathSetCallback pathSetCallback)
   {
     std::lock_guard<std::mutex> lock(m_monitorMutex);
     stop();
 
-    PathSetCallback pathSetCallback{new PathSetCallbackData{*this, {}, callback, consolidateDelay}};
     for(const auto& path : pathList)
     {
       auto pathID = m_monitor->add(path, eventMask, pathSetCallback.get());
@@ -244,12 +409,15 @@ public:
     return pathSetCallback;
   }
 
-private:
   static void callback(const nvp::FileSystemMonitor::EventData& ev)
   {
     auto cbData = reinterpret_cast<PathSetCallbackData*>(ev.userPtr);
 
-    if(cbData->consolidateDelay != Duration::zero())
+    if(cbData->batchCallback)
+    {
+      cbData->batchCallback({FileSystemMonitor::PathEvents{ev.path, uint32_t(ev.event), ev.userPtr}});
+    }
+    else if(cbData->consolidateDelay != Duration::zero())
     {
       // This may block if the previous delayed call started and is still running. Rather than do anything clever here,
       // it is left to the user to layer on functionality and make sure this callback loop is not blocked.
@@ -260,6 +428,41 @@ private:
       cbData->callback(ev);
   }
 
+  static void batchCallback(const std::vector<FileSystemMonitor::PathEvents>& events)
+  {
+    // Split by path set, keeping the order of the events
+    std::vector<std::pair<void*, std::vector<FileSystemMonitor::PathEvents>>> pathSets;
+    for(const auto& pathEvents : events)
+    {
+      auto it = std::find_if(pathSets.begin(), pathSets.end(), [&](const auto& p) { return p.first == pathEvents.userPtr; });
+      if(it == pathSets.end())
+      {
+        it = pathSets.insert(pathSets.end(), {pathEvents.userPtr, {}});
+      }
+      it->second.push_back(pathEvents);
+    }
+
+    for(const auto& pathSet : pathSets)
+    {
+      auto cbData = reinterpret_cast<PathSetCallbackData*>(pathSet.first);
+      if(cbData->batchCallback)
+      {
+        cbData->batchCallback(pathSet.second);
+        continue;
+      }
+
+      // The merged events hold the final state of each path, create and delete are never both set
+      for(const auto& pathEvents : pathSet.second)
+      {
+        for(auto event : {FileSystemMonitor::FSM_CREATE, FileSystemMonitor::FSM_MODIFY, FileSystemMonitor::FSM_DELETE})
+        {
+          if(pathEvents.events & event)
+            callback(FileSystemMonitor::EventData{event, pathEvents.path, pathEvents.userPtr});
+        }
+      }
+    }
+  }
+
   // Protect against various threads racing FSMRunner::stop()/start() calls during add() and ~PathSetCallbackData().
   std::mutex m_monitorMutex;
 };
@@ -282,6 +485,12 @@ private:
     g_reloadShaders = true;
   };
   auto fileMonitor = std::make_unique<nvp::ModifiedFilesMonitor>(dirs, callback);
+
+  // or, one call per burst of changes, watching subdirectories too
+  nvp::FileSystemMonitor::BatchCallback batchCallback = [](const std::vector<nvp::FileSystemMonitor::PathEvents>& events){
+    g_reloadShaders = true;
+  };
+  auto batchMonitor = std::make_unique<nvp::ModifiedFilesMonitor>(dirs, batchCallback, std::chrono::milliseconds(100), true);
   ```
 @DOC_END */
 class ModifiedFilesMonitor : public FSMRunner
@@ -290,15 +499,34 @@ public:
   template <class List>
   ModifiedFilesMonitor(const List& paths, const FileSystemMonitor::Callback& callback)
       : FSMRunner(callback)
+  {
+    addPaths(paths, 0);
+    start();
+  }
+
+  template <class List>
+  ModifiedFilesMonitor(const List&                             paths,
+                       const FileSystemMonitor::BatchCallback& batchCallback,
+                       const Duration&                         settleWindow,
+                       bool                                    recursive  = false,
+                       const Duration&                         maxLatency = Duration::max())
+      : FSMRunner(batchCallback, settleWindow, maxLatency)
+  {
+    addPaths(paths, recursive ? FileSystemMonitor::FSM_RECURSIVE : 0);
+    start();
+  }
+
+private:
+  template <class List>
+  void addPaths(const List& paths, uint32_t flags)
   {
     for(const auto& path : paths)
     {
-      if(m_monitor->add(path, FileSystemMonitor::FSM_MODIFY | FileSystemMonitor::FSM_CREATE) == FileSystemMonitor::INVALID_PATH_ID)
+      if(m_monitor->add(path, FileSystemMonitor::FSM_MODIFY | FileSystemMonitor::FSM_CREATE | flags) == FileSystemMonitor::INVALID_PATH_ID)
       {
         LOGE("Failed to watch '%s' for changes\n", path.c_str());
       }
     }
-    start();
   }
 };
 
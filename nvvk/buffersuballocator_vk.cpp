@@ -172,6 +172,50 @@ void BufferSubAllocator::subFree(Handle sub)
   }
 }
 
+VkDeviceSize BufferSubAllocator::defragmentBlock(uint32_t                     blockIndex,
+                                                 std::vector<Handle>&         handles,
+                                                 const std::vector<uint32_t>& alignments,
+                                                 std::vector<VkBufferCopy>&   copies,
+                                                 VkDeviceSize                 maxMoveSize)
+{
+  using BlockRange = decltype(Block::range);
+
+  copies.clear();
+
+  Block& block = getBlock(blockIndex);
+  if(!block.buffer || block.isDedicated)
+  {
+    return 0;
+  }
+
+  assert(alignments.empty() || alignments.size() == handles.size());
+
+  std::vector<BlockRange::DefragRange> ranges;
+  ranges.reserve(handles.size());
+  for(size_t i = 0; i < handles.size(); i++)
+  {
+    const Handle& handle = handles[i];
+    assert(handle.getBlockIndex() == blockIndex && !handle.isDedicated());
+    uint32_t      alignment = alignments.empty() ? BASE_ALIGNMENT : alignments[i];
+    ranges.push_back({uint32_t(handle.getOffset()), uint32_t(handle.getSize()), alignment});
+  }
+
+  std::vector<BlockRange::DefragMove> moves;
+  uint32_t maxMoveSize32 = uint32_t(std::min(maxMoveSize, VkDeviceSize(~uint32_t(0))));
+  uint32_t moved         = block.range.defragment(ranges, moves, maxMoveSize32);
+
+  for(const BlockRange::DefragMove& move : moves)
+  {
+    bool valid = handles[move.index].setup(blockIndex, move.dstOffset, move.size, false);
+    assert(valid);
+    (void)valid;
+
+    copies.push_back({move.srcOffset, move.dstOffset, move.size});
+  }
+
+  return moved;
+}
+
 float BufferSubAllocator::getUtilization(VkDeviceSize& allocatedSize, VkDeviceSize& usedSize) const
 {
   allocatedSize = m_allocatedSize;
@@ -216,6 +216,18 @@ public:
   uint32_t getSubBlockIndex(Handle handle) const { return handle.getBlockIndex(); }
   VkBuffer getBlockBuffer(uint32_t blockIndex) const { return m_blocks[blockIndex].buffer; }
 
+  // One incremental defragmentation pass over a regular block: the sub-allocations move towards
+  // lower offsets, at most maxMoveSize bytes. `handles` must contain all live sub-allocations of the
+  // block, with their `alignments` if custom ones were used (empty for BASE_ALIGNMENT).
+  // The moved handles are updated in place, and `copies` gets one region per move within
+  // getBlockBuffer(blockIndex). The regions never overlap, they can be recorded with a single
+  // vkCmdCopyBuffer, which must happen before the next sub-allocation. Returns the number of bytes moved.
+  VkDeviceSize defragmentBlock(uint32_t                     blockIndex,
+                               std::vector<Handle>&         handles,
+                               const std::vector<uint32_t>& alignments,
+                               std::vector<VkBufferCopy>&   copies,
+                               VkDeviceSize                 maxMoveSize = VK_WHOLE_SIZE);
+
   float getUtilization(VkDeviceSize& allocatedSize, VkDeviceSize& usedSize) const;
   bool  fitsInAllocated(VkDeviceSize size, uint32_t alignment = BASE_ALIGNMENT) const;
 
@@ -212,7 +212,11 @@ int DeviceMemoryAllocator::s_allocDebugBias = 0;
 
 //#define DEBUG_ALLOCID   8
 
-nvvk::AllocationID DeviceMemoryAllocator::createID(Allocation& allocation, BlockID block, uint32_t blockOffset, uint32_t blockSize)
+nvvk::AllocationID DeviceMemoryAllocator::createID(Allocation&  allocation,
+                                                   BlockID      block,
+                                                   VkDeviceSize blockOffset,
+                                                   VkDeviceSize blockSize,
+                                                   VkDeviceSize alignment)
 {
   // find free slot
   if(m_freeAllocationIndex != INVALID_ID_INDEX)
@@ -224,6 +228,7 @@ nvvk::AllocationID DeviceMemoryAllocator::createID(Allocation& allocation, Block
     m_allocations[index].block       = block;
     m_allocations[index].blockOffset = blockOffset;
     m_allocations[index].blockSize   = blockSize;
+    m_allocations[index].alignment   = alignment;
 #if DEBUG_ALLOCID
     // debug some specific id, useful to track allocation leaks
     if(index == DEBUG_ALLOCID)
@@ -242,6 +247,7 @@ nvvk::AllocationID DeviceMemoryAllocator::createID(Allocation& allocation, Block
   info.block       = block;
   info.blockOffset = blockOffset;
   info.blockSize   = blockSize;
+  info.alignment   = alignment;
 
   m_allocations.push_back(info);
 
@@ -520,14 +526,14 @@ AllocationID DeviceMemoryAllocator::allocInternal(const VkMemoryRequirements&
       // if there is a compatible block, we are not "first" of a kind
       isFirst = false;
 
-      uint32_t blockSize;
-      uint32_t blockOffset;
-      uint32_t offset;
+      VkDeviceSize blockSize;
+      VkDeviceSize blockOffset;
+      VkDeviceSize offset;
 
 
       // Look for a block which has enough free space available
 
-      if(block.range.subAllocate((uint32_t)memReqs.size, (uint32_t)memReqs.alignment, blockOffset, offset, blockSize))
+      if(block.range.subAllocate(memReqs.size, memReqs.alignment, blockOffset, offset, blockSize))
       {
         block.allocationCount++;
         block.usedSize += blockSize;
@@ -539,7 +545,7 @@ AllocationID DeviceMemoryAllocator::allocInternal(const VkMemoryRequirements&
 
         m_usedSize += blockSize;
 
-        return createID(allocation, block.id, blockOffset, blockSize);
+        return createID(allocation, block.id, blockOffset, blockSize, memReqs.alignment);
       }
     }
   }
@@ -596,10 +602,10 @@ AllocationID DeviceMemoryAllocator::allocInternal(const VkMemoryRequirements&
     memInfo.pNext       = &memFlags;
   }
 
-  block.allocationSize  = block.range.alignedSize((uint32_t)block.allocationSize);
+  block.allocationSize  = block.range.alignedSize(block.allocationSize);
   block.priority        = priority;
   block.memoryTypeIndex = memInfo.memoryTypeIndex;
-  block.range.init((uint32_t)block.allocationSize);
+  block.range.init(block.allocationSize);
   block.isLinear           = isLinear;
   block.isFirst            = isFirst;
   block.isDedicated        = dedicated != nullptr;
@@ -617,11 +623,11 @@ AllocationID DeviceMemoryAllocator::allocInternal(const VkMemoryRequirements&
 
     m_allocatedSize += block.allocationSize;
 
-    uint32_t offset;
-    uint32_t blockSize;
-    uint32_t blockOffset;
+    VkDeviceSize offset;
+    VkDeviceSize blockSize;
+    VkDeviceSize blockOffset;
 
-    block.range.subAllocate((uint32_t)memReqs.size, (uint32_t)memReqs.alignment, blockOffset, offset, blockSize);
+    block.range.subAllocate(memReqs.size, memReqs.alignment, blockOffset, offset, blockSize);
 
     block.allocationCount = 1;
     block.usedSize        = blockSize;
@@ -638,7 +644,7 @@ AllocationID DeviceMemoryAllocator::allocInternal(const VkMemoryRequirements&
 
     m_activeBlockCount++;
 
-    return createID(allocation, id, blockOffset, blockSize);
+    return createID(allocation, id, blockOffset, blockSize, memReqs.alignment);
   }
   else
   {
@@ -688,6 +694,65 @@ void DeviceMemoryAllocator::free(AllocationID allocationID)
   }
 }
 
+VkDeviceSize DeviceMemoryAllocator::defragment(std::vector<DefragMove>& moves, VkDeviceSize maxMoveSize)
+{
+  using BlockRange = decltype(Block::range);
+
+  moves.clear();
+
+  // live allocations per block
+  std::vector<std::vector<uint32_t>> blockAllocations(m_blocks.size());
+  for(size_t i = 0; i < m_allocations.size(); i++)
+  {
+    if(m_allocations[i].id.index == (uint32_t)i)
+    {
+      blockAllocations[m_allocations[i].block.index].push_back((uint32_t)i);
+    }
+  }
+
+  std::vector<BlockRange::DefragRange> ranges;
+  std::vector<BlockRange::DefragMove>  rangeMoves;
+  VkDeviceSize                         moved = 0;
+
+  for(size_t b = 0; b < m_blocks.size() && moved < maxMoveSize; b++)
+  {
+    Block&                       block       = m_blocks[b];
+    const std::vector<uint32_t>& allocations = blockAllocations[b];
+    if(!block.mem || block.isDedicated || allocations.empty())
+    {
+      continue;
+    }
+
+    ranges.clear();
+    for(uint32_t index : allocations)
+    {
+      const AllocationInfo& info = m_allocations[index];
+      ranges.push_back({info.blockOffset, info.blockSize, info.alignment});
+    }
+
+    moved += block.range.defragment(ranges, rangeMoves, maxMoveSize - moved);
+
+    for(const BlockRange::DefragMove& rangeMove : rangeMoves)
+    {
+      AllocationInfo& info = m_allocations[allocations[rangeMove.index]];
+
+      DefragMove move;
+      move.id        = info.id;
+      move.memory    = block.mem;
+      move.srcOffset = info.allocation.offset;
+      move.size      = info.allocation.size;
+
+      info.allocation.offset -= rangeMove.srcOffset - rangeMove.dstOffset;
+      info.blockOffset = rangeMove.dstOffset;
+      move.dstOffset   = info.allocation.offset;
+
+      moves.push_back(move);
+    }
+  }
+
+  return moved;
+}
+
 void* DeviceMemoryAllocator::map(AllocationID allocationID, VkResult* pResult)
 {
   const AllocationInfo& info  = getInfo(allocationID);
@@ -328,6 +328,23 @@ public:
   // returns the detailed information from an allocationID
   const Allocation& getAllocation(AllocationID id) const;
 
+  struct DefragMove
+  {
+    AllocationID   id;
+    VkDeviceMemory memory    = VK_NULL_HANDLE;
+    VkDeviceSize   srcOffset = 0;  // previous Allocation::offset
+    VkDeviceSize   dstOffset = 0;  // new Allocation::offset
+    VkDeviceSize   size      = 0;
+  };
+
+  // One incremental defragmentation pass: within each regular (non-dedicated) block, allocations
+  // move towards lower offsets, at most maxMoveSize bytes in total. Within a block, no destination
+  // overlaps the previous location of any allocation, so all copies of a pass can be recorded at once.
+  // getAllocation() returns the new offsets right away. For each move, the application binds a new
+  // resource at dstOffset, copies the content from the old resource and destroys the old one,
+  // the copies must be done before the next allocation. Returns the number of bytes moved.
+  VkDeviceSize defragment(std::vector<DefragMove>& moves, VkDeviceSize maxMoveSize = VK_WHOLE_SIZE);
+
   // can have multiple map/unmaps at once, but must be paired
   // internally will keep the vk mapping active as long as one map is active
   void* map(AllocationID allocationID, VkResult* pResult = nullptr);
@@ -436,9 +453,9 @@ protected:
 
   struct Block
   {
-    BlockID                   id{};  // index to self, or next free item
-    VkDeviceMemory            mem = VK_NULL_HANDLE;
-    nvh::TRangeAllocator<256> range;
+    BlockID                     id{};  // index to self, or next free item
+    VkDeviceMemory              mem = VK_NULL_HANDLE;
+    nvh::TRangeAllocator64<256> range;
 
     VkDeviceSize allocationSize = 0;
     VkDeviceSize usedSize       = 0;
@@ -468,8 +485,9 @@ protected:
   {
     AllocationID id{};  // index to self, or next free item
     Allocation   allocation{};
-    uint32_t     blockOffset = 0;
-    uint32_t     blockSize   = 0;
+    VkDeviceSize blockOffset = 0;
+    VkDeviceSize blockSize   = 0;
+    VkDeviceSize alignment   = 1;
     BlockID      block{};
   };
 
@@ -510,7 +528,11 @@ protected:
                              bool                                 preferDevice,
                              const State&                         state);
 
-  AllocationID createID(Allocation& allocation, BlockID block, uint32_t blockOffset, uint32_t blockSize);
+  AllocationID createID(Allocation&  allocation,
+                        BlockID      block,
+                        VkDeviceSize blockOffset,
+                        VkDeviceSize blockSize,
+                        VkDeviceSize alignment);
   void         destroyID(AllocationID id);
 
   const AllocationInfo& getInfo(AllocationID id) const
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2025, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2025 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "pipelinecache_vk.hpp"
+
+#include <assert.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string.h>  // memcmp
+#include <string_view>
+
+#include <nvh/fileoperations.hpp>
+#include <nvh/nvprint.hpp>
+
+namespace nvvk {
+//////////////////////////////////////////////////////////////////////////
+
+void PersistentPipelineCache::init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& filename)
+{
+  assert(!m_device);
+  m_device   = device;
+  m_filename = filename;
+  m_loaded   = false;
+  vkGetPhysicalDeviceProperties(physicalDevice, &m_properties);
+
+  std::string data;
+  if(!m_filename.empty() && nvh::fileExists(m_filename.c_str()))
+  {
+    data = nvh::loadFile(m_filename, true);
+    if(!isCompatible(data.data(), data.size()))
+    {
+      LOGW("Pipeline cache %s was created by another device or driver, ignored\n", m_filename.c_str());
+      data.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo createInfo{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+  createInfo.initialDataSize = data.size();
+  createInfo.pInitialData    = data.empty() ? nullptr : data.data();
+
+  VkResult result = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache);
+  if(result != VK_SUCCESS && !data.empty())
+  {
+    // the driver may still reject the data, start over with an empty cache
+    LOGW("Pipeline cache %s rejected by the driver, ignored\n", m_filename.c_str());
+    data.clear();
+    createInfo.initialDataSize = 0;
+    createInfo.pInitialData    = nullptr;
+    result                     = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache);
+  }
+  assert(result == VK_SUCCESS);
+
+  m_loaded    = !data.empty();
+  m_savedHash = m_loaded ? std::hash<std::string_view>()(data) : 0;
+}
+
+void PersistentPipelineCache::deinit()
+{
+  if(!m_device)
+    return;
+
+  waitSave();
+
+  for(VkPipelineCache threadCache : m_threadCaches)
+  {
+    vkDestroyPipelineCache(m_device, threadCache, nullptr);
+  }
+  m_threadCaches.clear();
+
+  vkDestroyPipelineCache(m_device, m_cache, nullptr);
+  m_cache  = VK_NULL_HANDLE;
+  m_device = VK_NULL_HANDLE;
+}
+
+bool PersistentPipelineCache::isCompatible(const void* data, size_t size) const
+{
+  VkPipelineCacheHeaderVersionOne header;
+  if(size < sizeof(header))
+    return false;
+
+  memcpy(&header, data, sizeof(header));
+  return header.headerSize >= sizeof(header) && header.headerSize <= size
+         && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header.vendorID == m_properties.vendorID
+         && header.deviceID == m_properties.deviceID
+         && memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache PersistentPipelineCache::createThreadCache()
+{
+  VkPipelineCacheCreateInfo createInfo{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+  VkPipelineCache           threadCache = VK_NULL_HANDLE;
+  if(vkCreatePipelineCache(m_device, &createInfo, nullptr, &threadCache) != VK_SUCCESS)
+    return VK_NULL_HANDLE;
+
+  std::lock_guard<std::mutex> lock(m_threadCachesMutex);
+  m_threadCaches.push_back(threadCache);
+  return threadCache;
+}
+
+bool PersistentPipelineCache::save(bool background)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_threadCachesMutex);
+    if(!m_threadCaches.empty()
+       && vkMergePipelineCaches(m_device, m_cache, uint32_t(m_threadCaches.size()), m_threadCaches.data()) != VK_SUCCESS)
+    {
+      LOGW("Failed to merge the pipeline caches\n");
+    }
+  }
+
+  if(m_filename.empty())
+    return true;
+
+  size_t size = 0;
+  if(vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS)
+    return false;
+
+  std::string data(size, '\0');
+  if(vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) != VK_SUCCESS)
+    return false;
+  data.resize(size);
+
+  // nothing new since the file was loaded or last written
+  size_t hash = std::hash<std::string_view>()(data);
+  if(hash == m_savedHash)
+    return true;
+
+  waitSave();
+  m_savedHash = hash;
+
+  auto write = [filename = m_filename, data = std::move(data)]() {
+    namespace fs         = std::filesystem;
+    std::string tempFile = filename + ".tmp";
+    {
+      std::ofstream stream(tempFile, std::ios::binary | std::ios::trunc);
+      if(!stream.write(data.data(), std::streamsize(data.size())))
+      {
+        LOGW("Failed to write the pipeline cache %s\n", tempFile.c_str());
+        return;
+      }
+    }
+
+    std::error_code ec;
+    fs::rename(tempFile, filename, ec);
+    if(ec)
+    {
+      LOGW("Failed to write the pipeline cache %s\n", filename.c_str());
+      fs::remove(tempFile, ec);
+    }
+  };
+
+  if(background)
+  {
+    m_saveThread = std::thread(std::move(write));
+  }
+  else
+  {
+    write();
+  }
+  return true;
+}
+
+void PersistentPipelineCache::waitSave()
+{
+  if(m_saveThread.joinable())
+  {
+    m_saveThread.join();
+  }
+}
+
+}  // namespace nvvk
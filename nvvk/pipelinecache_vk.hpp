@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2025, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2025 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nvvk {
+//////////////////////////////////////////////////////////////////////////
+/** @DOC_START
+  # class nvvk::PersistentPipelineCache
+
+  This nvvk::PersistentPipelineCache class owns a VkPipelineCache that is
+  seeded from a file at init and written back to it with save().
+
+  The file is the raw data of vkGetPipelineCacheData. On init its header
+  (VkPipelineCacheHeaderVersionOne) is checked against the vendor ID, device ID
+  and pipelineCacheUUID of the physical device; a file written by another
+  device or driver is ignored and the cache starts empty.
+
+  save() retrieves the data on the calling thread and writes the file on a
+  background thread, through a temporary file that is renamed once complete,
+  so an interrupted write never leaves a truncated cache behind. deinit() waits
+  for a pending write.
+
+  Threads that create many pipelines concurrently can use their own cache from
+  createThreadCache(), avoiding the lock of a shared cache inside the driver.
+  save() merges them into the main cache with vkMergePipelineCaches, it must
+  not run while pipelines are being created with the thread caches.
+
+  Example :
+  ```cpp
+  nvvk::PersistentPipelineCache cache(device, physicalDevice, "myapp.pipelinecache");
+
+  createPipelines(cache.getCache());
+
+  // at exit, or whenever new pipelines were created
+  cache.save();
+  cache.deinit();
+  ```
+@DOC_END */
+
+class PersistentPipelineCache
+{
+public:
+  PersistentPipelineCache(PersistentPipelineCache const&)            = delete;
+  PersistentPipelineCache& operator=(PersistentPipelineCache const&) = delete;
+
+  PersistentPipelineCache() {}
+  PersistentPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& filename)
+  {
+    init(device, physicalDevice, filename);
+  }
+  ~PersistentPipelineCache() { deinit(); }
+
+  // an empty filename makes it a regular, non-persistent, cache
+  void init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& filename);
+  // waits for a pending save and destroys the caches, does not save
+  void deinit();
+
+  VkPipelineCache getCache() const { return m_cache; }
+  bool            wasLoaded() const { return m_loaded; }  // true if seeded from the file
+
+  // additional cache to be used by one thread, merged into the main cache by save()
+  VkPipelineCache createThreadCache();
+
+  // merges the thread caches and writes the cache data to the file,
+  // on a background thread unless `background` is false
+  bool save(bool background = true);
+  // waits until the pending background save is done
+  void waitSave();
+
+private:
+  bool isCompatible(const void* data, size_t size) const;
+
+  VkDevice                     m_device = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties   m_properties{};
+  VkPipelineCache              m_cache = VK_NULL_HANDLE;
+  std::vector<VkPipelineCache> m_threadCaches;
+  std::mutex                   m_threadCachesMutex;
+  std::string                  m_filename;
+  std::thread                  m_saveThread;
+  size_t                       m_savedHash = 0;  // data of the file, to skip saving unchanged caches
+  bool                         m_loaded    = false;
+};
+
+}  // namespace nvvk
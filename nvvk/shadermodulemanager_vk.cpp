@@ -21,14 +21,18 @@
 #include "shadermodulemanager_vk.hpp"
 #include <algorithm>
 #include <assert.h>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <stdarg.h>
 #include <stdio.h>
+#include <type_traits>
 
 #include <nvh/fileoperations.hpp>
 #include <nvh/nvprint.hpp>
+#include <nvh/parallel_work.hpp>
 #include "shaders_vk.hpp"
 
 #if NVP_SUPPORTS_SHADERC
@@ -53,6 +57,8 @@ class ShadercIncludeBridge : public shaderc::CompileOptions::IncluderInterface
 {
   // Borrowed pointer to our include file loader.
   nvvk::ShaderModuleManager* m_pShaderFileManager;
+  // Borrowed, found filenames of all includes are appended.
+  std::vector<std::string>* m_includedFiles;
 
   // Inputs/outputs reused for manualInclude.
   std::string       m_filenameFound;
@@ -82,7 +88,11 @@ class ShadercIncludeBridge : public shaderc::CompileOptions::IncluderInterface
   };
 
 public:
-  ShadercIncludeBridge(nvvk::ShaderModuleManager* pShaderFileManager) { m_pShaderFileManager = pShaderFileManager; }
+  ShadercIncludeBridge(nvvk::ShaderModuleManager* pShaderFileManager, std::vector<std::string>* includedFiles)
+  {
+    m_pShaderFileManager = pShaderFileManager;
+    m_includedFiles      = includedFiles;
+  }
 
   // Handles shaderc_include_resolver_fn callbacks.
   virtual shaderc_include_result* GetInclude(const char*          requested_source,
@@ -101,6 +111,10 @@ public:
     {
       includeFileText = m_pShaderFileManager->getContent(filename, m_filenameFound);
     }
+    if(!includeFileText.empty())
+    {
+      m_includedFiles->push_back(m_filenameFound);
+    }
     std::string content = m_pShaderFileManager->manualIncludeText(includeFileText, m_filenameFound, m_emptyString, versionFound);
     return new Result(std::move(content), std::move(m_filenameFound));
   }
@@ -214,29 +228,57 @@ uint32_t ShaderModuleManager::DefaultInterface::getTypeShadercKind(uint32_t type
 #endif
 }
 
-bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
+// Makes the dependencies comparable to the paths given to reloadShaderModules
+static void normalizeDependencies(std::vector<std::string>& dependencies)
+{
+  namespace fs = std::filesystem;
+  for(std::string& dependency : dependencies)
+  {
+    std::error_code ec;
+    fs::path        path = fs::weakly_canonical(dependency, ec);
+    if(ec)
+    {
+      path = fs::absolute(dependency, ec).lexically_normal();
+    }
+    dependency = path.string();
+  }
+  std::sort(dependencies.begin(), dependencies.end());
+  dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+}
+
+bool ShaderModuleManager::setupShaderModule(ShaderModule& module, bool preprocessOnly)
 {
   Definition& definition = module.definition;
 
   module.module = VK_NULL_HANDLE;
+  module.dependencies.clear();
   if(definition.filetype == FILETYPE_DEFAULT)
   {
     definition.filetype = m_filetype;
   }
 
-  size_t prependHash = 0;
+  size_t      prependHash = 0;
+  std::string prepend;
 
   if(definition.filetype == FILETYPE_SPIRV)
   {
     std::string filenameFound;
     definition.content = nvh::loadFile(definition.filename, true, m_directories, filenameFound);
+    if(!definition.content.empty())
+    {
+      module.dependencies.push_back(filenameFound);
+    }
   }
   else
   {
-    std::string prepend = m_usedSetupIF->getTypeDefine(definition.type) + m_prepend + definition.prepend;
-    prependHash         = std::hash<std::string>{}(prepend);
+    {
+      std::lock_guard<std::mutex> guard(m_setupIFMutex);
+      prepend = m_usedSetupIF->getTypeDefine(definition.type);
+    }
+    prepend += m_prepend + definition.prepend;
+    prependHash = std::hash<std::string>{}(prepend);
 
-    definition.content = manualInclude(definition.filename, definition.filenameFound, prepend, false);
+    definition.content = manualInclude(definition.filename, definition.filenameFound, prepend, false, &module.dependencies);
   }
 
   if(definition.content.empty())
@@ -244,7 +286,7 @@ bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
     return false;
   }
 
-  if(m_preprocessOnly)
+  if(preprocessOnly)
   {
     module.module = PREPROCESS_ONLY_MODULE;
     return true;
@@ -255,28 +297,43 @@ bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
 
 #if NVP_SUPPORTS_SHADERC
     shaderc_compilation_result_t result = nullptr;
+    std::string                  cachedSpirv;
     if(definition.filetype == FILETYPE_GLSL)
     {
-      std::lock_guard<std::mutex> guard(s_shadercCompilerMutex);
-      shaderc_shader_kind         shaderkind = (shaderc_shader_kind)m_usedSetupIF->getTypeShadercKind(definition.type);
-      shaderc_compile_options_t options = (shaderc_compile_options_t)m_usedSetupIF->getShadercCompileOption(s_shadercCompiler);
-      if(!options)
+      shaderc_shader_kind       shaderkind    = shaderc_glsl_infer_from_source;
+      shaderc_compile_options_t options       = nullptr;
+      bool                      customOptions = false;
+      {
+        // The compiler itself is thread-safe, the lock protects the setup interface.
+        std::lock_guard<std::mutex> guard(m_setupIFMutex);
+        shaderkind                       = (shaderc_shader_kind)m_usedSetupIF->getTypeShadercKind(definition.type);
+        shaderc_compile_options_t custom = (shaderc_compile_options_t)m_usedSetupIF->getShadercCompileOption(s_shadercCompiler);
+        customOptions                    = custom != nullptr;
+
+        // Every compilation works on its own copy, as it sets its own includer and may
+        // lower the optimization level, so that modules can be compiled concurrently.
+        options = shaderc_compile_options_clone(customOptions ? custom : m_shadercOptions);
+      }
+      std::unique_ptr<std::remove_pointer_t<shaderc_compile_options_t>, decltype(&shaderc_compile_options_release)> optionsOwner(
+          options, shaderc_compile_options_release);
+
+      if(!customOptions)
       {
         if(m_apiMajor == 1 && m_apiMinor == 0)
         {
-          shaderc_compile_options_set_target_env(m_shadercOptions, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+          shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
         }
         else if(m_apiMajor == 1 && m_apiMinor == 1)
         {
-          shaderc_compile_options_set_target_env(m_shadercOptions, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_1);
+          shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_1);
         }
         else if(m_apiMajor == 1 && m_apiMinor == 2)
         {
-          shaderc_compile_options_set_target_env(m_shadercOptions, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+          shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
         }
         else if(m_apiMajor == 1 && m_apiMinor == 3)
         {
-          shaderc_compile_options_set_target_env(m_shadercOptions, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+          shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
         }
         else
         {
@@ -284,18 +341,16 @@ bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
           assert(0);
         }
 
-        shaderc_compile_options_set_optimization_level(m_shadercOptions, m_shadercOptimizationLevel);
+        shaderc_compile_options_set_optimization_level(options, m_shadercOptimizationLevel);
 
         // Keep debug info, doesn't cost shader execution perf, only compile-time and memory size.
         // Improves usage for debugging tools, not recommended for shipping application,
         // but good for developmenent builds.
-        shaderc_compile_options_set_generate_debug_info(m_shadercOptions);
-
-        options = m_shadercOptions;
+        shaderc_compile_options_set_generate_debug_info(options);
       }
 
       // Tell shaderc to use this class (really our base class, nvh::ShaderFileManager) to load include files.
-      ShadercIncludeBridge shadercIncludeBridge(this);
+      ShadercIncludeBridge shadercIncludeBridge(this, &module.dependencies);
       shadercIncludeBridge.setAsIncluder(options);
 
       // Note: need filenameFound, not filename, so that relative includes work.
@@ -308,46 +363,95 @@ bool ShaderModuleManager::setupShaderModule(ShaderModule& module)
       // Because we insert line markers in our prepended content string, the original file is still found.
       filenameUsed += ShaderFileManager::format(".nvvk_prepend_%llu", prependHash);
 
-      result = shaderc_compile_into_spv(s_shadercCompiler, definition.content.c_str(), definition.content.size(),
-                                        shaderkind, filenameUsed.c_str(), "main", options);
-
-      if(!result)
+      // Preprocessing is cheap compared to the compilation and resolves all includes and defines,
+      // its output is the main part of the cache key. The raw source is added for the comments
+      // that end up in the debug info.
+      nvh::SpirvDiskCache::Key cacheKey;
+      bool                     useCache = m_spirvCache && m_spirvCache->isValid() && !customOptions;
+      if(useCache)
       {
-        return false;
+        shaderc_compilation_result_t preprocessed =
+            shaderc_compile_into_preprocessed_text(s_shadercCompiler, definition.content.c_str(), definition.content.size(),
+                                                   shaderkind, filenameUsed.c_str(), "main", options);
+
+        useCache = preprocessed && shaderc_result_get_compilation_status(preprocessed) == shaderc_compilation_status_success;
+        if(useCache)
+        {
+          unsigned int spvVersion  = 0;
+          unsigned int spvRevision = 0;
+          shaderc_get_spv_version(&spvVersion, &spvRevision);
+
+          cacheKey = nvh::SpirvDiskCache::KeyBuilder()
+                         .add(std::string_view(shaderc_result_get_bytes(preprocessed), shaderc_result_get_length(preprocessed)))
+                         .add(definition.content)
+                         .add(prepend)
+                         .add(uint64_t(shaderkind))
+                         .add(uint64_t(m_apiMajor))
+                         .add(uint64_t(m_apiMinor))
+                         .add(uint64_t(m_shadercOptimizationLevel))
+                         .add(uint64_t(spvVersion))
+                         .add(uint64_t(spvRevision))
+                         .finish();
+        }
+        if(preprocessed)
+        {
+          shaderc_result_release(preprocessed);
+        }
       }
 
-      if(shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+      if(useCache && m_spirvCache->load(cacheKey, cachedSpirv))
+      {
+        shaderModuleInfo.codeSize = cachedSpirv.size();
+        shaderModuleInfo.pCode    = (const uint32_t*)cachedSpirv.data();
+      }
+      else
       {
-        bool failedToOptimize = strstr(shaderc_result_get_error_message(result), "failed to optimize");
-        int  level            = failedToOptimize ? LOGLEVEL_WARNING : LOGLEVEL_ERROR;
-        nvprintfLevel(level, "%s: optimization_level_performance\n", definition.filename.c_str());
-        nvprintfLevel(level, "  %s\n", definition.prepend.c_str());
-        nvprintfLevel(level, "  %s\n", shaderc_result_get_error_message(result));
-        shaderc_result_release(result);
-
-        if(!failedToOptimize || options != m_shadercOptions)
+        result = shaderc_compile_into_spv(s_shadercCompiler, definition.content.c_str(), definition.content.size(),
+                                          shaderkind, filenameUsed.c_str(), "main", options);
+
+        if(!result)
         {
           return false;
         }
 
-        // try again without optimization
-        shaderc_compile_options_set_optimization_level(m_shadercOptions, shaderc_optimization_level_zero);
+        if(shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+        {
+          bool failedToOptimize = strstr(shaderc_result_get_error_message(result), "failed to optimize");
+          int  level            = failedToOptimize ? LOGLEVEL_WARNING : LOGLEVEL_ERROR;
+          nvprintfLevel(level, "%s: optimization_level_performance\n", definition.filename.c_str());
+          nvprintfLevel(level, "  %s\n", definition.prepend.c_str());
+          nvprintfLevel(level, "  %s\n", shaderc_result_get_error_message(result));
+          shaderc_result_release(result);
+
+          if(!failedToOptimize || customOptions)
+          {
+            return false;
+          }
+
+          // try again without optimization
+          shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_zero);
+
+          result = shaderc_compile_into_spv(s_shadercCompiler, definition.content.c_str(), definition.content.size(),
+                                            shaderkind, definition.filename.c_str(), "main", options);
+        }
 
-        result = shaderc_compile_into_spv(s_shadercCompiler, definition.content.c_str(), definition.content.size(),
-                                          shaderkind, definition.filename.c_str(), "main", options);
-      }
+        if(shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+        {
+          LOGE("%s: optimization_level_zero\n", definition.filename.c_str());
+          LOGE("  %s\n", definition.prepend.c_str());
+          LOGE("  %s\n", shaderc_result_get_error_message(result));
+          shaderc_result_release(result);
+          return false;
+        }
 
-      if(shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
-      {
-        LOGE("%s: optimization_level_zero\n", definition.filename.c_str());
-        LOGE("  %s\n", definition.prepend.c_str());
-        LOGE("  %s\n", shaderc_result_get_error_message(result));
-        shaderc_result_release(result);
-        return false;
-      }
+        shaderModuleInfo.codeSize = shaderc_result_get_length(result);
+        shaderModuleInfo.pCode    = (const uint32_t*)shaderc_result_get_bytes(result);
 
-      shaderModuleInfo.codeSize = shaderc_result_get_length(result);
-      shaderModuleInfo.pCode    = (const uint32_t*)shaderc_result_get_bytes(result);
+        if(useCache)
+        {
+          m_spirvCache->store(cacheKey, shaderModuleInfo.pCode, shaderModuleInfo.codeSize);
+        }
+      }
     }
     else
 #else
@@ -434,10 +538,11 @@ ShaderModuleID ShaderModuleManager::createShaderModule(const Definition& definit
   ShaderModule module;
   module.definition = definition;
 
-  if(!setupShaderModule(module))
+  if(!setupShaderModule(module, m_preprocessOnly))
   {
     return ShaderModuleID();
   }
+  normalizeDependencies(module.dependencies);
 
   // find unused
   for(size_t i = 0; i < m_shadermodules.size(); i++)
@@ -490,38 +595,76 @@ void ShaderModuleManager::deleteShaderModules()
 
 void ShaderModuleManager::reloadModule(ShaderModuleID idx)
 {
-  if(!isValid(idx))
+  // modules that failed to compile are retried as well
+  if(!idx.isValid() || size_t(idx) >= m_shadermodules.size() || getShaderModule(idx).definition.type == 0)
     return;
 
   ShaderModule& module = getShaderModule(idx);
 
-  bool old         = m_preprocessOnly;
-  m_preprocessOnly = module.module == PREPROCESS_ONLY_MODULE;
+  bool preprocessOnly = module.module == PREPROCESS_ONLY_MODULE;
   if(module.module && module.module != PREPROCESS_ONLY_MODULE)
   {
     vkDestroyShaderModule(m_device, module.module, nullptr);
     module.module = nullptr;
   }
-  if(module.definition.type != 0)
-  {
-    setupShaderModule(module);
-  }
 
-  m_preprocessOnly = old;
+  setupShaderModule(module, preprocessOnly);
+  normalizeDependencies(module.dependencies);
+}
+
+void ShaderModuleManager::reloadModules(const std::vector<ShaderModuleID>& indices)
+{
+  // modules are independent, see setupShaderModule for the shared state
+  nvh::parallel_batches_indexed<1>(indices.size(), [&](uint64_t i, uint32_t) { reloadModule(indices[i]); });
 }
 
 void ShaderModuleManager::reloadShaderModules()
 {
   LOGI("Reloading programs...\n");
 
+  std::vector<ShaderModuleID> indices(m_shadermodules.size());
   for(size_t i = 0; i < m_shadermodules.size(); i++)
   {
-    reloadModule((ShaderModuleID)i);
+    indices[i] = i;
   }
+  reloadModules(indices);
 
   LOGI("done\n");
 }
 
+size_t ShaderModuleManager::reloadShaderModules(const std::vector<std::string>& changedFiles)
+{
+  std::vector<ShaderModuleID> indices = findDependentModules(changedFiles);
+  if(!indices.empty())
+  {
+    LOGI("Reloading %d programs...\n", int(indices.size()));
+    reloadModules(indices);
+    LOGI("done\n");
+  }
+  return indices.size();
+}
+
+std::vector<ShaderModuleID> ShaderModuleManager::findDependentModules(const std::vector<std::string>& files) const
+{
+  std::vector<std::string> normalizedFiles = files;
+  normalizeDependencies(normalizedFiles);
+
+  std::vector<ShaderModuleID> indices;
+  for(size_t i = 0; i < m_shadermodules.size(); i++)
+  {
+    const std::vector<std::string>& dependencies = m_shadermodules[i].dependencies;
+    for(const std::string& file : normalizedFiles)
+    {
+      if(std::binary_search(dependencies.begin(), dependencies.end(), file))
+      {
+        indices.push_back(i);
+        break;
+      }
+    }
+  }
+  return indices;
+}
+
 bool ShaderModuleManager::isValid(ShaderModuleID idx) const
 {
   return idx.isValid()
@@ -557,6 +700,7 @@ void ShaderModuleManager::destroyShaderModule(ShaderModuleID idx)
     module.module = 0;
   }
   module.definition = Definition();
+  module.dependencies.clear();
 }
 
 const char* ShaderModuleManager::getCode(ShaderModuleID idx, size_t* len) const
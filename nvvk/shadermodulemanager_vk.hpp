@@ -34,6 +34,7 @@
 #endif
 
 #include <nvh/shaderfilemanager.hpp>
+#include <nvh/spirvcache.hpp>
 
 
 namespace nvvk {
@@ -50,6 +51,12 @@ namespace nvvk {
   It also comes with some convenience functions to reload shaders etc.
   That is why we pass out the ShaderModuleID rather than a VkShaderModule directly.
 
+  While compiling, every module records the files it was built from, the
+  source and all its (nested) includes. reloadShaderModules(changedFiles)
+  uses this to only rebuild the modules affected by a file change, e.g. from
+  nvp::FileSystemMonitor. Reloads compile on the nvh::parallel_work thread
+  pool, each compilation with its own copy of the shaderc options.
+
   To change the compilation behavior manipulate the public member variables
   prior createShaderModule.
 
@@ -57,6 +64,12 @@ namespace nvvk {
   If GLSL is used, shaderc must be used as well (which must be added via
   _add_package_ShaderC() in CMake of the project)
 
+  GLSL compilations can be cached on disk with setSpirvCache(). The key is
+  the shaderc-preprocessed source (so all includes and defines are covered),
+  the prepend, the shader stage, the target Vulkan version and the compile
+  options; a hit skips the compilation. Modules created with custom options
+  from SetupInterface::getShadercCompileOption are never cached.
+
   Example:
 
   ```cpp
@@ -68,6 +81,10 @@ namespace nvvk {
   // all shaders get this injected after #version statement
   mgr.m_prepend = "#define USE_NOISE 1\n";
 
+  // optional, reuse the SPIR-V of previous runs
+  nvh::SpirvDiskCache spirvCache("spirv_cache/");
+  mgr.setSpirvCache(&spirvCache);
+
   vid = mgr.createShaderModule(VK_SHADER_STAGE_VERTEX_BIT,   "object.vert.glsl");
   fid = mgr.createShaderModule(VK_SHADER_STAGE_FRAGMENT_BIT, "object.frag.glsl");
 
@@ -114,9 +131,10 @@ public:
     {
     }
 
-    VkShaderModule module;
-    std::string    moduleSPIRV;
-    Definition     definition;
+    VkShaderModule           module;
+    std::string              moduleSPIRV;
+    Definition               definition;
+    std::vector<std::string> dependencies;  // normalized paths of the source file and all files it includes
   };
 
   void init(VkDevice device, int apiMajor = 1, int apiMinor = 1);
@@ -133,7 +151,15 @@ public:
   void destroyShaderModule(ShaderModuleID idx);
   void reloadModule(ShaderModuleID idx);
 
+  // reloads the modules concurrently on the nvh::parallel_work thread pool
+  void reloadModules(const std::vector<ShaderModuleID>& indices);
   void reloadShaderModules();
+  // only reloads the modules that depend on one of the changed files (source or include),
+  // returns how many were reloaded
+  size_t reloadShaderModules(const std::vector<std::string>& changedFiles);
+  // modules whose source or includes contain one of the files
+  std::vector<ShaderModuleID> findDependentModules(const std::vector<std::string>& files) const;
+
   void deleteShaderModules();
   bool areShaderModulesValid();
 
@@ -141,6 +167,10 @@ public:
   void setOptimizationLevel(shaderc_optimization_level level) { m_shadercOptimizationLevel = level; }
 #endif
 
+  // borrowed, must outlive the manager or be reset to nullptr
+  void                 setSpirvCache(nvh::SpirvDiskCache* cache) { m_spirvCache = cache; }
+  nvh::SpirvDiskCache* getSpirvCache() const { return m_spirvCache; }
+
 
   bool                isValid(ShaderModuleID idx) const;
   VkShaderModule      get(ShaderModuleID idx) const;
@@ -167,6 +197,8 @@ public:
     // This class is to aid using a shaderc library version that is not
     // provided by the Vulkan SDK, but custom. Therefore it allows custom settings etc.
     // Useful for driver development of new shader stages, otherwise can be pretty much ignored.
+    // Calls are serialized per ShaderModuleManager, an interface shared by several managers
+    // that reload at the same time must be thread-safe.
 
     virtual std::string getTypeDefine(uint32_t type) const      = 0;
     virtual uint32_t    getTypeShadercKind(uint32_t type) const = 0;
@@ -207,7 +239,7 @@ public:
 
 private:
   ShaderModuleID createShaderModule(const Definition& def);
-  bool           setupShaderModule(ShaderModule& prog);
+  bool           setupShaderModule(ShaderModule& prog, bool preprocessOnly);
 
 
   struct DefaultInterface : public SetupInterface
@@ -222,15 +254,18 @@ private:
   VkDevice         m_device = nullptr;
   DefaultInterface m_defaultSetupIF;
   SetupInterface*  m_usedSetupIF = nullptr;
+  std::mutex       m_setupIFMutex;  // modules are reloaded concurrently
 
   int m_apiMajor = 1;
   int m_apiMinor = 1;
 
+  nvh::SpirvDiskCache* m_spirvCache = nullptr;
+
 #if NVP_SUPPORTS_SHADERC
   static uint32_t            s_shadercCompilerUsers;
-  static shaderc_compiler_t  s_shadercCompiler;  // Lock mutex below while using.
+  static shaderc_compiler_t  s_shadercCompiler;  // Thread-safe for compiling, lock mutex below to create/destroy.
   static std::mutex          s_shadercCompilerMutex;
-  shaderc_compile_options_t  m_shadercOptions           = nullptr;
+  shaderc_compile_options_t  m_shadercOptions           = nullptr;  // cloned by every compilation
   shaderc_optimization_level m_shadercOptimizationLevel = shaderc_optimization_level_performance;
 #endif
 
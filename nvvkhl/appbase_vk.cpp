@@ -18,6 +18,7 @@
  */
 
 #include "nvvkhl/appbase_vk.hpp"
+#include "nvp/nvpsystem.hpp"
 #include "nvp/perproject_globals.hpp"
 // Imgui
 #include <imgui.h>
@@ -61,8 +62,13 @@ void nvvkhl::AppBaseVk::setup(const VkInstance& instance, const VkDevice& device
   poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
   vkCreateCommandPool(m_device, &poolCreateInfo, nullptr, &m_cmdPool);
 
-  VkPipelineCacheCreateInfo pipelineCacheInfo{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
-  vkCreatePipelineCache(m_device, &pipelineCacheInfo, nullptr, &m_pipelineCache);
+  // Pipelines compiled by the previous runs
+  if(!m_pipelineCacheFileSet)
+  {
+    m_pipelineCacheFile = NVPSystem::exePath() + getProjectName() + ".pipelinecache";
+  }
+  m_persistentPipelineCache.init(m_device, m_physicalDevice, m_pipelineCacheFile);
+  m_pipelineCache = m_persistentPipelineCache.getCache();
 
   ImGuiH::SetCameraJsonFile(getProjectName());
 }
@@ -74,6 +80,9 @@ void nvvkhl::AppBaseVk::destroy()
 {
   vkDeviceWaitIdle(m_device);
 
+  // Written in the background while the rest is destroyed
+  m_persistentPipelineCache.save();
+
   if(ImGui::GetCurrentContext() != nullptr)
   {
     // In case multiple ImGUI contexts are used in the same application, the VK side may not own ImGui resources
@@ -90,7 +99,8 @@ void nvvkhl::AppBaseVk::destroy()
   vkDestroyImageView(m_device, m_depthView, nullptr);
   vkDestroyImage(m_device, m_depthImage, nullptr);
   vkFreeMemory(m_device, m_depthMemory, nullptr);
-  vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+  m_persistentPipelineCache.deinit();
+  m_pipelineCache = VK_NULL_HANDLE;
 
   for(uint32_t i = 0; i < m_swapChain.getImageCount(); i++)
   {
@@ -691,7 +701,7 @@ void nvvkhl::AppBaseVk::initGUI(uint32_t subpassID /*= 0*/)
   init_info.Device                    = m_device;
   init_info.QueueFamily               = m_graphicsQueueIndex;
   init_info.Queue                     = m_queue;
-  init_info.PipelineCache             = VK_NULL_HANDLE;
+  init_info.PipelineCache             = m_pipelineCache;
   init_info.DescriptorPool            = m_imguiDescPool;
   init_info.RenderPass                = m_renderPass;
   init_info.Subpass                   = subpassID;
@@ -23,6 +23,7 @@
 
 // Utilities
 #include "nvh/cameramanipulator.hpp"
+#include "nvvk/pipelinecache_vk.hpp"
 #include "nvvk/swapchain_vk.hpp"
 
 #ifdef LINUX
@@ -292,6 +293,13 @@ public:
   bool         isMinimized(bool doSleeping = true);
   void         setTitle(const std::string& title) { glfwSetWindowTitle(m_window, title.c_str()); }
   void         useNvlink(bool useNvlink) { m_useNvlink = useNvlink; }
+  void         savePipelineCache() { m_persistentPipelineCache.save(); }  // Background write, also done by destroy()
+  // Persistent pipeline cache, to set before setup(). Default: <exe dir>/<project>.pipelinecache, empty disables it
+  void setPipelineCacheFile(const std::string& filename)
+  {
+    m_pipelineCacheFile    = filename;
+    m_pipelineCacheFileSet = true;
+  }
 
   // GLFW Callback setup
   void        setupGlfwCallbacks(GLFWwindow* window);
@@ -356,6 +364,11 @@ protected:
   bool                         m_useNvlink{false};               // NVLINK usage
   GLFWwindow*                  m_window{nullptr};                // GLFW Window
 
+  // Pipeline cache, seeded from and saved to m_pipelineCacheFile
+  nvvk::PersistentPipelineCache m_persistentPipelineCache;
+  std::string                   m_pipelineCacheFile;
+  bool                          m_pipelineCacheFileSet{false};
+
   // Surface buffer formats
   VkFormat m_colorFormat{VK_FORMAT_B8G8R8A8_UNORM};
   VkFormat m_depthFormat{VK_FORMAT_UNDEFINED};
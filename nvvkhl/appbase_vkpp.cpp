@@ -23,6 +23,7 @@
 #include <backends/imgui_impl_vulkan.h>
 #include "imgui/imgui_helper.h"
 #include "imgui/imgui_camera_widget.h"
+#include "nvp/nvpsystem.hpp"
 #include "nvp/perproject_globals.hpp"
 
 #ifdef LINUX
@@ -53,7 +54,14 @@ void nvvkhl::AppBase::setup(const vk::Instance& instance, const vk::Device& devi
   m_graphicsQueueIndex = graphicsQueueIndex;
   m_queue              = m_device.getQueue(m_graphicsQueueIndex, 0);
   m_cmdPool = m_device.createCommandPool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer, graphicsQueueIndex});
-  m_pipelineCache = device.createPipelineCache(vk::PipelineCacheCreateInfo());
+
+  // Pipelines compiled by the previous runs
+  if(!m_pipelineCacheFileSet)
+  {
+    m_pipelineCacheFile = NVPSystem::exePath() + getProjectName() + ".pipelinecache";
+  }
+  m_persistentPipelineCache.init(m_device, m_physicalDevice, m_pipelineCacheFile);
+  m_pipelineCache = m_persistentPipelineCache.getCache();
 
   ImGuiH::SetCameraJsonFile(getProjectName());
 }
@@ -62,6 +70,9 @@ void nvvkhl::AppBase::destroy()
 {
   m_device.waitIdle();
 
+  // Written in the background while the rest is destroyed
+  m_persistentPipelineCache.save();
+
   if(ImGui::GetCurrentContext() != nullptr)
   {
     //ImGui::ShutdownVK();
@@ -74,7 +85,8 @@ void nvvkhl::AppBase::destroy()
   m_device.destroy(m_depthView);
   m_device.destroy(m_depthImage);
   m_device.freeMemory(m_depthMemory);
-  m_device.destroy(m_pipelineCache);
+  m_persistentPipelineCache.deinit();
+  m_pipelineCache = nullptr;
 
   for(uint32_t i = 0; i < m_swapChain.getImageCount(); i++)
   {
@@ -536,7 +548,7 @@ void nvvkhl::AppBase::initGUI(uint32_t subpassID)
   init_info.Device                    = m_device;
   init_info.QueueFamily               = m_graphicsQueueIndex;
   init_info.Queue                     = m_queue;
-  init_info.PipelineCache             = VK_NULL_HANDLE;
+  init_info.PipelineCache             = m_pipelineCache;
   init_info.DescriptorPool            = m_imguiDescPool;
   init_info.RenderPass                = m_renderPass;
   init_info.Subpass                   = subpassID;
@@ -639,6 +651,17 @@ void nvvkhl::AppBase::useNvlink(bool useNvlink)
   m_useNvlink = useNvlink;
 }
 
+void nvvkhl::AppBase::setPipelineCacheFile(const std::string& filename)
+{
+  m_pipelineCacheFile    = filename;
+  m_pipelineCacheFileSet = true;
+}
+
+void nvvkhl::AppBase::savePipelineCache()
+{
+  m_persistentPipelineCache.save();
+}
+
 vk::Instance nvvkhl::AppBase::getInstance()
 {
   return m_instance;
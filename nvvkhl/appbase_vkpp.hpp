@@ -25,6 +25,7 @@
 
 #include "nvh/cameramanipulator.hpp"
 #include "nvh/timesampler.hpp"
+#include "nvvk/pipelinecache_vk.hpp"
 #include "nvvk/swapchain_vk.hpp"
 
 struct GLFWwindow;
@@ -176,6 +177,13 @@ public:
   // Set if Nvlink will be used
   void useNvlink(bool useNvlink);
 
+  // Persistent pipeline cache file, to set before setup()
+  // Default is <exe dir>/<project>.pipelinecache, an empty filename disables it
+  void setPipelineCacheFile(const std::string& filename);
+
+  // Writes the pipeline cache to its file in the background, also done by destroy()
+  void savePipelineCache();
+
   //--------------------------------------------------------------------------------------------------
   // Getters
   vk::Instance                          getInstance();
@@ -233,6 +241,11 @@ protected:
   bool                           m_useNvlink{false};  // NVLINK usage
   GLFWwindow*                    m_window{nullptr};   // GLFW Window
 
+  // Pipeline cache, seeded from and saved to m_pipelineCacheFile
+  nvvk::PersistentPipelineCache m_persistentPipelineCache;
+  std::string                   m_pipelineCacheFile;
+  bool                          m_pipelineCacheFileSet{false};
+
   // Surface buffer formats
   vk::Format m_colorFormat{vk::Format::eB8G8R8A8Unorm};
   vk::Format m_depthFormat{vk::Format::eUndefined};
@@ -22,16 +22,24 @@
 
 >  This class is a wrapper around the shaderc compiler to help compiling GLSL to Spir-V using shaderC
 
+compileFileCached() can reuse the Spir-V of previous runs from a nvh::SpirvDiskCache set with setSpirvCache().
+The key is the preprocessed source, so includes and macro definitions are covered. As shaderc::CompileOptions
+cannot be inspected, the other options that affect the output (target environment, optimization level, debug info)
+must be described by the `optionsTag` string.
+
 @DOC_END */
 
 
 #pragma once
 
 
+#include <cstring>
 #include <memory>
 #include <filesystem>
 #include <shaderc/shaderc.hpp>
 #include "nvh/fileoperations.hpp"
+#include "nvh/nvprint.hpp"
+#include "nvh/spirvcache.hpp"
 #include "nvvk/error_vk.hpp"
 #include "nvvk/shaders_vk.hpp"
 
@@ -138,6 +146,73 @@ public:
     return CompileGlslToSpv(source_code, shader_kind, filename.c_str(), options);
   }
 
+  // Borrowed, must outlive the compiler or be reset to nullptr
+  void                 setSpirvCache(nvh::SpirvDiskCache* cache) { m_spirvCache = cache; }
+  nvh::SpirvDiskCache* getSpirvCache() const { return m_spirvCache; }
+
+  // Compiles into `spirv`, loading it from the SPIR-V cache if the same compilation was done before.
+  // `optionsTag` must change whenever options that don't affect preprocessing change.
+  bool compileFileCached(const std::string&             filename,
+                         shaderc_shader_kind            shader_kind,
+                         std::vector<uint32_t>&         spirv,
+                         const std::string&             optionsTag = "",
+                         const shaderc::CompileOptions* options    = nullptr)
+  {
+    const shaderc::CompileOptions& compileOptions = options ? *options : *m_compilerOptions;
+
+    std::string find_file = nvh::findFile(filename, m_includePaths, true);
+    if(find_file.empty())
+      return false;
+    std::string source_code = nvh::loadFile(find_file, false);
+
+    nvh::SpirvDiskCache::Key cacheKey;
+    bool                     useCache = m_spirvCache && m_spirvCache->isValid();
+    if(useCache)
+    {
+      // Preprocessing is cheap compared to the compilation and resolves all includes and defines
+      shaderc::PreprocessedSourceCompilationResult preprocessed =
+          PreprocessGlsl(source_code, shader_kind, find_file.c_str(), compileOptions);
+      useCache = preprocessed.GetCompilationStatus() == shaderc_compilation_status_success;
+      if(useCache)
+      {
+        unsigned int spvVersion  = 0;
+        unsigned int spvRevision = 0;
+        shaderc_get_spv_version(&spvVersion, &spvRevision);
+
+        cacheKey = nvh::SpirvDiskCache::KeyBuilder()
+                       .add(std::string_view(preprocessed.cbegin(), preprocessed.cend() - preprocessed.cbegin()))
+                       .add(source_code)
+                       .add(uint64_t(shader_kind))
+                       .add(optionsTag)
+                       .add(uint64_t(spvVersion))
+                       .add(uint64_t(spvRevision))
+                       .finish();
+
+        std::string cached;
+        if(m_spirvCache->load(cacheKey, cached))
+        {
+          spirv.resize(cached.size() / sizeof(uint32_t));
+          memcpy(spirv.data(), cached.data(), cached.size());
+          return true;
+        }
+      }
+    }
+
+    shaderc::SpvCompilationResult result = CompileGlslToSpv(source_code, shader_kind, find_file.c_str(), compileOptions);
+    if(result.GetCompilationStatus() != shaderc_compilation_status_success)
+    {
+      LOGE("%s: %s\n", find_file.c_str(), result.GetErrorMessage().c_str());
+      return false;
+    }
+    spirv.assign(result.cbegin(), result.cend());
+
+    if(useCache)
+    {
+      m_spirvCache->store(cacheKey, spirv.data(), spirv.size() * sizeof(uint32_t));
+    }
+    return true;
+  }
+
   VkShaderModule createModule(VkDevice device, const shaderc::SpvCompilationResult& compResult)
   {
     VkShaderModule shaderModule = nvvk::createShaderModule(device, std::vector(compResult.begin(), compResult.end()));
@@ -150,6 +225,7 @@ public:
 private:
   std::vector<std::string>                 m_includePaths;
   std::unique_ptr<shaderc::CompileOptions> m_compilerOptions;
+  nvh::SpirvDiskCache*                     m_spirvCache = nullptr;
 };
 
 
@@ -20,8 +20,14 @@
 #include "gltf_scene_vk.hpp"
 
 #include <cinttypes>
+#include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <numeric>
 #include <sstream>
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#endif
 
 #include "stb_image.h"
 
@@ -33,7 +39,9 @@
 #include "nvh/parallel_work.hpp"
 #include "nvh/timesampler.hpp"
 #include "nvvk/buffers_vk.hpp"
+#include "nvvk/commands_vk.hpp"
 #include "nvvk/images_vk.hpp"
+#include "nvvk/stagingmemorymanager_vk.hpp"
 #include "shaders/dh_scn_desc.h"
 #include "shaders/dh_lighting.h"
 
@@ -62,6 +70,13 @@ nvvkhl::SceneVk::SceneVk(VkDevice device, VkPhysicalDevice physicalDevice, nvvk:
   m_dutil = std::make_unique<nvvk::DebugUtil>(m_device);  // Debug utility
 }
 
+void nvvkhl::SceneVk::setTextureStreaming(VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize inFlightBytes)
+{
+  m_streamQueue         = queue;
+  m_streamQueueFamily   = queueFamilyIndex;
+  m_streamInFlightBytes = inFlightBytes;
+}
+
 //--------------------------------------------------------------------------------------------------
 // Create all Vulkan resources to hold a nvh::gltf::Scene
 //
@@ -238,72 +253,341 @@ void nvvkhl::SceneVk::updateMaterialBuffer(VkCommandBuffer cmd, const nvh::gltf:
   }
 }
 
-// Function to blend positions of a primitive with morph targets
-std::vector<glm::vec3> getBlendedPositions(const tinygltf::Accessor&  baseAccessor,
-                                           const glm::vec3*           basePositionData,
-                                           const tinygltf::Primitive& primitive,
-                                           const tinygltf::Mesh&      mesh,
-                                           const tinygltf::Model&     model)
+//--------------------------------------------------------------------------------------------------
+// Decodes the morph targets of a primitive the first time it is blended
+// - Sparse target accessors without a buffer view (zero deltas except the sparse values) are kept sparse
+//
+const nvvkhl::SceneVk::MorphCache& nvvkhl::SceneVk::getMorphCache(const nvh::gltf::Scene& scn, int renderPrimID)
+{
+  auto it = m_morphCache.find(renderPrimID);
+  if(it != m_morphCache.end())
+  {
+    return it->second;
+  }
+
+  const tinygltf::Model&     model     = scn.getModel();
+  const tinygltf::Primitive& primitive = *scn.getRenderPrimitive(renderPrimID).pPrimitive;
+  MorphCache&                cache     = m_morphCache[renderPrimID];
+
+  const auto decodeBase = [&](const char* attributeName, auto& dst) {
+    using T                = typename std::remove_reference_t<decltype(dst)>::value_type;
+    const auto& findResult = primitive.attributes.find(attributeName);
+    if(findResult == primitive.attributes.end())
+    {
+      return;
+    }
+    std::vector<T>           tempStorage;
+    const std::span<const T> data =
+        tinygltf::utils::getAccessorData2(model, model.accessors[findResult->second], tempStorage);
+    dst.assign(data.begin(), data.end());
+  };
+  decodeBase("POSITION", cache.positions);
+  decodeBase("NORMAL", cache.normals);
+  decodeBase("TANGENT", cache.tangents);
+
+  const size_t vertexCount = cache.positions.size();
+  if(cache.normals.size() != vertexCount)
+    cache.normals.clear();
+  if(cache.tangents.size() != vertexCount)
+    cache.tangents.clear();
+
+  const auto decodeDeltas = [&](const tinygltf::Accessor& accessor, MorphDeltas& deltas) {
+    if(accessor.bufferView < 0)
+    {
+      if(!accessor.sparse.isSparse)
+      {
+        return;  // All zero
+      }
+      if(accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor.type != TINYGLTF_TYPE_VEC3)
+      {
+        LOGW("Ignoring a sparse morph target that doesn't use float VEC3 values.\n");
+        return;
+      }
+      const auto addValue = [&](size_t index, const glm::vec3* value) {
+        deltas.indices.push_back(static_cast<uint32_t>(index));
+        deltas.values.push_back(*value);
+      };
+      tinygltf::utils::forEachSparseValue<glm::vec3>(model, accessor, 0, vertexCount, addValue);
+
+      // glTF requires increasing indices, but the blending relies on it so make sure
+      if(!std::is_sorted(deltas.indices.begin(), deltas.indices.end()))
+      {
+        std::vector<uint32_t> order(deltas.indices.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](uint32_t a, uint32_t b) { return deltas.indices[a] < deltas.indices[b]; });
+        MorphDeltas sorted;
+        for(uint32_t i : order)
+        {
+          sorted.indices.push_back(deltas.indices[i]);
+          sorted.values.push_back(deltas.values[i]);
+        }
+        deltas = std::move(sorted);
+      }
+      return;
+    }
+
+    std::vector<glm::vec3>           tempStorage;
+    const std::span<const glm::vec3> data = tinygltf::utils::getAccessorData2(model, accessor, tempStorage);
+    if(data.size() >= vertexCount)
+    {
+      deltas.values.assign(data.begin(), data.begin() + vertexCount);
+    }
+  };
+
+  const auto decodeTargets = [&](const char* attributeName, std::vector<MorphDeltas>& targets) {
+    for(size_t targetIndex = 0; targetIndex < primitive.targets.size(); targetIndex++)
+    {
+      const auto& findResult = primitive.targets[targetIndex].find(attributeName);
+      if(findResult != primitive.targets[targetIndex].end())
+      {
+        targets.resize(primitive.targets.size());
+        decodeDeltas(model.accessors[findResult->second], targets[targetIndex]);
+      }
+    }
+  };
+  decodeTargets("POSITION", cache.positionTargets);
+  if(!cache.normals.empty())
+    decodeTargets("NORMAL", cache.normalTargets);
+  if(!cache.tangents.empty())
+    decodeTargets("TANGENT", cache.tangentTargets);
+
+  return cache;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Blends the morph targets of one attribute for the vertices [begin, end) in a single pass:
+// all active targets are accumulated into a small chunk on the stack, which is then written once to `out`.
+// Tangents keep the handedness of the base (w).
+//
+template <typename T>
+void nvvkhl::SceneVk::blendMorphTargets(const T*                        base,
+                                        const std::vector<MorphDeltas>& targets,
+                                        const MorphWeights&             weights,
+                                        bool                            normalize,
+                                        uint64_t                        begin,
+                                        uint64_t                        end,
+                                        T*                              out)
 {
-  // Prepare for blending positions
-  std::vector<glm::vec3> blendedPositions(baseAccessor.count);
-  std::copy(basePositionData, basePositionData + baseAccessor.count, blendedPositions.begin());
+  constexpr uint64_t CHUNK_SIZE = 256;
+  glm::vec3          accum[CHUNK_SIZE];
 
-  // Blend the positions with the morph targets
-  for(size_t targetIndex = 0; targetIndex < primitive.targets.size(); ++targetIndex)
+  for(uint64_t chunkBegin = begin; chunkBegin < end; chunkBegin += CHUNK_SIZE)
   {
-    // Retrieve the weight for the current morph target
-    float weight = float(mesh.weights[targetIndex]);
-    if(weight == 0.0f)
-      continue;  // Skip this morph target if its weight is zero
-
-    // Get the morph target attribute (e.g., POSITION)
-    const auto& findResult = primitive.targets[targetIndex].find("POSITION");
-    if(findResult != primitive.targets[targetIndex].end())
+    const uint64_t count = std::min(CHUNK_SIZE, end - chunkBegin);
+    for(uint64_t i = 0; i < count; i++)
     {
-      const tinygltf::Accessor& morphAccessor = model.accessors[findResult->second];
-      std::vector<glm::vec3>    tempStorage;
-      const std::span<const glm::vec3> morphTargetData = tinygltf::utils::getAccessorData2(model, morphAccessor, tempStorage);
+      accum[i] = glm::vec3(base[chunkBegin + i]);
+    }
 
-      // Apply the morph target offset in parallel, scaled by the corresponding weight
-      nvh::parallel_batches(blendedPositions.size(),
-                            [&](uint64_t v) { blendedPositions[v] += weight * morphTargetData[v]; });
+    for(const auto& [target, weight] : weights)
+    {
+      if(target >= targets.size())
+      {
+        break;  // No target has this attribute
+      }
+      const MorphDeltas& deltas = targets[target];
+      if(deltas.indices.empty())
+      {
+        if(deltas.values.empty())
+        {
+          continue;
+        }
+        const glm::vec3* values = deltas.values.data() + chunkBegin;
+        for(uint64_t i = 0; i < count; i++)
+        {
+          accum[i] += weight * values[i];
+        }
+      }
+      else
+      {
+        // Scatter-add the sparse values that fall in this chunk
+        const auto first = std::lower_bound(deltas.indices.begin(), deltas.indices.end(), uint32_t(chunkBegin));
+        for(auto k = size_t(first - deltas.indices.begin()); k < deltas.indices.size(); k++)
+        {
+          if(deltas.indices[k] >= chunkBegin + count)
+          {
+            break;
+          }
+          accum[deltas.indices[k] - chunkBegin] += weight * deltas.values[k];
+        }
+      }
     }
-  }
 
-  return blendedPositions;
+    for(uint64_t i = 0; i < count; i++)
+    {
+      glm::vec3 value = accum[i];
+      if(normalize && glm::dot(value, value) > 0.0f)
+      {
+        value = glm::normalize(value);
+      }
+      if constexpr(std::is_same_v<T, glm::vec4>)
+      {
+        out[chunkBegin + i] = glm::vec4(value, base[chunkBegin + i].w);
+      }
+      else
+      {
+        out[chunkBegin + i] = value;
+      }
+    }
+  }
 }
 
-// Function to calculate skinned positions for a primitive
-std::vector<glm::vec3> getSkinnedPositions(const std::span<const glm::vec3>&  basePositionData,
-                                           const std::span<const glm::vec4>&  weights,
-                                           const std::span<const glm::ivec4>& joints,
-                                           const std::vector<glm::mat4>&      jointMatrices)
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+// Stores the xyz components of v, without writing past them
+static inline void storeVec3(float* dst, __m128 v)
 {
-  size_t vertexCount = weights.size();
+  _mm_storel_pi(reinterpret_cast<__m64*>(dst), v);
+  _mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+}
 
-  // Prepare the output skinned positions
-  std::vector<glm::vec3> skinnedPositions(vertexCount);
+// v * a + b
+static inline __m128 madd(__m128 v, float a, __m128 b)
+{
+  return _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(a)), b);
+}
 
-  // Apply skinning using multi-threading
-  nvh::parallel_batches<2048>(weights.size(), [&](uint64_t v) {
-    glm::vec3 skinnedPosition(0.0f);
+static inline __m128 normalize3(__m128 v)
+{
+  const __m128 sq     = _mm_mul_ps(v, v);
+  const float  length = _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, 1)), _mm_movehl_ps(sq, sq)));
+  return length > 0.0f ? _mm_mul_ps(v, _mm_set1_ps(1.0f / std::sqrt(length))) : v;
+}
+#endif
+
+// Linear blend skinning of the vertices [begin, end): the joint matrices of each vertex are blended by their weights,
+// then applied to the position, normal and tangent. The results are written to the output pointers, which are
+// typically staging memory; normals and tangents are only skinned if their output isn't null.
+static void skinVertices(const glm::vec4* weights,
+                         const uint16_t*  joints,
+                         const glm::mat4* jointMatrices,
+                         const glm::vec3* positions,
+                         const glm::vec3* normals,
+                         const glm::vec4* tangents,
+                         uint64_t         begin,
+                         uint64_t         end,
+                         glm::vec3*       outPositions,
+                         glm::vec3*       outNormals,
+                         glm::vec4*       outTangents)
+{
+  for(uint64_t v = begin; v < end; v++)
+  {
+    const glm::vec4& weight = weights[v];
+    const uint16_t*  joint  = joints + 4 * v;
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+    // Blended columns; the last row of the joint matrices is ignored since they are affine
+    __m128 c0 = _mm_setzero_ps();
+    __m128 c1 = _mm_setzero_ps();
+    __m128 c2 = _mm_setzero_ps();
+    __m128 c3 = _mm_setzero_ps();
+    for(int i = 0; i < 4; i++)
+    {
+      if(weight[i] > 0.0f)
+      {
+        const float* m = glm::value_ptr(jointMatrices[joint[i]]);
+        c0             = madd(_mm_loadu_ps(m + 0), weight[i], c0);
+        c1             = madd(_mm_loadu_ps(m + 4), weight[i], c1);
+        c2             = madd(_mm_loadu_ps(m + 8), weight[i], c2);
+        c3             = madd(_mm_loadu_ps(m + 12), weight[i], c3);
+      }
+    }
 
-    // Skinning: blend the position based on joint weights and transforms
-    for(int i = 0; i < 4; ++i)
+    const glm::vec3& p = positions[v];
+    storeVec3(glm::value_ptr(outPositions[v]), madd(c0, p.x, madd(c1, p.y, madd(c2, p.z, c3))));
+    if(outNormals)
     {
-      const float& jointWeight = weights[v][i];
-      if(jointWeight > 0.0f)
+      const glm::vec3& n       = normals[v];
+      const __m128     skinned = madd(c0, n.x, madd(c1, n.y, _mm_mul_ps(c2, _mm_set1_ps(n.z))));
+      storeVec3(glm::value_ptr(outNormals[v]), normalize3(skinned));
+    }
+    if(outTangents)
+    {
+      const glm::vec4& t       = tangents[v];
+      const __m128     skinned = madd(c0, t.x, madd(c1, t.y, _mm_mul_ps(c2, _mm_set1_ps(t.z))));
+      storeVec3(glm::value_ptr(outTangents[v]), normalize3(skinned));
+      outTangents[v].w = t.w;
+    }
+#else
+    glm::mat4 skinMatrix(0.0f);
+    for(int i = 0; i < 4; i++)
+    {
+      if(weight[i] > 0.0f)
       {
-        const int& jointIndex = joints[v][i];
-        skinnedPosition += jointWeight * glm::vec3(jointMatrices[jointIndex] * glm::vec4(basePositionData[v], 1.0f));
+        skinMatrix += weight[i] * jointMatrices[joint[i]];
       }
     }
 
-    skinnedPositions[v] = skinnedPosition;
-  });
+    outPositions[v] = glm::vec3(skinMatrix * glm::vec4(positions[v], 1.0f));
+    if(outNormals)
+    {
+      const glm::vec3 n = glm::mat3(skinMatrix) * normals[v];
+      outNormals[v]     = glm::dot(n, n) > 0.0f ? glm::normalize(n) : n;
+    }
+    if(outTangents)
+    {
+      const glm::vec3 t = glm::mat3(skinMatrix) * glm::vec3(tangents[v]);
+      outTangents[v]    = glm::vec4(glm::dot(t, t) > 0.0f ? glm::normalize(t) : t, tangents[v].w);
+    }
+#endif
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Decodes the skinning attributes of a primitive the first time it is skinned
+//
+const nvvkhl::SceneVk::SkinCache& nvvkhl::SceneVk::getSkinCache(const nvh::gltf::Scene& scn, int renderPrimID)
+{
+  auto it = m_skinCache.find(renderPrimID);
+  if(it != m_skinCache.end())
+  {
+    return it->second;
+  }
+
+  const tinygltf::Model&     model     = scn.getModel();
+  const tinygltf::Primitive& primitive = *scn.getRenderPrimitive(renderPrimID).pPrimitive;
+  SkinCache&                 cache     = m_skinCache[renderPrimID];
+
+  const auto decode = [&](const char* attributeName, auto& dst) {
+    using T                = typename std::remove_reference_t<decltype(dst)>::value_type;
+    const auto& findResult = primitive.attributes.find(attributeName);
+    if(findResult == primitive.attributes.end())
+    {
+      return;
+    }
+    std::vector<T>           tempStorage;
+    const std::span<const T> data =
+        tinygltf::utils::getAccessorData2(model, model.accessors[findResult->second], tempStorage);
+    dst.assign(data.begin(), data.end());
+  };
+  decode("POSITION", cache.positions);
+  decode("NORMAL", cache.normals);
+  decode("TANGENT", cache.tangents);
+  decode("WEIGHTS_0", cache.weights);
+
+  std::vector<glm::ivec4>     tempJointStorage;
+  std::span<const glm::ivec4> joints =
+      tinygltf::utils::getAccessorData2(model, model.accessors[primitive.attributes.at("JOINTS_0")], tempJointStorage);
+  cache.joints.resize(joints.size() * 4);
+  for(size_t v = 0; v < joints.size(); v++)
+  {
+    for(int i = 0; i < 4; i++)
+    {
+      cache.joints[4 * v + i] = static_cast<uint16_t>(joints[v][i]);
+      cache.maxJoint          = std::max(cache.maxJoint, static_cast<uint32_t>(cache.joints[4 * v + i]));
+    }
+  }
 
-  return skinnedPositions;
+  // All attributes must have one value per vertex
+  const size_t vertexCount = std::min({cache.positions.size(), cache.weights.size(), joints.size()});
+  cache.positions.resize(vertexCount);
+  cache.weights.resize(vertexCount);
+  cache.joints.resize(vertexCount * 4);
+  if(cache.normals.size() < vertexCount)
+    cache.normals.clear();
+  if(cache.tangents.size() < vertexCount)
+    cache.tangents.clear();
+
+  return cache;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -335,6 +619,43 @@ void nvvkhl::SceneVk::updateRenderNodesBuffer(VkCommandBuffer cmd, const nvh::gl
   }
 }
 
+//--------------------------------------------------------------------------------------------------
+// Partial update of the render nodes, for example the ones returned by nvh::gltf::Scene::updateDirtyRenderNodes
+// - The IDs must be sorted, consecutive IDs are uploaded with a single copy
+void nvvkhl::SceneVk::updateRenderNodesBuffer(VkCommandBuffer cmd, const nvh::gltf::Scene& scn, const std::vector<uint32_t>& renderNodeIDs)
+{
+  if(m_bRenderNode.buffer == VK_NULL_HANDLE)
+  {
+    updateRenderNodesBuffer(cmd, scn);
+    return;
+  }
+
+  const std::vector<nvh::gltf::RenderNode>& renderNodes = scn.getRenderNodes();
+
+  size_t i = 0;
+  while(i < renderNodeIDs.size())
+  {
+    // Find the range of consecutive render nodes
+    const uint32_t first = renderNodeIDs[i];
+    uint32_t       count = 1;
+    while(i + count < renderNodeIDs.size() && renderNodeIDs[i + count] == first + count)
+    {
+      count++;
+    }
+
+    nvvkhl_shaders::RenderNode* dst = m_alloc->getStaging()->cmdToBufferT<nvvkhl_shaders::RenderNode>(
+        cmd, m_bRenderNode.buffer, first * sizeof(nvvkhl_shaders::RenderNode), count * sizeof(nvvkhl_shaders::RenderNode));
+    for(uint32_t j = 0; j < count; j++)
+    {
+      const nvh::gltf::RenderNode& obj = renderNodes[first + j];
+      dst[j].objectToWorld             = obj.worldMatrix;
+      dst[j].worldToObject             = glm::inverse(obj.worldMatrix);
+      dst[j].materialID                = obj.materialID;
+      dst[j].renderPrimID              = obj.renderPrimID;
+    }
+    i += count;
+  }
+}
 
 //--------------------------------------------------------------------------------------------------
 // Update the buffer of all lights
@@ -369,74 +690,109 @@ void nvvkhl::SceneVk::updateRenderPrimitivesBuffer(VkCommandBuffer cmd, const nv
   // ** Morph **
   for(int renderPrimID : scn.getMorphPrimitives())
   {
-    const nvh::gltf::RenderPrimitive& renderPrimitive  = scn.getRenderPrimitive(renderPrimID);
-    const tinygltf::Primitive&        primitive        = *renderPrimitive.pPrimitive;
-    const tinygltf::Mesh&             mesh             = model.meshes[renderPrimitive.meshID];
-    const tinygltf::Accessor&         positionAccessor = model.accessors[primitive.attributes.at("POSITION")];
-    std::vector<glm::vec3>            tempStorage;
-    const std::span<const glm::vec3> positionData = tinygltf::utils::getAccessorData2(model, positionAccessor, tempStorage);
-
-    // Get blended position
-    std::vector<glm::vec3> blendedPositions = getBlendedPositions(positionAccessor, positionData.data(), primitive, mesh, model);
-
-    // Update buffer
-    VertexBuffers& vertexBuffers = m_vertexBuffers[renderPrimID];
-    m_alloc->getStaging()->cmdToBuffer(cmd, vertexBuffers.position.buffer, 0,
-                                       sizeof(glm::vec3) * positionAccessor.count, blendedPositions.data());
+    const nvh::gltf::RenderPrimitive& renderPrimitive = scn.getRenderPrimitive(renderPrimID);
+    const tinygltf::Mesh&             mesh            = model.meshes[renderPrimitive.meshID];
+    const MorphCache&                 cache           = getMorphCache(scn, renderPrimID);
+    if(cache.positions.empty())
+    {
+      continue;
+    }
+
+    // Only the targets with a non-zero weight are blended
+    m_morphActiveWeights.clear();
+    const size_t numTargets = std::min(mesh.weights.size(), renderPrimitive.pPrimitive->targets.size());
+    for(size_t targetIndex = 0; targetIndex < numTargets; targetIndex++)
+    {
+      if(mesh.weights[targetIndex] != 0.0)
+      {
+        m_morphActiveWeights.push_back({uint32_t(targetIndex), float(mesh.weights[targetIndex])});
+      }
+    }
+
+    // Blend directly into the staging memory of the vertex buffers; normals and tangents are only uploaded if a
+    // target modifies them
+    const VertexBuffers&        vertexBuffers = m_vertexBuffers[renderPrimID];
+    nvvk::StagingMemoryManager* staging       = m_alloc->getStaging();
+    const uint64_t              vertexCount   = cache.positions.size();
+    glm::vec3*                  outPositions =
+        staging->cmdToBufferT<glm::vec3>(cmd, vertexBuffers.position.buffer, 0, sizeof(glm::vec3) * vertexCount);
+    glm::vec3* outNormals  = nullptr;
+    glm::vec4* outTangents = nullptr;
+    if(!cache.normalTargets.empty() && vertexBuffers.normal.buffer != VK_NULL_HANDLE)
+    {
+      outNormals =
+          staging->cmdToBufferT<glm::vec3>(cmd, vertexBuffers.normal.buffer, 0, sizeof(glm::vec3) * vertexCount);
+    }
+    if(!cache.tangentTargets.empty() && vertexBuffers.tangent.buffer != VK_NULL_HANDLE)
+    {
+      outTangents =
+          staging->cmdToBufferT<glm::vec4>(cmd, vertexBuffers.tangent.buffer, 0, sizeof(glm::vec4) * vertexCount);
+    }
+
+    nvh::parallel_ranges<4096>(vertexCount, [&](uint64_t begin, uint64_t end, uint32_t /*threadIdx*/) {
+      const MorphWeights& weights = m_morphActiveWeights;
+      blendMorphTargets(cache.positions.data(), cache.positionTargets, weights, false, begin, end, outPositions);
+      if(outNormals)
+        blendMorphTargets(cache.normals.data(), cache.normalTargets, weights, true, begin, end, outNormals);
+      if(outTangents)
+        blendMorphTargets(cache.tangents.data(), cache.tangentTargets, weights, true, begin, end, outTangents);
+    });
   }
 
   // ** Skin **
   const std::vector<nvh::gltf::RenderNode>& renderNodes = scn.getRenderNodes();
   for(int skinNodeID : scn.getSkinNodes())
   {
-    const nvh::gltf::RenderNode& skinNode  = renderNodes[skinNodeID];
-    const tinygltf::Skin&        skin      = model.skins[skinNode.skinID];
-    const tinygltf::Primitive&   primitive = *scn.getRenderPrimitive(skinNode.renderPrimID).pPrimitive;
+    const nvh::gltf::RenderNode& skinNode = renderNodes[skinNodeID];
+    const tinygltf::Skin&        skin     = model.skins[skinNode.skinID];
+    const SkinCache&             cache    = getSkinCache(scn, skinNode.renderPrimID);
+    if(cache.positions.empty())
+    {
+      continue;
+    }
 
-    int32_t                numJoints = int32_t(skin.joints.size());
-    std::vector<glm::mat4> inverseBindMatrices(numJoints, glm::mat4(1));
-    std::vector<glm::mat4> jointMatrices(numJoints, glm::mat4(1));
+    // Calculate joint matrices; joints referenced by vertices but missing from the skin stay identity
+    const int32_t numJoints = int32_t(skin.joints.size());
+    m_skinJointMatrices.assign(std::max(size_t(numJoints), size_t(cache.maxJoint) + 1), glm::mat4(1));
 
+    std::span<const glm::mat4> inverseBindMatrices;
     if(skin.inverseBindMatrices > -1)
     {
-      std::span<const glm::mat4> ibm = tinygltf::utils::getBufferDataSpan<glm::mat4>(model, skin.inverseBindMatrices);
-      for(int i = 0; i < numJoints; i++)
-      {
-        inverseBindMatrices[i] = ibm[i];
-      }
+      inverseBindMatrices = tinygltf::utils::getBufferDataSpan<glm::mat4>(model, skin.inverseBindMatrices);
     }
 
-    // Calculate joint matrices
     const std::vector<glm::mat4>& nodeMatrices = scn.getNodesWorldMatrices();
     glm::mat4 invNode = glm::inverse(nodeMatrices[skinNode.refNodeID]);  // Removing current node transform as it will be applied by the shaders
     for(int i = 0; i < numJoints; ++i)
     {
-      int jointNodeID = skin.joints[i];
-      jointMatrices[i] = invNode * nodeMatrices[jointNodeID] * inverseBindMatrices[i];  // World matrix of the joint's node
+      int              jointNodeID = skin.joints[i];
+      const glm::mat4  ibm         = size_t(i) < inverseBindMatrices.size() ? inverseBindMatrices[i] : glm::mat4(1);
+      m_skinJointMatrices[i]       = invNode * nodeMatrices[jointNodeID] * ibm;  // World matrix of the joint's node
     }
 
-    // Getting the weights of all positions/joint
-    std::vector<glm::vec4>     tempWeightStorage;
-    std::span<const glm::vec4> weights =
-        tinygltf::utils::getAccessorData2(model, model.accessors[primitive.attributes.at("WEIGHTS_0")], tempWeightStorage);
-
-    // Getting the joint that each position is using
-    std::vector<glm::ivec4>     tempJointStorage;
-    std::span<const glm::ivec4> joints =
-        tinygltf::utils::getAccessorData2(model, model.accessors[primitive.attributes.at("JOINTS_0")], tempJointStorage);
-
-    // Original vertex positions
-    std::vector<glm::vec3>           tempPosStorage;
-    const std::span<const glm::vec3> basePositionData =
-        tinygltf::utils::getAccessorData2(model, model.accessors[primitive.attributes.at("POSITION")], tempPosStorage);
-
-    // Get skinned positions
-    std::vector<glm::vec3> skinnedPositions = getSkinnedPositions(basePositionData, weights, joints, jointMatrices);
+    // Skin directly into the staging memory of the vertex buffers
+    const VertexBuffers&        vertexBuffers = m_vertexBuffers[skinNode.renderPrimID];
+    nvvk::StagingMemoryManager* staging       = m_alloc->getStaging();
+    const uint64_t              vertexCount   = cache.positions.size();
+    glm::vec3*                  outPositions =
+        staging->cmdToBufferT<glm::vec3>(cmd, vertexBuffers.position.buffer, 0, sizeof(glm::vec3) * vertexCount);
+    glm::vec3* outNormals  = nullptr;
+    glm::vec4* outTangents = nullptr;
+    if(!cache.normals.empty() && vertexBuffers.normal.buffer != VK_NULL_HANDLE)
+    {
+      outNormals =
+          staging->cmdToBufferT<glm::vec3>(cmd, vertexBuffers.normal.buffer, 0, sizeof(glm::vec3) * vertexCount);
+    }
+    if(!cache.tangents.empty() && vertexBuffers.tangent.buffer != VK_NULL_HANDLE)
+    {
+      outTangents =
+          staging->cmdToBufferT<glm::vec4>(cmd, vertexBuffers.tangent.buffer, 0, sizeof(glm::vec4) * vertexCount);
+    }
 
-    // Update buffer
-    VertexBuffers& vertexBuffers = m_vertexBuffers[skinNode.renderPrimID];
-    m_alloc->getStaging()->cmdToBuffer(cmd, vertexBuffers.position.buffer, 0,
-                                       sizeof(glm::vec3) * skinnedPositions.size(), skinnedPositions.data());
+    nvh::parallel_ranges<4096>(vertexCount, [&](uint64_t begin, uint64_t end, uint32_t /*threadIdx*/) {
+      skinVertices(cache.weights.data(), cache.joints.data(), m_skinJointMatrices.data(), cache.positions.data(),
+                   cache.normals.data(), cache.tangents.data(), begin, end, outPositions, outNormals, outTangents);
+    });
   }
 }
 
@@ -600,6 +956,9 @@ void nvvkhl::SceneVk::createVertexBuffers(VkCommandBuffer cmd, const nvh::gltf::
 void nvvkhl::SceneVk::updateVertexBuffers(VkCommandBuffer cmd, const nvh::gltf::Scene& scene)
 {
   const auto& model = scene.getModel();
+  // The attributes may have changed, e.g. new tangents
+  m_skinCache.clear();
+  m_morphCache.clear();
 
   for(size_t primID = 0; primID < scene.getNumRenderPrimitives(); primID++)
   {
@@ -715,25 +1074,34 @@ void nvvkhl::SceneVk::createTextureImages(VkCommandBuffer cmd, const tinygltf::M
     usedImages.insert(source_image);
   }
 
-  // Load images in parallel
   m_images.resize(model.images.size());
-  uint32_t          num_threads = std::min((uint32_t)model.images.size(), std::thread::hardware_concurrency());
-  const std::string indent      = st.indent();
-  nvh::parallel_batches<1>(  // Not batching
-      model.images.size(),
-      [&](uint64_t i) {
-        if(usedImages.find(static_cast<int>(i)) == usedImages.end())
-          return;  // Skip unused images
-        const auto& image = model.images[i];
-        LOGI("%s(%" PRIu64 ") %s \n", indent.c_str(), i, image.uri.c_str());
-        loadImage(basedir, image, static_cast<int>(i));
-      },
-      num_threads);
-
+  if(m_streamQueue != VK_NULL_HANDLE)
+  {
+    // Decode and upload overlapped, within a memory budget
+    streamTextureImages(model, basedir, usedImages, generateMipmaps);
+  }
+  else
+  {
+    // Load images in parallel
+    uint32_t          num_threads = std::min((uint32_t)model.images.size(), std::thread::hardware_concurrency());
+    const std::string indent      = st.indent();
+    nvh::parallel_batches<1>(  // Not batching
+        model.images.size(),
+        [&](uint64_t i) {
+          if(usedImages.find(static_cast<int>(i)) == usedImages.end())
+            return;  // Skip unused images
+          const auto& image = model.images[i];
+          LOGI("%s(%" PRIu64 ") %s \n", indent.c_str(), i, image.uri.c_str());
+          loadImage(basedir, image, static_cast<int>(i));
+        },
+        num_threads);
+  }
 
   // Create Vulkan images
   for(size_t i = 0; i < m_images.size(); i++)
   {
+    if(m_images[i].nvvkImage.image != VK_NULL_HANDLE)
+      continue;  // Already streamed
     if(!createImage(cmd, m_images[i], generateMipmaps))
     {
       addDefaultImage((uint32_t)i, {255, 0, 255, 255});  // Image not present or incorrectly loaded (image.empty)
@@ -774,6 +1142,156 @@ void nvvkhl::SceneVk::createTextureImages(VkCommandBuffer cmd, const tinygltf::M
   }
 }
 
+//--------------------------------------------------------------------------------------------------------------
+// Decodes the used images on the thread pool while this thread uploads them. Images are recorded in batches into
+// own command buffers, each batch is submitted with a fence, and its staging memory is released once the fence
+// signaled. Decoding stalls while the decoded and staged bytes exceed m_streamInFlightBytes.
+//
+void nvvkhl::SceneVk::streamTextureImages(const tinygltf::Model&       model,
+                                          const std::filesystem::path& basedir,
+                                          const std::set<int>&         usedImages,
+                                          bool                         generateMipmaps)
+{
+  std::vector<int> order;
+  for(int imageID : usedImages)
+  {
+    if(imageID >= 0 && imageID < static_cast<int>(model.images.size()))
+      order.push_back(imageID);
+  }
+  if(order.empty())
+    return;
+
+  const VkDeviceSize budget     = std::max(m_streamInFlightBytes, VkDeviceSize(1));
+  const VkDeviceSize batchBytes = std::max(budget / 4, VkDeviceSize(1));
+
+  std::mutex              mutex;
+  std::condition_variable condition;  // Signaled when an image got decoded or in-flight bytes were released
+  std::deque<int>         decoded;
+  VkDeviceSize            inFlight = 0;  // Decoded plus staged bytes
+  std::atomic_size_t      next     = 0;
+
+  // Decoding runs on the thread pool, driven from a separate thread so this one can upload meanwhile.
+  // The callback waits for the budget, which is only allowed with the indexed variant.
+  std::thread decoder([&]() {
+    nvh::parallel_batches_indexed<1>(order.size(), [&](uint64_t, uint32_t) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&]() { return inFlight < budget; });
+      }
+      int imageID = order[next++];
+      LOGI("  (%d) %s \n", imageID, model.images[imageID].uri.c_str());
+      loadImage(basedir, model.images[imageID], imageID);
+
+      VkDeviceSize bytes = 0;
+      for(const auto& mip : m_images[imageID].mipData)
+        bytes += mip.size();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight += bytes;
+        decoded.push_back(imageID);
+      }
+      condition.notify_all();
+    });
+  });
+
+  struct Batch
+  {
+    VkCommandBuffer cmd{VK_NULL_HANDLE};
+    VkFence         fence{VK_NULL_HANDLE};
+    VkDeviceSize    bytes{0};
+  };
+
+  nvvk::CommandPool          cmdPool(m_device, m_streamQueueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, m_streamQueue);
+  nvvk::StagingMemoryManager staging(m_alloc->getMemoryAllocator());
+  Batch                      recording;
+  std::deque<Batch>          submitted;
+
+  auto submitBatch = [&]() {
+    if(recording.cmd == VK_NULL_HANDLE)
+      return;
+    VkFenceCreateInfo fence_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    vkCreateFence(m_device, &fence_info, nullptr, &recording.fence);
+    cmdPool.submit(1, &recording.cmd, recording.fence);
+    staging.finalizeResources(recording.fence);
+    submitted.push_back(recording);
+    recording = {};
+  };
+
+  // Releases completed batches, waiting for the oldest one if `wait` is set
+  auto releaseBatches = [&](bool wait) {
+    VkDeviceSize released = 0;
+    while(!submitted.empty())
+    {
+      Batch& batch = submitted.front();
+      if(wait)
+        vkWaitForFences(m_device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+      else if(vkGetFenceStatus(m_device, batch.fence) != VK_SUCCESS)
+        break;
+      wait = false;
+      released += batch.bytes;
+      cmdPool.destroy(batch.cmd);
+      vkDestroyFence(m_device, batch.fence, nullptr);
+      submitted.pop_front();
+    }
+    if(released)
+    {
+      staging.releaseResources();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight -= released;
+      }
+      condition.notify_all();
+    }
+  };
+
+  size_t numUploaded = 0;
+  while(numUploaded < order.size())
+  {
+    int imageID = -1;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if(decoded.empty() && recording.cmd == VK_NULL_HANDLE && submitted.empty())
+        condition.wait(lock, [&]() { return !decoded.empty(); });
+      if(!decoded.empty())
+      {
+        imageID = decoded.front();
+        decoded.pop_front();
+      }
+    }
+
+    if(imageID >= 0)
+    {
+      SceneImage&  image = m_images[imageID];
+      VkDeviceSize bytes = 0;
+      for(const auto& mip : image.mipData)
+        bytes += mip.size();
+
+      if(recording.cmd == VK_NULL_HANDLE)
+        recording.cmd = cmdPool.createCommandBuffer();
+      createImage(recording.cmd, staging, image, generateMipmaps);  // Failed images get a default image later
+      recording.bytes += bytes;
+      numUploaded++;
+
+      if(recording.bytes < batchBytes)
+      {
+        releaseBatches(false);
+        continue;
+      }
+    }
+
+    // Nothing decoded yet or batch is full: submit, and give memory back to the decoders
+    submitBatch();
+    releaseBatches(imageID < 0);
+  }
+
+  submitBatch();
+  while(!submitted.empty())
+    releaseBatches(true);
+
+  decoder.join();
+  staging.deinit();
+}
+
 //-------------------------------------------------------------------------------------------------
 // Some images must be sRgb encoded, we find them and will be uploaded with the _SRGB format.
 //
@@ -854,6 +1372,7 @@ void nvvkhl::SceneVk::loadImage(const std::filesystem::path& basedir, const tiny
   {
     nv_dds::Image         ddsImage{};
     nv_dds::ReadSettings  settings{};
+    settings.zeroCopy                = true;  // mips are copied from the mapped file once
     nv_dds::ErrorWithText readResult = ddsImage.readFromFile(imgURI.c_str(), settings);
     if(readResult.has_value())
     {
@@ -890,8 +1409,8 @@ void nvvkhl::SceneVk::loadImage(const std::filesystem::path& basedir, const tiny
     // Add all mip-levels
     for(uint32_t i = 0; i < ddsImage.getNumMips(); i++)
     {
-      const std::vector<char>& mip = ddsImage.subresource(i, 0, 0).data;
-      image.mipData.emplace_back(mip.data(), mip.data() + mip.size());
+      const nv_dds::Subresource& mip = ddsImage.subresource(i, 0, 0);
+      image.mipData.emplace_back(mip.bytes(), mip.bytes() + mip.size());
     }
   }
   else if(extension == ".ktx" || extension == ".ktx2")
@@ -993,6 +1512,11 @@ void nvvkhl::SceneVk::loadImage(const std::filesystem::path& basedir, const tiny
 }
 
 bool nvvkhl::SceneVk::createImage(const VkCommandBuffer& cmd, SceneImage& image, bool generateMipmaps)
+{
+  return createImage(cmd, *m_alloc->getStaging(), image, generateMipmaps);
+}
+
+bool nvvkhl::SceneVk::createImage(const VkCommandBuffer& cmd, nvvk::StagingMemoryManager& staging, SceneImage& image, bool generateMipmaps)
 {
   if(image.size.width == 0 || image.size.height == 0)
     return false;
@@ -1021,8 +1545,16 @@ bool nvvkhl::SceneVk::createImage(const VkCommandBuffer& cmd, SceneImage& image,
   // Keep info for the creation of the texture
   image.createInfo = image_create_info;
 
-  VkDeviceSize buffer_size  = image.mipData[0].size();
-  nvvk::Image  result_image = m_alloc->createImage(cmd, buffer_size, image.mipData[0].data(), image_create_info);
+  // Upload the base level through the given staging memory
+  VkDeviceSize             buffer_size  = image.mipData[0].size();
+  nvvk::Image              result_image = m_alloc->createImage(image_create_info);
+  VkImageSubresourceRange  range{VK_IMAGE_ASPECT_COLOR_BIT, 0, image_create_info.mipLevels, 0, 1};
+  VkImageSubresourceLayers base_layer{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  nvvk::cmdBarrierImageLayout(cmd, result_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range);
+  staging.cmdToImage(cmd, result_image.image, VkOffset3D{}, image_create_info.extent, base_layer, buffer_size,
+                     image.mipData[0].data());
+  nvvk::cmdBarrierImageLayout(cmd, result_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range);
 
   if(image.mipData.size() == 1 && (can_generate_mipmaps && generateMipmaps))
   {
@@ -1032,7 +1564,6 @@ bool nvvkhl::SceneVk::createImage(const VkCommandBuffer& cmd, SceneImage& image,
   {
     // Create all mip-levels
     nvvk::cmdBarrierImageLayout(cmd, result_image.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    auto staging = m_alloc->getStaging();
     for(uint32_t mip = 1; mip < (uint32_t)image_create_info.mipLevels; mip++)
     {
       image_create_info.extent.width  = std::max(1u, image.size.width >> mip);
@@ -1048,8 +1579,8 @@ bool nvvkhl::SceneVk::createImage(const VkCommandBuffer& cmd, SceneImage& image,
       VkDeviceSize          bufferSize  = mipresource.size();
       if(image_create_info.extent.width > 0 && image_create_info.extent.height > 0)
       {
-        staging->cmdToImage(cmd, result_image.image, offset, image_create_info.extent, subresource, bufferSize,
-                            mipresource.data());
+        staging.cmdToImage(cmd, result_image.image, offset, image_create_info.extent, subresource, bufferSize,
+                           mipresource.data());
       }
     }
     nvvk::cmdBarrierImageLayout(cmd, result_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -1149,4 +1680,6 @@ void nvvkhl::SceneVk::destroy()
   m_textures.clear();
 
   m_sRgbImages.clear();
+  m_skinCache.clear();
+  m_morphCache.clear();
 }
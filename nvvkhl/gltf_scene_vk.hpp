@@ -21,6 +21,7 @@
 
 #include <filesystem>
 #include <set>
+#include <unordered_map>
 
 #include "nvvk/debug_util_vk.hpp"
 #include "nvvk/context_vk.hpp"
@@ -62,12 +63,22 @@ public:
 
   void         update(VkCommandBuffer cmd, const nvh::gltf::Scene& scn);
   void         updateRenderNodesBuffer(VkCommandBuffer cmd, const nvh::gltf::Scene& scn);
+  void         updateRenderNodesBuffer(VkCommandBuffer              cmd,
+                                       const nvh::gltf::Scene&      scn,
+                                       const std::vector<uint32_t>& renderNodeIDs);  // Partial update
   void         updateRenderPrimitivesBuffer(VkCommandBuffer cmd, const nvh::gltf::Scene& scn);
   void         updateRenderLightsBuffer(VkCommandBuffer cmd, const nvh::gltf::Scene& scn);
   void         updateMaterialBuffer(VkCommandBuffer cmd, const nvh::gltf::Scene& scn);
   void         updateVertexBuffers(VkCommandBuffer cmd, const nvh::gltf::Scene& scene);
   virtual void destroy();
 
+  // Makes create() stream textures: images are decoded in parallel while the calling thread uploads them in
+  // batches through own command buffers on `queue`, recycling staging memory as batches complete. Decoded and
+  // staged image data stays within `inFlightBytes` (plus one image per decoding thread).
+  // The queue must belong to the family the `cmd` given to create() is submitted to.
+  // Without streaming, all images are decoded first and uploaded with the `cmd` given to create().
+  void setTextureStreaming(VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize inFlightBytes = 256ULL << 20);
+
   // Getters
   const nvvk::Buffer&               material() const { return m_bMaterial; }
   const nvvk::Buffer&               primInfo() const { return m_bRenderPrim; }
@@ -99,6 +110,52 @@ protected:
 
   virtual void loadImage(const std::filesystem::path& basedir, const tinygltf::Image& gltfImage, int imageID);
   virtual bool createImage(const VkCommandBuffer& cmd, SceneImage& image, bool generateMipmaps);
+  bool createImage(const VkCommandBuffer& cmd, nvvk::StagingMemoryManager& staging, SceneImage& image, bool generateMipmaps);
+  void streamTextureImages(const tinygltf::Model&       model,
+                           const std::filesystem::path& basedir,
+                           const std::set<int>&         usedImages,
+                           bool                         generateMipmaps);
+
+  // Skinning inputs of a primitive, decoded once from the glTF accessors and kept as one array per attribute
+  struct SkinCache
+  {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;   // Empty if the primitive has no normals
+    std::vector<glm::vec4> tangents;  // Empty if the primitive has no tangents
+    std::vector<glm::vec4> weights;
+    std::vector<uint16_t>  joints;    // 4 joint indices per vertex
+    uint32_t               maxJoint = 0;
+  };
+  const SkinCache& getSkinCache(const nvh::gltf::Scene& scn, int renderPrimID);
+
+  // Morph target deltas of one attribute; sparse targets only store the vertices they modify
+  struct MorphDeltas
+  {
+    std::vector<glm::vec3> values;   // One per vertex if dense, one per index if sparse
+    std::vector<uint32_t>  indices;  // Sorted vertex indices of the values if sparse, empty if dense
+  };
+
+  // Morph inputs of a primitive, decoded once from the glTF accessors
+  struct MorphCache
+  {
+    std::vector<glm::vec3>   positions;
+    std::vector<glm::vec3>   normals;          // Empty if the primitive has no normals
+    std::vector<glm::vec4>   tangents;         // Empty if the primitive has no tangents
+    std::vector<MorphDeltas> positionTargets;  // One per morph target, empty if no target has the attribute
+    std::vector<MorphDeltas> normalTargets;
+    std::vector<MorphDeltas> tangentTargets;
+  };
+  const MorphCache& getMorphCache(const nvh::gltf::Scene& scn, int renderPrimID);
+
+  using MorphWeights = std::vector<std::pair<uint32_t, float>>;  // (target, weight) of the active targets
+  template <typename T>
+  static void blendMorphTargets(const T*                        base,
+                                const std::vector<MorphDeltas>& targets,
+                                const MorphWeights&             weights,
+                                bool                            normalize,
+                                uint64_t                        begin,
+                                uint64_t                        end,
+                                T*                              out);
 
   //--
   VkDevice         m_device{VK_NULL_HANDLE};
@@ -118,6 +175,15 @@ protected:
   std::vector<nvvk::Texture> m_textures;  // Vector of all textures of the scene
 
   std::set<int> m_sRgbImages;  // All images that are in sRGB (typically, only the one used by baseColorTexture)
+
+  VkQueue      m_streamQueue{VK_NULL_HANDLE};  // See setTextureStreaming()
+  uint32_t     m_streamQueueFamily{0};
+  VkDeviceSize m_streamInFlightBytes{0};
+
+  std::unordered_map<int, SkinCache>  m_skinCache;           // Key: render primitive ID
+  std::vector<glm::mat4>              m_skinJointMatrices;   // Reused every frame
+  std::unordered_map<int, MorphCache> m_morphCache;          // Key: render primitive ID
+  MorphWeights                        m_morphActiveWeights;  // Reused every frame
 };
 
 }  // namespace nvvkhl